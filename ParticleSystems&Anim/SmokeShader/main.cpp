@@ -7,6 +7,7 @@
 #include "shader.h"
 #include "camera.h"
 #include "model.h"
+#include "headless.h"
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -76,42 +77,55 @@ void drawGui();
 //-----------------------------------------------------------------------------------------------------------------------------------------
 //-------------------------------------------------------------------MAIN------------------------------------------------------------------
 //-----------------------------------------------------------------------------------------------------------------------------------------
-int main()
+int main(int argc, char** argv)
 {
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    // --headless [frames] renders offscreen at a fixed timestep and prints frame statistics, see headless.h
+    HeadlessRun headless;
+    headless.parseArgs(argc, argv);
 
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // uncomment this statement to fix compilation on OS X
-#endif
-
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Smoke", NULL, NULL);
-    if (window == NULL)
+    GLFWwindow* window = NULL;
+    if (headless.enabled)
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+        if (!headless.init(SCR_WIDTH, SCR_HEIGHT, 4, 4))
+            return -1;
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, cursor_input_callback);
-    glfwSetKeyCallback(window, key_input_callback);
-    glfwSetScrollCallback(window, scroll_callback);
+    else
+    {
+        // glfw: initialize and configure
+        // ------------------------------
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // uncomment this statement to fix compilation on OS X
+#endif
 
-    // glad: load all OpenGL function pointers
-    // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+        // glfw window creation
+        // --------------------
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Smoke", NULL, NULL);
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetCursorPosCallback(window, cursor_input_callback);
+        glfwSetKeyCallback(window, key_input_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+        // glad: load all OpenGL function pointers
+        // ---------------------------------------
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
     }
 	
     smokeShader = new Shader("shaders/smoke.vert", "shaders/smoke.frag");
@@ -136,29 +150,33 @@ int main()
 	
     initParticlesBuffer();
 
-    // Dear IMGUI init
-    // ---------------
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    // Setup Dear ImGui style
-    ImGui::StyleColorsDark();
-    // Setup Platform/Renderer bindings
-    ImGui_ImplGlfw_InitForOpenGL(window, true);
-    ImGui_ImplOpenGL3_Init("#version 440 core");
+    if (!headless.enabled)
+    {
+        // Dear IMGUI init
+        // ---------------
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        // Setup Dear ImGui style
+        ImGui::StyleColorsDark();
+        // Setup Platform/Renderer bindings
+        ImGui_ImplGlfw_InitForOpenGL(window, true);
+        ImGui_ImplOpenGL3_Init("#version 440 core");
+    }
     
     // render loop
     // -----------   
-    while (!glfwWindowShouldClose(window))
+    while (headless.enabled ? headless.nextFrame() : !glfwWindowShouldClose(window))
     {
         static float lastFrame = 0.0f;
-        float currentFrame = (float)glfwGetTime();
+        float currentFrame = headless.enabled ? headless.time() : (float)glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
         config.Time = currentFrame;
 		config.H = deltaTime;
 
-        processInput(window);
+        if (!headless.enabled)
+            processInput(window);
         		
         shader->use();
         
@@ -168,16 +186,25 @@ int main()
             drawGui();
         }
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (!headless.enabled)
+        {
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
     }
 
     // Cleanup
     // -------
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
+    if (!headless.enabled)
+    {
+        ImGui_ImplOpenGL3_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+    }
 	
+    if (headless.enabled)
+        headless.finish();
+
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
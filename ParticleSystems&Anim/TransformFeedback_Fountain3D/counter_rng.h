@@ -0,0 +1,66 @@
+// Counter-based random numbers, the CPU side of shaders/counter_rng.glsl
+#ifndef COUNTER_RNG_H
+#define COUNTER_RNG_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3") keeps no state: the four
+// numbers are a pure function of a 128 bit counter and a 64 bit key. Particle i simply asks for the counter
+// (i, generation, stream, 0), so initialization can be split over any number of threads or shader invocations
+// and a respawn can draw new numbers without a generator per particle or a stored initial velocity.
+// counter_rng.glsl computes the same bits with umulExtended().
+
+// streams keep the numbers of different attributes of the same particle independent
+const glm::uint RNG_STREAM_VELOCITY = 0;
+const glm::uint RNG_STREAM_POSITION = 1;
+
+inline glm::uvec4 philox4x32(glm::uvec4 counter, glm::uvec2 key)
+{
+    for (int round = 0; round < 10; round++)
+    {
+        uint64_t product0 = (uint64_t)0xD2511F53u * counter.x;
+        uint64_t product1 = (uint64_t)0xCD9E8D57u * counter.z;
+        counter = glm::uvec4((glm::uint)(product1 >> 32) ^ counter.y ^ key.x, (glm::uint)product1,
+                             (glm::uint)(product0 >> 32) ^ counter.w ^ key.y, (glm::uint)product0);
+        key += glm::uvec2(0x9E3779B9u, 0xBB67AE85u);
+    }
+    return counter;
+}
+
+// uniform float in [0, 1), the top 24 bits are exact in a float on both sides
+inline float rngUnitFloat(glm::uint bits)
+{
+    return (float)(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+// the four numbers of (id, generation, stream) as uniform floats in [0, 1)
+inline glm::vec4 rngUniform4(glm::uint seed, glm::uint id, glm::uint generation, glm::uint stream)
+{
+    glm::uvec4 bits = philox4x32(glm::uvec4(id, generation, stream, 0u), glm::uvec2(seed, 0u));
+    return glm::vec4(rngUnitFloat(bits.x), rngUnitFloat(bits.y), rngUnitFloat(bits.z), rngUnitFloat(bits.w));
+}
+
+// generation of a respawn at the given time: the bits of the time are unique for every respawn of a particle
+inline glm::uint rngTimeGeneration(float time)
+{
+    glm::uint bits;
+    std::memcpy(&bits, &time, sizeof(bits));
+    return bits;
+}
+
+// velocity in a cone around +y, angle is the half opening in radians, speed the (min, max) magnitude.
+// Same distribution as the original fountain: theta and phi uniform, not uniform over the cap.
+inline glm::vec3 rngSpawnVelocity(glm::uint seed, glm::uint id, glm::uint generation, float angle, glm::vec2 speed)
+{
+    glm::vec4 u = rngUniform4(seed, id, generation, RNG_STREAM_VELOCITY);
+    float theta = angle * u.x;
+    float phi = glm::two_pi<float>() * u.y;
+    float magnitude = glm::mix(speed.x, speed.y, u.z);
+    return glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)) * magnitude;
+}
+#endif
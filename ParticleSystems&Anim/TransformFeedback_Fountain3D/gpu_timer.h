@@ -0,0 +1,185 @@
+// GPU time of the render passes with double-buffered GL_TIME_ELAPSED queries
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// passes of a frame, in the order they are drawn. Time elapsed queries can not nest, every pass is
+// one begin()/end() interval per frame.
+enum GpuPass {
+    GPU_PASS_SKYBOX,
+    GPU_PASS_UPDATE,
+    GPU_PASS_RENDER,
+    GPU_PASS_COMPOSITE, // reduced resolution particles laid over the frame, see particle_target.h
+    GPU_PASS_GUI,
+    GPU_PASS_COUNT
+};
+
+inline const char* gpuPassName(GpuPass pass)
+{
+    static const char* names[GPU_PASS_COUNT] = { "skybox", "update", "render", "composite", "gui" };
+    return names[pass];
+}
+
+// Frame N records its queries in set N % 2 and reads the results of set N % 2 from frame N - 2 just before
+// reusing it, so the CPU never waits for the GPU to finish the frame it just submitted. A result that is
+// still not available after two frames is dropped instead of stalling.
+class GpuPassTimer
+{
+public:
+    static const int HISTORY = 60; // frames averaged for display
+
+    GpuPassTimer() : frame(0), collected(0), active(GPU_PASS_COUNT)
+    {
+        glGenQueries(2 * GPU_PASS_COUNT, &queries[0][0]);
+        for (int set = 0; set < 2; set++)
+            for (int pass = 0; pass < GPU_PASS_COUNT; pass++)
+                issued[set][pass] = false;
+        for (int i = 0; i < HISTORY; i++)
+            for (int pass = 0; pass < GPU_PASS_COUNT; pass++)
+                history[i][pass] = 0.0f;
+    }
+
+    ~GpuPassTimer()
+    {
+        glDeleteQueries(2 * GPU_PASS_COUNT, &queries[0][0]);
+    }
+
+    GpuPassTimer(const GpuPassTimer&) = delete;
+    GpuPassTimer& operator=(const GpuPassTimer&) = delete;
+
+    // every collected frame is appended to path as one CSV row
+    // ------------------------------------------------------------------------
+    bool openCsv(const std::string& path)
+    {
+        csv.open(path.c_str());
+        if (!csv)
+        {
+            std::cout << "ERROR::GPU_TIMER::CSV_NOT_OPENED " << path << std::endl;
+            return false;
+        }
+        csv << "frame";
+        for (int pass = 0; pass < GPU_PASS_COUNT; pass++)
+            csv << "," << gpuPassName((GpuPass)pass) << "_ms";
+        csv << ",total_ms\n";
+        return true;
+    }
+
+    // collects the results of the frame that used this query set two frames ago
+    // ------------------------------------------------------------------------
+    void beginFrame()
+    {
+        if (frame >= 2)
+            collect(frame - 2, false);
+    }
+
+    void begin(GpuPass pass)
+    {
+        glBeginQuery(GL_TIME_ELAPSED, queries[frame % 2][pass]);
+        issued[frame % 2][pass] = true;
+        active = pass;
+    }
+
+    void end()
+    {
+        if (active == GPU_PASS_COUNT)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        active = GPU_PASS_COUNT;
+    }
+
+    void endFrame() { frame++; }
+
+    // waits for the frames still in flight, at the end of a run
+    // ------------------------------------------------------------------------
+    void finish()
+    {
+        for (int f = frame < 2 ? 0 : frame - 2; f < frame; f++)
+            collect(f, true);
+    }
+
+    // average over the last HISTORY collected frames
+    // ------------------------------------------------------------------------
+    float averageMs(GpuPass pass) const
+    {
+        int frames = collected < HISTORY ? collected : HISTORY;
+        if (frames == 0)
+            return 0.0f;
+        float sum = 0.0f;
+        for (int i = 0; i < frames; i++)
+            sum += history[i][pass];
+        return sum / frames;
+    }
+
+    float averageTotalMs() const
+    {
+        float sum = 0.0f;
+        for (int pass = 0; pass < GPU_PASS_COUNT; pass++)
+            sum += averageMs((GpuPass)pass);
+        return sum;
+    }
+
+private:
+    GLuint queries[2][GPU_PASS_COUNT];
+    bool issued[2][GPU_PASS_COUNT]; // passes drawn by the frame that used the set, the GUI is optional
+    int frame; // frames begun so far
+    int collected; // frames whose results were read back
+    GpuPass active;
+    float history[HISTORY][GPU_PASS_COUNT];
+    std::ofstream csv;
+
+    // reads the query set of the given frame, without wait the frame is dropped if a result is not ready
+    void collect(int resultFrame, bool wait)
+    {
+        int set = resultFrame % 2;
+        float ms[GPU_PASS_COUNT];
+        bool complete = false;
+        for (int pass = 0; pass < GPU_PASS_COUNT; pass++)
+            complete = complete || issued[set][pass];
+        for (int pass = 0; pass < GPU_PASS_COUNT; pass++)
+        {
+            ms[pass] = 0.0f;
+            if (!issued[set][pass])
+                continue;
+            GLint available = 0;
+            if (!wait)
+                glGetQueryObjectiv(queries[set][pass], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!wait && !available)
+            {
+                complete = false;
+                continue;
+            }
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(queries[set][pass], GL_QUERY_RESULT, &ns);
+            ms[pass] = ns * 1e-6f;
+        }
+        for (int pass = 0; pass < GPU_PASS_COUNT; pass++)
+            issued[set][pass] = false;
+        if (complete)
+            record(resultFrame, ms);
+    }
+
+    void record(int resultFrame, const float* ms)
+    {
+        float total = 0.0f;
+        for (int pass = 0; pass < GPU_PASS_COUNT; pass++)
+        {
+            history[collected % HISTORY][pass] = ms[pass];
+            total += ms[pass];
+        }
+        collected++;
+
+        if (csv.is_open())
+        {
+            csv << resultFrame;
+            for (int pass = 0; pass < GPU_PASS_COUNT; pass++)
+                csv << "," << ms[pass];
+            csv << "," << total << "\n";
+        }
+    }
+};
+#endif
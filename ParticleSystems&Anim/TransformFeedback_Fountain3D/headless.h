@@ -0,0 +1,321 @@
+// Offscreen run mode for machines without a display or GPU (render nodes, CI)
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <dlfcn.h>
+#endif
+
+// --headless [frames] replaces the window by an offscreen context and renders a fixed number of frames at a
+// fixed timestep (--timestep seconds, default 1/60) into a framebuffer object, then prints the frame time
+// statistics and a checksum of the last frame and exits. --capture file.ppm also writes the last frame.
+//
+// The context is created with EGL on the surfaceless Mesa platform when libEGL can be loaded (llvmpipe needs
+// neither a display nor a GPU). Otherwise a hidden GLFW window is used, which needs no display either when
+// GLFW is configured with -DGLFW_USE_OSMESA=ON (null window backend with an OSMesa context).
+class HeadlessRun
+{
+public:
+    bool enabled = false;
+    int frames = 300;
+    float timestep = 1.0f / 60.0f;
+    std::string capturePath;
+
+    // picks up --headless [frames], --timestep s and --capture path, other arguments are left to the demo
+    // ------------------------------------------------------------------------
+    void parseArgs(int argc, char** argv)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            bool hasValue = i + 1 < argc && argv[i + 1][0] != '-';
+            if (std::strcmp(argv[i], "--headless") == 0)
+            {
+                enabled = true;
+                if (hasValue)
+                    frames = std::max(1, std::atoi(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--timestep") == 0 && hasValue)
+                timestep = (float)std::atof(argv[++i]);
+            else if (std::strcmp(argv[i], "--capture") == 0 && hasValue)
+                capturePath = argv[++i];
+        }
+    }
+
+    // creates the context, loads the GL functions and sets up the framebuffer the frames are drawn to
+    // ------------------------------------------------------------------------
+    bool init(unsigned int width, unsigned int height, int glMajor, int glMinor)
+    {
+        this->width = width;
+        this->height = height;
+
+        if (!createEglContext(glMajor, glMinor) && !createHiddenWindow(glMajor, glMinor))
+        {
+            std::cout << "ERROR::HEADLESS::NO_CONTEXT neither EGL nor a hidden GLFW window is available" << std::endl;
+            return false;
+        }
+        std::cout << "Headless: " << glGetString(GL_RENDERER) << ", OpenGL " << glGetString(GL_VERSION) << std::endl;
+
+        glGenRenderbuffers(2, renderbuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "ERROR::HEADLESS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+            return false;
+        }
+        // a surfaceless context starts with an empty viewport
+        glViewport(0, 0, width, height);
+
+        frameMs.reserve(frames);
+        return true;
+    }
+
+    // true while frames remain, starts timing the next frame
+    // ------------------------------------------------------------------------
+    bool nextFrame()
+    {
+        if (frame > 0)
+            endFrame();
+        if (frame == frames)
+            return false;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        frameStart = std::chrono::steady_clock::now();
+        if (frame == 0)
+            runStart = frameStart;
+        frame++;
+        return true;
+    }
+
+    // animation time of the current frame, the first frame is at t = timestep
+    float time() const { return frame * timestep; }
+
+    // prints the statistics, writes the capture and releases the context
+    // ------------------------------------------------------------------------
+    void finish()
+    {
+        double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - runStart).count();
+
+        std::vector<unsigned char> pixels((size_t)width * height * 4);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+        std::vector<double> sorted(frameMs);
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0.0;
+        for (double ms : sorted)
+            sum += ms;
+        double mean = sum / sorted.size();
+
+        std::printf("Headless: %d frames of %.4f s (%.2f s animated) in %.1f ms, %.1f FPS\n", frames, timestep,
+                    frames * timestep, totalMs, 1000.0 * frames / totalMs);
+        std::printf("Frame ms: mean %.3f, min %.3f, median %.3f, p95 %.3f, max %.3f\n", mean, sorted.front(),
+                    percentile(sorted, 0.5), percentile(sorted, 0.95), sorted.back());
+        std::printf("Last frame: %ux%u, checksum %08x\n", width, height, checksum(pixels));
+        if (!capturePath.empty())
+            writePPM(pixels);
+        release();
+    }
+
+    // releases the framebuffer and the context without drawing a frame, for modes that only need the context
+    // ------------------------------------------------------------------------
+    void release()
+    {
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(2, renderbuffers);
+        destroyContext();
+    }
+
+private:
+    unsigned int width = 0, height = 0;
+    GLuint framebuffer = 0;
+    GLuint renderbuffers[2] = { 0, 0 }; // color, depth stencil
+    int frame = 0;
+    std::vector<double> frameMs;
+    std::chrono::steady_clock::time_point runStart, frameStart;
+    GLFWwindow* window = nullptr;
+
+    // EGL is loaded at run time like GLFW does, so the demos do not link against it. Only the handful of
+    // entry points and enums used here are declared.
+    typedef void* EGLDisplay;
+    typedef void* EGLConfig;
+    typedef void* EGLContext;
+    typedef void* EGLSurface;
+    typedef int EGLint;
+    typedef unsigned int EGLBoolean;
+    typedef void* (*PFN_eglGetProcAddress)(const char*);
+    typedef EGLDisplay (*PFN_eglGetPlatformDisplayEXT)(unsigned int, void*, const EGLint*);
+    typedef EGLDisplay (*PFN_eglGetDisplay)(void*);
+    typedef EGLBoolean (*PFN_eglInitialize)(EGLDisplay, EGLint*, EGLint*);
+    typedef EGLBoolean (*PFN_eglBindAPI)(unsigned int);
+    typedef EGLBoolean (*PFN_eglChooseConfig)(EGLDisplay, const EGLint*, EGLConfig*, EGLint, EGLint*);
+    typedef EGLContext (*PFN_eglCreateContext)(EGLDisplay, EGLConfig, EGLContext, const EGLint*);
+    typedef EGLBoolean (*PFN_eglMakeCurrent)(EGLDisplay, EGLSurface, EGLSurface, EGLContext);
+    typedef EGLBoolean (*PFN_eglDestroyContext)(EGLDisplay, EGLContext);
+    typedef EGLBoolean (*PFN_eglTerminate)(EGLDisplay);
+    enum {
+        EGL_NONE = 0x3038,
+        EGL_RENDERABLE_TYPE = 0x3040,
+        EGL_OPENGL_BIT = 0x0008,
+        EGL_OPENGL_API = 0x30A2,
+        EGL_CONTEXT_MAJOR_VERSION = 0x3098,
+        EGL_CONTEXT_MINOR_VERSION = 0x30FB,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK = 0x30FD,
+        EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT = 0x0001,
+        EGL_PLATFORM_SURFACELESS_MESA = 0x31DD
+    };
+
+    void* egl = nullptr;
+    EGLDisplay eglDisplay = nullptr;
+    EGLContext eglContext = nullptr;
+    static PFN_eglGetProcAddress& eglGetProcAddressFn()
+    {
+        static PFN_eglGetProcAddress fn = nullptr;
+        return fn;
+    }
+    static void* eglLoad(const char* name) { return eglGetProcAddressFn()(name); }
+
+    bool createEglContext(int glMajor, int glMinor)
+    {
+#if defined(__linux__)
+        egl = dlopen("libEGL.so.1", RTLD_LAZY | RTLD_LOCAL);
+        if (!egl)
+            return false;
+        eglGetProcAddressFn() = (PFN_eglGetProcAddress)dlsym(egl, "eglGetProcAddress");
+        PFN_eglGetDisplay getDisplay = (PFN_eglGetDisplay)dlsym(egl, "eglGetDisplay");
+        PFN_eglInitialize initialize = (PFN_eglInitialize)dlsym(egl, "eglInitialize");
+        PFN_eglBindAPI bindAPI = (PFN_eglBindAPI)dlsym(egl, "eglBindAPI");
+        PFN_eglChooseConfig chooseConfig = (PFN_eglChooseConfig)dlsym(egl, "eglChooseConfig");
+        PFN_eglCreateContext createContext = (PFN_eglCreateContext)dlsym(egl, "eglCreateContext");
+        PFN_eglMakeCurrent makeCurrent = (PFN_eglMakeCurrent)dlsym(egl, "eglMakeCurrent");
+        if (!eglGetProcAddressFn() || !getDisplay || !initialize || !bindAPI || !chooseConfig || !createContext || !makeCurrent)
+            return false;
+
+        // the surfaceless platform needs no window system, fall back to the default display
+        PFN_eglGetPlatformDisplayEXT getPlatformDisplay = (PFN_eglGetPlatformDisplayEXT)eglLoad("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, nullptr, nullptr);
+        if (!eglDisplay)
+            eglDisplay = getDisplay(nullptr);
+        EGLint major, minor;
+        if (!eglDisplay || !initialize(eglDisplay, &major, &minor) || !bindAPI(EGL_OPENGL_API))
+            return false;
+
+        const EGLint configAttribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLConfig config = nullptr;
+        EGLint configCount = 0;
+        chooseConfig(eglDisplay, configAttribs, &config, 1, &configCount);
+
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, glMajor, EGL_CONTEXT_MINOR_VERSION, glMinor,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE
+        };
+        eglContext = createContext(eglDisplay, configCount ? config : nullptr, nullptr, contextAttribs);
+        if (!eglContext || !makeCurrent(eglDisplay, nullptr, nullptr, eglContext))
+            return false;
+        return gladLoadGLLoader((GLADloadproc)eglLoad) != 0;
+#else
+        (void)glMajor;
+        (void)glMinor;
+        return false;
+#endif
+    }
+
+    bool createHiddenWindow(int glMajor, int glMinor)
+    {
+        if (!glfwInit())
+            return false;
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, glMajor);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, glMinor);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        window = glfwCreateWindow(width, height, "Headless", NULL, NULL);
+        if (window == NULL)
+            return false;
+        glfwMakeContextCurrent(window);
+        return gladLoadGLLoader((GLADloadproc)glfwGetProcAddress) != 0;
+    }
+
+    void destroyContext()
+    {
+        if (window)
+        {
+            glfwDestroyWindow(window);
+            window = nullptr;
+        }
+#if defined(__linux__)
+        if (eglContext)
+        {
+            PFN_eglMakeCurrent makeCurrent = (PFN_eglMakeCurrent)dlsym(egl, "eglMakeCurrent");
+            PFN_eglDestroyContext destroyContext = (PFN_eglDestroyContext)dlsym(egl, "eglDestroyContext");
+            PFN_eglTerminate terminate = (PFN_eglTerminate)dlsym(egl, "eglTerminate");
+            makeCurrent(eglDisplay, nullptr, nullptr, nullptr);
+            destroyContext(eglDisplay, eglContext);
+            terminate(eglDisplay);
+            eglContext = nullptr;
+        }
+#endif
+    }
+
+    // waits for the GPU so the frame time includes the rendering, not only the command submission
+    void endFrame()
+    {
+        glFinish();
+        frameMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+    }
+
+    static double percentile(const std::vector<double>& sorted, double p)
+    {
+        return sorted[std::min(sorted.size() - 1, (size_t)(p * (sorted.size() - 1) + 0.5))];
+    }
+
+    // FNV-1a of the pixels, identical renders on the same driver give identical checksums
+    static unsigned int checksum(const std::vector<unsigned char>& pixels)
+    {
+        unsigned int hash = 2166136261u;
+        for (unsigned char c : pixels)
+            hash = (hash ^ c) * 16777619u;
+        return hash;
+    }
+
+    void writePPM(const std::vector<unsigned char>& pixels) const
+    {
+        FILE* file = std::fopen(capturePath.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "ERROR::HEADLESS::CAPTURE_NOT_WRITTEN " << capturePath << std::endl;
+            return;
+        }
+        std::fprintf(file, "P6\n%u %u\n255\n", width, height);
+        // GL rows start at the bottom
+        for (unsigned int y = height; y-- > 0;)
+            for (unsigned int x = 0; x < width; x++)
+                std::fwrite(&pixels[((size_t)y * width + x) * 4], 1, 3, file);
+        std::fclose(file);
+    }
+};
+#endif
@@ -1,12 +1,24 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include <chrono>
+#include <cstring>
 
 #include <vector>
+#include <algorithm>
 
 #include "shader.h"
 #include "camera.h"
 #include "model.h"
+#include "headless.h"
+#include "gpu_timer.h"
+#include "asset_manager.h"
+#include "profiler.h"
+#include "particles_cpu.h"
+#include "particle_emitter.h"
+#include "particle_system.h"
+#include "particle_sprites.h"
+#include "particle_target.h"
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -27,13 +39,51 @@ const unsigned int SCR_HEIGHT = 720;
 
 // global variables used for rendering
 // -----------------------------------
-Shader* fountainShader;
-Shader* fireShader;
+ShaderHandle fountainShader;
+ShaderHandle fireShader;
 Camera camera(glm::vec3(0.0f, 1.6f, 5.0f));
 
-Shader* skyboxShader;
+ShaderHandle emitterKickoffShader;
+ShaderHandle emitterEmitShader;
+ShaderHandle emitterSimulateShader;
+ShaderHandle emitterRenderShader;
+EmitterPrograms emitterPrograms;
+ParticleEmitter* fountainEmitter;
+ParticleEmitter* fireEmitter;
+ShaderHandle updateParticlesShader;
+ShaderHandle updatePackedShader;
+ShaderHandle particleRenderShader;
+ShaderHandle packedRenderShader;
+ParticleUniforms updateParticlesUniforms, updatePackedUniforms, particleRenderUniforms, packedRenderUniforms;
+ParticleSystem* particleSystem; // fountain, fire and the small fountains in one pool
+// a sprite program of one update path and the locations of its uniforms
+struct SpriteProgram {
+    ShaderHandle shader;
+    SpriteUniforms uniforms;
+    ParticleUniforms particleUniforms; // TimeWrap of the compute path
+
+    void load(const char* vertexPath)
+    {
+        shader = loadShaderAsset(vertexPath, "shaders/sprite.frag");
+        uniforms = SpriteUniforms(*shader);
+        particleUniforms = ParticleUniforms(*shader);
+    }
+};
+SpriteProgram feedbackSpriteProgram, emitterSpriteProgram, particleSpriteProgram, packedSpriteProgram;
+ParticleSprites* sprites; // hull of the particle texture and the scene depth the sprites fade against
+ShaderHandle depthDownsampleShader;
+ShaderHandle particleCompositeShader;
+ParticleTargetPrograms particleTargetPrograms;
+ParticleTarget* particleTargets[2]; // half and quarter resolution
+GpuPassTimer* gpuTimer;
+
+ShaderHandle skyboxShader;
+struct SkyboxUniforms {
+    GLint projection, view, skybox;
+} skyboxUniforms;
 unsigned int skyboxVAO; // skybox handle
-unsigned int cubemapTexture; // skybox texture handle
+TextureHandle cubemapTexture; // skybox texture handle
+TextureHandle particleTexture;
 
 // global variables used for control
 // ---------------------------------
@@ -46,22 +96,51 @@ bool isPaused = false; // stop camera movement when GUI is open
 //-----------------------------------------------------------------------------------------------------------------------------------------
 //-----------------------------------------------------------------CONFIG------------------------------------------------------------------
 //-----------------------------------------------------------------------------------------------------------------------------------------
-struct Config
+// how the particles are updated and drawn
+enum ParticlePath {
+    PATH_TRANSFORM_FEEDBACK, // update() subroutine + transform feedback ping-pong, slots recycled by start time
+    PATH_EMITTER, // compute shaders with dead/alive lists, only alive particles are drawn
+    PATH_COMPUTE // compute shader updating a single set of storage buffers in place
+};
+
+// transform feedback state of one particle system, every system owns its buffers
+struct FeedbackParticles
 {
-    GLuint particleCountFountain = 4000;
-    GLuint particleCountFire = 4000;
-
-    GLuint initVel;
+    Shader* shader = nullptr;
+    GLuint count = 0;
 
     GLuint feedback[2];
     GLuint posBuf[2];
-	GLuint velBuf[2];
+    GLuint velBuf[2];
     GLuint startTime[2];
     GLuint particleArray[2];
+    GLuint spriteArray[2]; // the same buffers, advancing once per instance
+
+    GLuint updateSubroutine;
+    GLuint renderSubroutine;
+    // locations of the uniforms the update and render passes set
+    struct {
+        GLint ParticleTexture, ParticleLifetime, Accel, Seed, SpawnAngle, SpawnSpeed, Time, H, MVP;
+    } uniforms;
+    GLuint drawBuf = 0; // buffer set holding the latest particles, read by the next update and drawn by the render pass
+};
 
-    GLuint updateParticles;
-    GLuint drawBuf = 1;
-    GLuint renderParticles;
+// fills the initial state of a system in the layout of the GL buffers
+typedef void (*ParticleFill)(GLuint count, std::vector<float>& positions, std::vector<float>& velocities, std::vector<float>& startTimes, WorkStealingPool* pool);
+
+struct Config
+{
+    ParticlePath particlePath = PATH_TRANSFORM_FEEDBACK;
+    ParticleFormat particleFormat = PARTICLE_FORMAT_FLOAT; // storage of the compute path
+    GLuint smallFountains = 0; // extra emitters of the compute path
+    GLuint particlesPerSmallFountain = 256;
+
+    GLuint particleCountFountain = 4000;
+    GLuint particleCountFire = 4000;
+    GLuint seed = 1; // key of the counter-based random numbers, the fire uses seed + 1
+
+    FeedbackParticles fountainFeedback;
+    FeedbackParticles fireFeedback;
 
     float Time = 0.0f;
     float H = 0.0f;
@@ -70,60 +149,181 @@ struct Config
 
     glm::vec3 accelerationFountain = { 0.0f, -0.6f, 0.0f };
     glm::vec3 accelerationFire = { 0.0f, -0.6f, 0.0f };
+
+    float emissionRateFountain = 1000.0f; // particles per second (emitter path)
+    float emissionRateFire = 1000.0f;
+
+    bool pointSprites = false; // draw GL_POINTS instead of the camera-facing sprites of particle_sprites.h
+    SpriteShape spriteShape = SPRITE_SHAPE_AUTO; // alpha hull or full quad, see particle_sprites.h
+
+    // resolution of the sprites of each emitter, the reduced ones are composited in a pass of their own
+    ParticleResolution resolutionFountain = PARTICLE_RESOLUTION_FULL;
+    ParticleResolution resolutionFire = PARTICLE_RESOLUTION_FULL;
+    ParticleResolution resolutionSmallFountains = PARTICLE_RESOLUTION_FULL;
 	
 } config;
 
-void drawObjects();
-void drawObjectsFountain();
-void drawObjectsFire();
-void initParticlesBuffer();
-void initFountainBuffer();
-void initFireBuffer();
-static GLuint loadTexture(const std::string& fName);
+void initFeedbackParticles(FeedbackParticles& particles, Shader* shader, GLuint count, ParticleFill fill);
+void deleteFeedbackParticles(FeedbackParticles& particles);
+void updateFeedbackParticles(FeedbackParticles& particles, const ParticleParams& params);
+void renderFeedbackParticles(FeedbackParticles& particles);
+void initSprites();
+void renderSprites();
+void compositeParticles();
+void initEmitters();
+void updateEmitters();
+void renderEmitters();
+void initParticleSystem();
+void setParticleFormat(ParticleFormat format);
+void setSmallFountains(GLuint count);
+void updateParticleSystem();
+void renderParticleSystem();
+void updateParticles();
+void renderParticles();
+ParticleParams fountainParams();
+ParticleParams fireParams();
+ParticleParams smallFountainParams(GLuint index);
+void fillFountainData(GLuint count, std::vector<float>& positions, std::vector<float>& velocities, std::vector<float>& startTimes, WorkStealingPool* pool = nullptr);
+void fillFireData(GLuint count, std::vector<float>& positions, std::vector<float>& velocities, std::vector<float>& startTimes, WorkStealingPool* pool = nullptr);
+WorkStealingPool& initPool();
+int runCpuSimulation(int frames, unsigned int particleCount, unsigned int threads);
+int runCpuBenchmark(int frames, unsigned int particleCount, unsigned int threads);
+int runCpuCheck(int frames, unsigned int particleCount, unsigned int threads);
+static TextureHandle loadTexture(const std::string& fName);
+static TextureHandle createTexture(const std::string& fName, const vector<unsigned char>& bytes);
 void drawGui();
 void drawSkybox();
 unsigned int initSkyboxBuffers();
-unsigned int loadCubemap(vector<std::string> faces);
+TextureHandle loadCubemap(vector<std::string> faces);
+TextureHandle createCubemap(const vector<std::string>& faces, const vector<vector<unsigned char>>& files);
 
 //-----------------------------------------------------------------------------------------------------------------------------------------
 //-------------------------------------------------------------------MAIN------------------------------------------------------------------
 //-----------------------------------------------------------------------------------------------------------------------------------------
-int main()
+int main(int argc, char** argv)
 {
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    PROFILE_THREAD_NAME("main");
+
+    // CPU only modes, no window or GL context needed:
+    // --cpu-sim [frames]    run both particle systems on the CPU
+    // --cpu-bench [frames]  report particles/second per thread count
+    // --cpu-check [frames]  run both systems with transform feedback on an offscreen context and on the CPU, compare
+    //                       the results (the only one of these modes that needs GL)
+    // --particles N         particle count per system (default: the GPU counts for --cpu-sim, 1M and 10M for --cpu-bench)
+    // --threads N           worker threads (default: all hardware threads, for --cpu-bench the largest count tested)
+    // --seed N              key of the random numbers (also used by the GPU paths)
+    // --emitters N          small fountains added to the compute path
+    // --path P              update path at startup: feedback, emitter or compute
+    // --format F            storage of the compute path: float or packed
+    // --gpu-csv path        stream the GPU time of every pass as CSV
+    // --trace path          write the CPU zones of the run as Chrome trace JSON on exit
+    // --no-program-cache    compile every shader instead of loading the binaries of the last run, see program_cache.h
+    // --point-sprites       draw the particles as points instead of camera-facing sprites, see particle_sprites.h
+    // --full-quads          draw the sprites as full quads, never cut to the alpha hull of the texture
+    // --hull-sprites        always cut the sprites to the alpha hull, however much of the quad it covers
+    // --fountain-resolution D, --fire-resolution D, --small-fountain-resolution D
+    //                       draw the sprites of that emitter at 1/D resolution (1, 2 or 4), see particle_target.h
+    int cpuFrames = 0, cpuCheckFrames = 0;
+    bool cpuBench = false;
+    unsigned int cpuParticles = 0, cpuThreads = 0;
+    std::string gpuCsvPath, tracePath;
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc && argv[i + 1][0] != '-';
+        if (std::strcmp(argv[i], "--cpu-sim") == 0 || std::strcmp(argv[i], "--cpu-bench") == 0)
+        {
+            cpuBench = std::strcmp(argv[i], "--cpu-bench") == 0;
+            cpuFrames = hasValue ? std::atoi(argv[++i]) : (cpuBench ? 100 : 600);
+        }
+        else if (std::strcmp(argv[i], "--cpu-check") == 0)
+            cpuCheckFrames = hasValue ? std::atoi(argv[++i]) : 600;
+        else if (std::strcmp(argv[i], "--particles") == 0 && hasValue)
+            cpuParticles = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+        else if (std::strcmp(argv[i], "--threads") == 0 && hasValue)
+            cpuThreads = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+        else if (std::strcmp(argv[i], "--seed") == 0 && hasValue)
+            config.seed = (GLuint)std::strtoul(argv[++i], NULL, 10);
+        else if (std::strcmp(argv[i], "--emitters") == 0 && hasValue)
+            config.smallFountains = (GLuint)std::strtoul(argv[++i], NULL, 10);
+        else if (std::strcmp(argv[i], "--path") == 0 && hasValue)
+        {
+            i++;
+            config.particlePath = std::strcmp(argv[i], "emitter") == 0 ? PATH_EMITTER
+                                : std::strcmp(argv[i], "compute") == 0 ? PATH_COMPUTE : PATH_TRANSFORM_FEEDBACK;
+        }
+        else if (std::strcmp(argv[i], "--format") == 0 && hasValue)
+            config.particleFormat = std::strcmp(argv[++i], "packed") == 0 ? PARTICLE_FORMAT_PACKED : PARTICLE_FORMAT_FLOAT;
+        else if (std::strcmp(argv[i], "--gpu-csv") == 0 && hasValue)
+            gpuCsvPath = argv[++i];
+        else if (std::strcmp(argv[i], "--trace") == 0 && hasValue)
+            tracePath = argv[++i];
+        else if (std::strcmp(argv[i], "--no-program-cache") == 0)
+            ProgramCache::shared().enabled = false;
+        else if (std::strcmp(argv[i], "--point-sprites") == 0)
+            config.pointSprites = true;
+        else if (std::strcmp(argv[i], "--full-quads") == 0)
+            config.spriteShape = SPRITE_SHAPE_QUAD;
+        else if (std::strcmp(argv[i], "--hull-sprites") == 0)
+            config.spriteShape = SPRITE_SHAPE_HULL;
+        else if (std::strcmp(argv[i], "--fountain-resolution") == 0 && hasValue)
+            config.resolutionFountain = particleResolution((unsigned int)std::strtoul(argv[++i], NULL, 10));
+        else if (std::strcmp(argv[i], "--fire-resolution") == 0 && hasValue)
+            config.resolutionFire = particleResolution((unsigned int)std::strtoul(argv[++i], NULL, 10));
+        else if (std::strcmp(argv[i], "--small-fountain-resolution") == 0 && hasValue)
+            config.resolutionSmallFountains = particleResolution((unsigned int)std::strtoul(argv[++i], NULL, 10));
+    }
+    if (cpuFrames > 0)
+        return cpuBench ? runCpuBenchmark(cpuFrames, cpuParticles, cpuThreads) : runCpuSimulation(cpuFrames, cpuParticles, cpuThreads);
+    if (cpuCheckFrames > 0)
+        return runCpuCheck(cpuCheckFrames, cpuParticles, cpuThreads);
 
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // uncomment this statement to fix compilation on OS X
-#endif
+    // --headless [frames] renders offscreen at a fixed timestep and prints frame statistics, see headless.h
+    HeadlessRun headless;
+    headless.parseArgs(argc, argv);
 
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Fountain", NULL, NULL);
-    if (window == NULL)
+    GLFWwindow* window = NULL;
+    if (headless.enabled)
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+        if (!headless.init(SCR_WIDTH, SCR_HEIGHT, 4, 4))
+            return -1;
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, cursor_input_callback);
-    glfwSetKeyCallback(window, key_input_callback);
-    glfwSetScrollCallback(window, scroll_callback);
+    else
+    {
+        // glfw: initialize and configure
+        // ------------------------------
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // uncomment this statement to fix compilation on OS X
+#endif
 
-    // glad: load all OpenGL function pointers
-    // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+        // glfw window creation
+        // --------------------
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Fountain", NULL, NULL);
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetCursorPosCallback(window, cursor_input_callback);
+        glfwSetKeyCallback(window, key_input_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+        // glad: load all OpenGL function pointers
+        // ---------------------------------------
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
     }
 	
     // init skybox
@@ -138,22 +338,16 @@ int main()
     };
     cubemapTexture = loadCubemap(faces);
     skyboxVAO = initSkyboxBuffers();
-    skyboxShader = new Shader("shaders/skybox.vert", "shaders/skybox.frag");
+    skyboxShader = loadShaderAsset("shaders/skybox.vert", "shaders/skybox.frag");
+    skyboxUniforms.projection = skyboxShader->uniform("projection");
+    skyboxUniforms.view = skyboxShader->uniform("view");
+    skyboxUniforms.skybox = skyboxShader->uniform("skybox");
 
 	
-    fountainShader = new Shader("shaders/TF_fountain.vert", "shaders/TF_fountain.frag");
-    fireShader = new Shader("shaders/fire.vert", "shaders/fire.frag");
-     
-	
-    const char* outputNames[] = { "Position", "Velocity", "StartTime" };
-    glTransformFeedbackVaryings(fountainShader->ID, 3, outputNames, GL_SEPARATE_ATTRIBS);
-    glTransformFeedbackVaryings(fireShader->ID, 3, outputNames, GL_SEPARATE_ATTRIBS);
-
-    // get subroutine indices
-    config.renderParticles = glGetSubroutineIndex(fountainShader->ID, GL_VERTEX_SHADER, "render");
-    config.updateParticles = glGetSubroutineIndex(fountainShader->ID, GL_VERTEX_SHADER, "update");
-	config.renderParticles = glGetSubroutineIndex(fireShader->ID, GL_VERTEX_SHADER, "render");
-    config.updateParticles = glGetSubroutineIndex(fireShader->ID, GL_VERTEX_SHADER, "update");
+    fountainShader = loadShaderAsset("shaders/TF_fountain.vert", "shaders/TF_fountain.frag");
+    fireShader = loadShaderAsset("shaders/fire.vert", "shaders/fire.frag");
+
+	// the captured outputs are declared with xfb_buffer/xfb_offset in the shaders
 	
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 
@@ -165,59 +359,141 @@ int main()
 
     const char *textureName = "water/bluewater.png";
     glActiveTexture(GL_TEXTURE0);
-    loadTexture(textureName);
+    particleTexture = loadTexture(textureName);
+    glBindTexture(GL_TEXTURE_2D, particleTexture->id);
 	
-    initFountainBuffer();
-    initFireBuffer();
-
-    // Dear IMGUI init
-    // ---------------
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    // Setup Dear ImGui style
-    ImGui::StyleColorsDark();
-    // Setup Platform/Renderer bindings
-    ImGui_ImplGlfw_InitForOpenGL(window, true);
-    ImGui_ImplOpenGL3_Init("#version 440 core");
+    initSprites();
+    initFeedbackParticles(config.fountainFeedback, fountainShader.get(), config.particleCountFountain, fillFountainData);
+    initFeedbackParticles(config.fireFeedback, fireShader.get(), config.particleCountFire, fillFireData);
+    initEmitters();
+    initParticleSystem();
+
+    gpuTimer = new GpuPassTimer();
+    if (!gpuCsvPath.empty())
+        gpuTimer->openCsv(gpuCsvPath);
+
+    if (!headless.enabled)
+    {
+        // Dear IMGUI init
+        // ---------------
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        // Setup Dear ImGui style
+        ImGui::StyleColorsDark();
+        // Setup Platform/Renderer bindings
+        ImGui_ImplGlfw_InitForOpenGL(window, true);
+        ImGui_ImplOpenGL3_Init("#version 440 core");
+    }
     
     // render loop
     // -----------   
-    while (!glfwWindowShouldClose(window))
+    while (headless.enabled ? headless.nextFrame() : !glfwWindowShouldClose(window))
     {
+        PROFILE_ZONE("frame");
         static float lastFrame = 0.0f;
-        float currentFrame = (float)glfwGetTime();
+        float currentFrame = headless.enabled ? headless.time() : (float)glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
         config.Time = currentFrame;
 		config.H = deltaTime;
 
-        processInput(window);
+        if (!headless.enabled)
+            processInput(window);
+
+        // cleared once per frame, the particles are drawn on top of the skybox
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        gpuTimer->beginFrame();
+        gpuTimer->begin(GPU_PASS_SKYBOX);
         drawSkybox();
-        		
-        fountainShader->use();
-        fireShader->use(); 
-        
-        drawObjectsFountain();
-        drawObjectsFire();
+        gpuTimer->end();
+
+        // one CPU zone per pass, the uniform setters inside are too small to time on their own
+        {
+            PROFILE_ZONE("update");
+            gpuTimer->begin(GPU_PASS_UPDATE);
+            updateParticles();
+            gpuTimer->end();
+        }
+        {
+            PROFILE_ZONE("render");
+            gpuTimer->begin(GPU_PASS_RENDER);
+            renderParticles();
+            gpuTimer->end();
+        }
+        {
+            PROFILE_ZONE("composite");
+            gpuTimer->begin(GPU_PASS_COMPOSITE);
+            compositeParticles();
+            gpuTimer->end();
+        }
 
         if (isPaused) {
+            gpuTimer->begin(GPU_PASS_GUI);
             drawGui();
-        }		
+            gpuTimer->end();
+        }
+        gpuTimer->endFrame();
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (!headless.enabled)
+        {
+            PROFILE_ZONE("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+    }
+
+    gpuTimer->finish();
+    if (headless.enabled)
+    {
+        std::printf("GPU ms:");
+        for (int pass = 0; pass < GPU_PASS_COUNT; pass++)
+            std::printf(" %s %.3f,", gpuPassName((GpuPass)pass), gpuTimer->averageMs((GpuPass)pass));
+        std::printf(" total %.3f (last %d frames)\n", gpuTimer->averageTotalMs(), GpuPassTimer::HISTORY);
     }
 
     // Cleanup
     // -------
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
+    if (!headless.enabled)
+    {
+        ImGui_ImplOpenGL3_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+    }
+
+    delete fountainEmitter;
+    delete fireEmitter;
+    delete particleSystem;
+    delete gpuTimer;
+    deleteFeedbackParticles(config.fountainFeedback);
+    deleteFeedbackParticles(config.fireFeedback);
+
+    // the last handles delete the programs and textures, while the context is still current
+    AssetManager::instance().printStats();
+    ProgramCache::shared().printStats();
+    if (!config.pointSprites)
+        sprites->printStats();
+    for (ParticleTarget* target : particleTargets)
+        target->printStats();
+    ShaderHandle* shaders[] = { &fountainShader, &fireShader, &emitterKickoffShader, &emitterEmitShader, &emitterSimulateShader,
+                                &emitterRenderShader, &updateParticlesShader, &updatePackedShader, &particleRenderShader,
+                                &packedRenderShader, &skyboxShader, &feedbackSpriteProgram.shader, &emitterSpriteProgram.shader,
+                                &particleSpriteProgram.shader, &packedSpriteProgram.shader, &depthDownsampleShader,
+                                &particleCompositeShader };
+    for (ShaderHandle* shader : shaders)
+        shader->reset();
+    delete sprites;
+    for (ParticleTarget* target : particleTargets)
+        delete target;
+    cubemapTexture.reset();
+    particleTexture.reset();
+
+    if (headless.enabled)
+        headless.finish();
+    if (!tracePath.empty())
+        profilerWriteChromeTrace(tracePath);
 
-    delete fountainShader;
-	
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
@@ -227,380 +503,803 @@ int main()
 //-----------------------------------------------------------------------------------------------------------------------------------------
 //-----------------------------------------------------------------FOUNTAIN----------------------------------------------------------------
 //-----------------------------------------------------------------------------------------------------------------------------------------
-float randFloat() {
-    return ( (float) rand() / RAND_MAX);
+// worker threads of the particle initialization
+WorkStealingPool& initPool() {
+    static WorkStealingPool pool;
+    return pool;
 }
 
-void initFountainBuffer() {
-	
-	// Generate the buffers
-	glGenBuffers(2, config.posBuf);
-	glGenBuffers(2, config.velBuf);
-	glGenBuffers(2, config.startTime);
-	glGenBuffers(1, &config.initVel);
-
-	// Initialize the buffers
-	int size = config.particleCountFountain * 3 * sizeof(float);
-	glBindBuffer(GL_ARRAY_BUFFER, config.posBuf[0]); //buffer A
-	glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_DYNAMIC_COPY);
-	glBindBuffer(GL_ARRAY_BUFFER, config.posBuf[1]); //buffer B
-	glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_DYNAMIC_COPY);
-	glBindBuffer(GL_ARRAY_BUFFER, config.velBuf[0]);
-	glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_DYNAMIC_COPY);
-	glBindBuffer(GL_ARRAY_BUFFER, config.velBuf[1]);
-	glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_DYNAMIC_COPY);
-	glBindBuffer(GL_ARRAY_BUFFER, config.initVel);
-	glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, config.startTime[0]);
-	glBufferData(GL_ARRAY_BUFFER, config.particleCountFountain * sizeof(float), NULL, GL_DYNAMIC_COPY);
-	glBindBuffer(GL_ARRAY_BUFFER, config.startTime[1]);
-	glBufferData(GL_ARRAY_BUFFER, config.particleCountFountain * sizeof(float), NULL, GL_DYNAMIC_COPY);
-	
-	//Fill the first position buffer with zeros
-	GLfloat *data = new GLfloat[config.particleCountFountain * 3];
-	for (int i = 0; i < config.particleCountFountain * 3; i+=3) {
-		data[i] = 0.0f;
-		data[i + 1] = 2.0f;
-		data[i + 2] = 0.0f;
-	}
-	glBindBuffer(GL_ARRAY_BUFFER, config.posBuf[0]);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
-	
-    //Fill the first velocity buffer with random numbers
-    glm::vec3 v(0.0f);
-    float velocity, theta, phi; 
-	
-    for (int i = 0; i < config.particleCountFountain; i++) {
+// calls fill(begin, end) over [0, count), split over the pool if there is one
+template <typename Fill>
+void fillParallel(GLuint count, WorkStealingPool* pool, const Fill& fill) {
+    if (pool)
+        pool->parallelFor(count, PARTICLE_CPU_CHUNK, fill);
+    else
+        fill(0, count);
+}
 
-        //pick the direction of the velocity
-        theta = glm::mix(0.0f, glm::pi<float>() / 6.0f, randFloat());
-        phi = glm::mix(0.0f, glm::two_pi<float>(), randFloat());
+// initial fountain state in the layout of the GL buffers (vec3 positions/velocities, one start time per particle).
+// Particle i draws its velocity from the counter (i, generation 0), so the result does not depend on the pool.
+void fillFountainData(GLuint count, std::vector<float>& positions, std::vector<float>& velocities, std::vector<float>& startTimes, WorkStealingPool* pool) {
+    PROFILE_FUNCTION();
+
+	positions.resize(count * 3);
+	velocities.resize(count * 3);
+	startTimes.resize(count);
+
+    ParticleParams params = fountainParams();
+    fillParallel(count, pool, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int i = begin; i < end; i++) {
+            //All particles start at the same position
+            positions[i * 3] = 0.0f;
+            positions[i * 3 + 1] = 2.0f;
+            positions[i * 3 + 2] = 0.0f;
+
+            //Same cone the update pass draws recycled particles from
+            glm::vec3 v = rngSpawnVelocity(params.seed, i, 0, params.spawnAngle, params.spawnSpeed);
+            velocities[i * 3] = v.x;
+            velocities[i * 3 + 1] = v.y;
+            velocities[i * 3 + 2] = v.z;
+
+            //Particles start one after another
+            startTimes[i] = i * 0.001f;
+        }
+    });
+}
 
-        v.x = sinf(theta) * cosf(phi);
-        v.y = cosf(theta); 
-        v.z = sinf(theta) * sinf(phi);
+// initial fire state in the layout of the GL buffers
+void fillFireData(GLuint count, std::vector<float>& positions, std::vector<float>& velocities, std::vector<float>& startTimes, WorkStealingPool* pool) {
+    PROFILE_FUNCTION();
 
-        velocity = glm::mix(1.25f, 1.5f, randFloat());
-        v = glm::normalize(v) * velocity;
+    positions.resize(count * 3);
+    velocities.resize(count * 3);
+    startTimes.resize(count);
 
-        data[i * 3] = v.x;
-        data[i * 3 + 1] = v.y;
-        data[i * 3 + 2] = v.z;
-    }
-	
-	glBindBuffer(GL_ARRAY_BUFFER, config.velBuf[0]);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);	
-	
-    glBindBuffer(GL_ARRAY_BUFFER, config.initVel);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+    ParticleParams params = fireParams();
+    fillParallel(count, pool, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int i = begin; i < end; i++) {
+            //Instead of using the origin for all particles, use a random x location
+            positions[i * 3] = glm::mix(-2.0f, 2.0f, rngUniform4(params.seed, i, 0, RNG_STREAM_POSITION).x);
+            positions[i * 3 + 1] = 0.0f;
+            positions[i * 3 + 2] = 0.0f;
 
-	//fill the first start time buffer
-    delete[] data;
-	data = new GLfloat[config.particleCountFountain];
-	float time = 0.0f, rate = 0.001f;
-	
-	for(int i = 0; i < config.particleCountFountain; i++) {
-		data[i] = time;
-		time += rate;
+            //The particles start at rest, the acceleration makes them rise
+            velocities[i * 3] = 0.0f;
+            velocities[i * 3 + 1] = 0.0f;
+            velocities[i * 3 + 2] = 0.0f;
+
+            startTimes[i] = i * 0.001f;
+        }
+    });
+}
+
+// creates the two buffer sets, vertex arrays and feedback objects of one system, the first set is filled by fill()
+void initFeedbackParticles(FeedbackParticles& particles, Shader* shader, GLuint count, ParticleFill fill) {
+    PROFILE_FUNCTION();
+
+    particles.shader = shader;
+    particles.count = count;
+
+    // the subroutine indices belong to the program, they can differ between the fountain and the fire
+    particles.updateSubroutine = glGetSubroutineIndex(shader->ID, GL_VERTEX_SHADER, "update");
+    particles.renderSubroutine = glGetSubroutineIndex(shader->ID, GL_VERTEX_SHADER, "render");
+    particles.uniforms.ParticleTexture = shader->uniform("ParticleTexture");
+    particles.uniforms.ParticleLifetime = shader->uniform("ParticleLifetime");
+    particles.uniforms.Accel = shader->uniform("Accel");
+    particles.uniforms.Seed = shader->uniform("Seed");
+    particles.uniforms.SpawnAngle = shader->uniform("SpawnAngle");
+    particles.uniforms.SpawnSpeed = shader->uniform("SpawnSpeed");
+    particles.uniforms.Time = shader->uniform("Time");
+    particles.uniforms.H = shader->uniform("H");
+    particles.uniforms.MVP = shader->uniform("MVP");
+
+	// Generate the buffers
+	glGenBuffers(2, particles.posBuf);
+	glGenBuffers(2, particles.velBuf);
+	glGenBuffers(2, particles.startTime);
+
+	//Fill the first position, velocity and start time buffers, the second set is written by the first update
+	std::vector<float> positions, velocities, startTimes;
+	fill(count, positions, velocities, startTimes, &initPool());
+
+	int size = count * 3 * sizeof(float);
+	for (int i = 0; i < 2; i++) {
+		glBindBuffer(GL_ARRAY_BUFFER, particles.posBuf[i]);
+		glBufferData(GL_ARRAY_BUFFER, size, i == 0 ? positions.data() : NULL, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_ARRAY_BUFFER, particles.velBuf[i]);
+		glBufferData(GL_ARRAY_BUFFER, size, i == 0 ? velocities.data() : NULL, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_ARRAY_BUFFER, particles.startTime[i]);
+		glBufferData(GL_ARRAY_BUFFER, count * sizeof(float), i == 0 ? startTimes.data() : NULL, GL_DYNAMIC_COPY);
 	}
-	
-	glBindBuffer(GL_ARRAY_BUFFER, config.startTime[0]);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, config.particleCountFountain * sizeof(float), data);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-	
-	delete[] data;
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	//create vertex arrays for each set of buffers
-	glGenVertexArrays(2, config.particleArray);
-	
-	//Set up particle array 0
-	glBindVertexArray(config.particleArray[0]);
-	glBindBuffer(GL_ARRAY_BUFFER, config.posBuf[0]);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, config.velBuf[0]);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(1);
-
-	glBindBuffer(GL_ARRAY_BUFFER, config.startTime[0]);
-	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(2);
-	
-    glBindBuffer(GL_ARRAY_BUFFER, config.initVel);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(3);
-
-	//Set up particle array 1
-	glBindVertexArray(config.particleArray[1]);
-	glBindBuffer(GL_ARRAY_BUFFER, config.posBuf[1]);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(0);
-
-	glBindBuffer(GL_ARRAY_BUFFER, config.velBuf[1]);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(1);
-	
-	glBindBuffer(GL_ARRAY_BUFFER, config.startTime[1]);
-	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(2);
-	
-	glBindBuffer(GL_ARRAY_BUFFER, config.initVel);
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(3);
-	
+	glGenVertexArrays(2, particles.particleArray);
+	for (int i = 0; i < 2; i++) {
+		glBindVertexArray(particles.particleArray[i]);
+		glBindBuffer(GL_ARRAY_BUFFER, particles.posBuf[i]);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+		glEnableVertexAttribArray(0);
+
+		glBindBuffer(GL_ARRAY_BUFFER, particles.velBuf[i]);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+		glEnableVertexAttribArray(1);
+
+		glBindBuffer(GL_ARRAY_BUFFER, particles.startTime[i]);
+		glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 0, NULL);
+		glEnableVertexAttribArray(2);
+	}
+
+	//the sprites read the position and start time of one particle per instance
+	glGenVertexArrays(2, particles.spriteArray);
+	for (int i = 0; i < 2; i++) {
+		glBindVertexArray(particles.spriteArray[i]);
+		glBindBuffer(GL_ARRAY_BUFFER, particles.posBuf[i]);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+		glEnableVertexAttribArray(0);
+		glVertexAttribDivisor(0, 1);
+
+		glBindBuffer(GL_ARRAY_BUFFER, particles.startTime[i]);
+		glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 0, NULL);
+		glEnableVertexAttribArray(2);
+		glVertexAttribDivisor(2, 1);
+	}
 	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	//Setup the feedback objects, feedback i captures into buffer set i
+	glGenTransformFeedbacks(2, particles.feedback);
+	for (int i = 0; i < 2; i++) {
+		glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, particles.feedback[i]);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, particles.posBuf[i]);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, particles.velBuf[i]);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 2, particles.startTime[i]);
+	}
+	glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+}
 
-	//Setup the feedback objects
-    glGenTransformFeedbacks(2, config.feedback);
+void deleteFeedbackParticles(FeedbackParticles& particles) {
+	glDeleteTransformFeedbacks(2, particles.feedback);
+	glDeleteVertexArrays(2, particles.particleArray);
+	glDeleteVertexArrays(2, particles.spriteArray);
+	glDeleteBuffers(2, particles.posBuf);
+	glDeleteBuffers(2, particles.velBuf);
+	glDeleteBuffers(2, particles.startTime);
+}
+
+// advances one system with transform feedback, from the latest buffer set into the other one
+void updateFeedbackParticles(FeedbackParticles& particles, const ParticleParams& params) {
+
+    Shader* shader = particles.shader;
+    shader->use();
+
+    //Select the subroutine for particle updating
+    glUniformSubroutinesuiv(GL_VERTEX_SHADER, 1, &particles.updateSubroutine);
+
+    shader->setSampler2D(particles.uniforms.ParticleTexture, 0);
+    shader->setFloat(particles.uniforms.ParticleLifetime, params.ParticleLifetime);
+    shader->setVec3(particles.uniforms.Accel, params.Accel);
+    shader->setUInt(particles.uniforms.Seed, params.seed);
+    shader->setFloat(particles.uniforms.SpawnAngle, params.spawnAngle);
+    shader->setVec2(particles.uniforms.SpawnSpeed, params.spawnSpeed);
+    shader->setFloat(particles.uniforms.Time, params.Time);
+    shader->setFloat(particles.uniforms.H, params.H);
 
-    //Transform feedback 0
-    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, config.feedback[0]);
-    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, config.posBuf[0]);
-    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, config.velBuf[0]);
-    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 2, config.startTime[0]);
+	//Disable rendering
+	glEnable(GL_RASTERIZER_DISCARD);
 
-    //Transform feedback 1
-    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, config.feedback[1]);
-    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, config.posBuf[1]);
-    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, config.velBuf[1]);
-    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 2, config.startTime[1]);
+	//Bind the feedback obj. for the buffers to be written
+	glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, particles.feedback[1 - particles.drawBuf]);
 
+	//Draw points from input buffer with transform feedback
+    glBeginTransformFeedback(GL_POINTS);
+    glBindVertexArray(particles.particleArray[particles.drawBuf]);
+    glDrawArrays(GL_POINTS, 0, particles.count);
+    glEndTransformFeedback();
     glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+
+	//Enable rendering
+	glDisable(GL_RASTERIZER_DISCARD);
+
+	//Swap buffers
+	particles.drawBuf = 1 - particles.drawBuf;
 }
 
+// draws the sprites of the latest buffer set, the uniforms set by the update stay in the program
+void renderFeedbackParticles(FeedbackParticles& particles) {
 
-void initFireBuffer() {
-
-    // Generate the buffers
-    glGenBuffers(2, config.posBuf);
-    glGenBuffers(2, config.velBuf);
-    glGenBuffers(2, config.startTime);
-    glGenBuffers(1, &config.initVel);
-
-    // Initialize the buffers
-    int size = config.particleCountFire * 3 * sizeof(float);
-    glBindBuffer(GL_ARRAY_BUFFER, config.posBuf[0]); //buffer A
-    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_DYNAMIC_COPY);
-    glBindBuffer(GL_ARRAY_BUFFER, config.posBuf[1]); //buffer B
-    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_DYNAMIC_COPY);
-    glBindBuffer(GL_ARRAY_BUFFER, config.velBuf[0]);
-    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_DYNAMIC_COPY);
-    glBindBuffer(GL_ARRAY_BUFFER, config.velBuf[1]);
-    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_DYNAMIC_COPY);
-    glBindBuffer(GL_ARRAY_BUFFER, config.initVel);
-    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, config.startTime[0]);
-    glBufferData(GL_ARRAY_BUFFER, config.particleCountFire * sizeof(float), NULL, GL_DYNAMIC_COPY);
-    glBindBuffer(GL_ARRAY_BUFFER, config.startTime[1]);
-    glBufferData(GL_ARRAY_BUFFER, config.particleCountFire * sizeof(float), NULL, GL_DYNAMIC_COPY);
-
-    //Instead of using the origin for all particles, use a random x location
-    GLfloat* data = new GLfloat[config.particleCountFire * 3];
-    for (int i = 0; i < config.particleCountFire * 3; i += 3) {
-        data[i] = glm::mix(-2.0f, 2.0f, randFloat());
-        data[i + 1] = 0.0f;
-        data[i + 2] = 0.0f;
-    }
-    glBindBuffer(GL_ARRAY_BUFFER, config.posBuf[0]);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+    Shader* shader = particles.shader;
+    shader->use();
 
-    //Fill the first velocity buffer with random numbers
-    glm::vec3 v(0.0f);
-    float velocity, theta, phi;
+	//Select the subroutine for particle rendering, the selection is lost by every glUseProgram
+	glUniformSubroutinesuiv(GL_VERTEX_SHADER, 1, &particles.renderSubroutine);
 
-    //x and z components are zero and the y component contains a random speed
-    for (int i = 0; i < config.particleCountFire; i++) {
+	// camera parameters
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 view = camera.GetViewMatrix();
+    glm::mat4 model = glm::mat4(1.0f);
 
-        data[i * 3] = v.x;
-        data[i * 3 + 1] = v.y;
-        data[i * 3 + 2] = v.z;
-    }
+    glm::mat4 mv = view * model;
+    shader->setMat4(particles.uniforms.MVP, projection * mv);
+
+	//Draw the sprites from the feedback buffer
+	glBindVertexArray(particles.particleArray[particles.drawBuf]);
+	glDrawTransformFeedback(GL_POINTS, particles.feedback[particles.drawBuf]);
+	glBindVertexArray(0);
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, config.velBuf[0]);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+// update pass of the selected path, the render pass draws its results
+void updateParticles() {
 
-    glBindBuffer(GL_ARRAY_BUFFER, config.initVel);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+    if (config.particlePath == PATH_EMITTER)
+    {
+        updateEmitters();
+    }
+    else if (config.particlePath == PATH_COMPUTE)
+    {
+        updateParticleSystem();
+    }
+    else
+    {
+        updateFeedbackParticles(config.fountainFeedback, fountainParams());
+        updateFeedbackParticles(config.fireFeedback, fireParams());
+    }
+}
 
-    //fill the first start time buffer
-    delete[] data;
-    data = new GLfloat[config.particleCountFire];
-    float time = 0.0f, rate = 0.001f;
+void renderParticles() {
 
-    for (int i = 0; i < config.particleCountFire; i++) {
-        data[i] = time;
-        time += rate;
+    if (!config.pointSprites)
+    {
+        renderSprites();
+        return;
+    }
+    if (config.particlePath == PATH_EMITTER)
+    {
+        renderEmitters();
+    }
+    else if (config.particlePath == PATH_COMPUTE)
+    {
+        renderParticleSystem();
     }
+    else
+    {
+        renderFeedbackParticles(config.fountainFeedback);
+        renderFeedbackParticles(config.fireFeedback);
+    }
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, config.startTime[0]);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, config.particleCountFire * sizeof(float), data);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+//-----------------------------------------------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------CPU SIMULATION--------------------------------------------------------------
+//-----------------------------------------------------------------------------------------------------------------------------------------
+// runs both particle systems on the CPU with a fixed timestep and checks the SIMD kernel against the scalar port of update()
+int runCpuSimulation(int frames, unsigned int particleCount, unsigned int threads) {
+
+    const float H = 1.0f / 60.0f;
+    ParticleKernel kernel = detectParticleKernel();
+    WorkStealingPool pool(threads);
+    std::cout << "CPU particle simulation: " << frames << " frames, " << particleKernelName(kernel) << " kernel, "
+              << pool.size() << " threads" << std::endl;
+
+    struct CpuRun {
+        const char* name;
+        GLuint count;
+        void (*fill)(GLuint, std::vector<float>&, std::vector<float>&, std::vector<float>&, WorkStealingPool*);
+        ParticleParams params;
+        CpuParticleSystem simd;
+        CpuParticleSystem reference;
+    };
 
-    delete[] data;
+    // same constants updateFeedbackParticles() sends to the shaders
+    CpuRun runs[2] = {
+        { "Fountain", particleCount ? particleCount : config.particleCountFountain, fillFountainData, fountainParams(), {}, {} },
+        { "Fire", particleCount ? particleCount : config.particleCountFire, fillFireData, fireParams(), {}, {} }
+    };
 
-    //create vertex arrays for each set of buffers
-    glGenVertexArrays(2, config.particleArray);
+    int result = 0;
+    for (CpuRun& run : runs)
+    {
+        std::vector<float> positions, velocities, startTimes;
+        run.fill(run.count, positions, velocities, startTimes, &pool);
 
-    //Set up particle array 0
-    glBindVertexArray(config.particleArray[0]);
-    glBindBuffer(GL_ARRAY_BUFFER, config.posBuf[0]);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(0);
+        run.simd.resize(run.count, &pool);
+        run.reference.resize(run.count);
+        run.simd.load(positions.data(), velocities.data(), startTimes.data());
+        run.reference.load(positions.data(), velocities.data(), startTimes.data());
 
-    glBindBuffer(GL_ARRAY_BUFFER, config.velBuf[0]);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(1);
+        double simdSeconds = 0.0;
+        for (int frame = 1; frame <= frames; frame++)
+        {
+            run.params.Time = frame * H;
+            run.params.H = H;
 
-    glBindBuffer(GL_ARRAY_BUFFER, config.startTime[0]);
-    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(2);
+            auto start = std::chrono::steady_clock::now();
+            run.simd.update(run.params, kernel, pool);
+            simdSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-    glBindBuffer(GL_ARRAY_BUFFER, config.initVel);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(3);
+            run.reference.update(run.params, PARTICLE_KERNEL_SCALAR);
+        }
 
-    //Set up particle array 1
-    glBindVertexArray(config.particleArray[1]);
-    glBindBuffer(GL_ARRAY_BUFFER, config.posBuf[1]);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(0);
+        run.reference.store(positions.data(), velocities.data());
+        float deviation = run.simd.maxDeviation(positions.data(), velocities.data());
+        std::cout << run.name << ": " << run.count << " particles, "
+                  << (frames > 0 ? simdSeconds * 1000.0 / frames : 0.0) << " ms/frame, "
+                  << "max deviation from scalar " << deviation << std::endl;
+        if (deviation != 0.0f)
+            result = 1;
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, config.velBuf[1]);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(1);
+    return result;
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, config.startTime[1]);
-    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(2);
+// particles/second of the threaded update for 1, 2, 4, ... threads, used to size simulation machines
+int runCpuBenchmark(int frames, unsigned int particleCount, unsigned int threads) {
 
-    glBindBuffer(GL_ARRAY_BUFFER, config.initVel);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(3);
+    const float H = 1.0f / 60.0f;
+    const int warmupFrames = 3;
+    ParticleKernel kernel = detectParticleKernel();
 
-    glBindVertexArray(0);
+    unsigned int maxThreads = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned int> threadCounts;
+    for (unsigned int t = 1; t < maxThreads; t *= 2)
+        threadCounts.push_back(t);
+    threadCounts.push_back(maxThreads);
 
-    //Setup the feedback objects
-    glGenTransformFeedbacks(2, config.feedback);
+    std::vector<unsigned int> particleCounts;
+    if (particleCount)
+        particleCounts.push_back(particleCount);
+    else
+        particleCounts = { 1000000, 10000000 };
 
-    //Transform feedback 0
-    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, config.feedback[0]);
-    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, config.posBuf[0]);
-    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, config.velBuf[0]);
-    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 2, config.startTime[0]);
+    std::cout << "CPU particle benchmark: " << particleKernelName(kernel) << " kernel, " << PARTICLE_CPU_CHUNK
+              << " particles per chunk, " << frames << " frames" << std::endl;
+    std::cout << "particles,threads,ms/frame,Mparticles/s,speedup,efficiency" << std::endl;
 
-    //Transform feedback 1
-    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, config.feedback[1]);
-    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, config.posBuf[1]);
-    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, config.velBuf[1]);
-    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 2, config.startTime[1]);
+    ParticleParams params = fountainParams();
 
-    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+    for (unsigned int count : particleCounts)
+    {
+        double singleThreadRate = 0.0;
+        for (unsigned int t : threadCounts)
+        {
+            WorkStealingPool pool(t);
+            CpuParticleSystem particles;
+            particles.resize(count, &pool);
+
+            // every particle alive and spread over its lifetime so respawns happen every frame
+            pool.parallelFor(count, PARTICLE_CPU_CHUNK, [&particles, &params](unsigned int begin, unsigned int end) {
+                for (unsigned int i = begin; i < end; i++)
+                {
+                    glm::vec3 velocity = rngSpawnVelocity(params.seed, i, 0, params.spawnAngle, params.spawnSpeed);
+                    particles.py[i] = 2.0f;
+                    particles.vx[i] = velocity.x;
+                    particles.vy[i] = velocity.y;
+                    particles.vz[i] = velocity.z;
+                    particles.startTime[i] = -(float)(i % 3500) * 0.001f;
+                }
+            });
+
+            double seconds = 0.0;
+            for (int frame = 1; frame <= warmupFrames + frames; frame++)
+            {
+                params.Time = frame * H;
+                params.H = H;
+
+                auto start = std::chrono::steady_clock::now();
+                particles.update(params, kernel, pool);
+                if (frame > warmupFrames)
+                    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+
+            double rate = (double)count * frames / seconds;
+            if (t == threadCounts.front())
+                singleThreadRate = rate / t;
+            double speedup = rate / singleThreadRate;
+            std::cout << count << "," << t << "," << seconds * 1000.0 / frames << "," << rate / 1e6 << ","
+                      << speedup << "," << speedup / t << std::endl;
+        }
+    }
+
+    return 0;
 }
 
+// runs both particle systems with transform feedback and on the CPU from the same initial state and compares the
+// buffers read back after the last frame, so the CPU engine is checked against the shaders and not only itself
+int runCpuCheck(int frames, unsigned int particleCount, unsigned int threads) {
 
-void drawObjectsFountain(){
+    const float H = 1.0f / 60.0f;
+    // the shaders and the CPU round differently, respawned particles start over from the same values
+    const float tolerance = 1e-3f;
 
+    HeadlessRun headless;
+    if (!headless.init(SCR_WIDTH, SCR_HEIGHT, 4, 4))
+        return -1;
+    ParticleKernel kernel = detectParticleKernel();
+    WorkStealingPool pool(threads);
+    std::cout << "CPU particle check: " << frames << " frames, transform feedback against the "
+              << particleKernelName(kernel) << " kernel" << std::endl;
+
+    struct CheckRun {
+        const char* name;
+        GLuint count;
+        ParticleFill fill;
+        ParticleParams params;
+        ShaderHandle shader;
+        FeedbackParticles gpu;
+        CpuParticleSystem cpu;
+    };
+    CheckRun runs[2] = {
+        { "Fountain", particleCount ? particleCount : config.particleCountFountain, fillFountainData, fountainParams(),
+          loadShaderAsset("shaders/TF_fountain.vert", "shaders/TF_fountain.frag"), {}, {} },
+        { "Fire", particleCount ? particleCount : config.particleCountFire, fillFireData, fireParams(),
+          loadShaderAsset("shaders/fire.vert", "shaders/fire.frag"), {}, {} }
+    };
 
-    //Select the subroutine for particle updating
-    glUniformSubroutinesuiv(GL_VERTEX_SHADER, 1, &config.updateParticles);
+    int result = 0;
+    for (CheckRun& run : runs)
+    {
+        initFeedbackParticles(run.gpu, run.shader.get(), run.count, run.fill);
+        std::vector<float> positions, velocities, startTimes;
+        run.fill(run.count, positions, velocities, startTimes, &pool);
+        run.cpu.resize(run.count, &pool);
+        run.cpu.load(positions.data(), velocities.data(), startTimes.data());
 
-    fountainShader->setSampler2D("ParticleTexture", 0);
-    fountainShader->setFloat("ParticleLifetime", config.ParticleLifeTimeFountain);
-    fountainShader->setVec3("Accel", config.accelerationFountain);
-    fountainShader->setFloat("Time", config.Time);
-    fountainShader->setFloat("H", config.H);
-	
-	//Disable rendering
-	glEnable(GL_RASTERIZER_DISCARD);
+        for (int frame = 1; frame <= frames; frame++)
+        {
+            run.params.Time = frame * H;
+            run.params.H = H;
+            updateFeedbackParticles(run.gpu, run.params);
+            run.cpu.update(run.params, kernel, pool);
+        }
 
-	//Bind the feedback obj. for the buffers to be drawn
-	glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, config.feedback[config.drawBuf]);
+        glBindBuffer(GL_ARRAY_BUFFER, run.gpu.posBuf[run.gpu.drawBuf]);
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, positions.size() * sizeof(float), positions.data());
+        glBindBuffer(GL_ARRAY_BUFFER, run.gpu.velBuf[run.gpu.drawBuf]);
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, velocities.size() * sizeof(float), velocities.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	//Draw points from input buffer with transform feedback
-    glBeginTransformFeedback(GL_POINTS);
-    glBindVertexArray(config.particleArray[1 - config.drawBuf]);
-    glDrawArrays(GL_POINTS, 0, config.particleCountFountain);
-    glEndTransformFeedback();
+        float deviation = run.cpu.maxDeviation(positions.data(), velocities.data());
+        std::cout << run.name << ": " << run.count << " particles, max deviation from transform feedback " << deviation
+                  << (deviation > tolerance ? " (above the tolerance of " : " (tolerance ") << tolerance << ")" << std::endl;
+        if (!(deviation <= tolerance))
+            result = 1;
 
-	//Enable rendering
-	glDisable(GL_RASTERIZER_DISCARD);
-	
-	//Select the subroutine for particle rendering
-	glUniformSubroutinesuiv(GL_VERTEX_SHADER, 1, &config.renderParticles);
-	glClear(GL_COLOR_BUFFER_BIT);
+        deleteFeedbackParticles(run.gpu);
+        run.shader.reset();
+    }
 
-	// camera parameters
+    headless.release();
+    return result;
+}
+
+//-----------------------------------------------------------------------------------------------------------------------------------------
+//-----------------------------------------------------------------EMITTERS----------------------------------------------------------------
+//-----------------------------------------------------------------------------------------------------------------------------------------
+void initEmitters() {
+    PROFILE_FUNCTION();
+
+    emitterKickoffShader = loadShaderAsset("shaders/emitter_kickoff.comp");
+    emitterEmitShader = loadShaderAsset("shaders/emitter_emit.comp");
+    emitterSimulateShader = loadShaderAsset("shaders/emitter_simulate.comp");
+    emitterRenderShader = loadShaderAsset("shaders/emitter.vert", "shaders/TF_fountain.frag");
+    emitterPrograms = EmitterPrograms(*emitterKickoffShader, *emitterEmitShader, *emitterSimulateShader, *emitterRenderShader,
+                                      *emitterSpriteProgram.shader);
+
+    // the slots spawn at the positions the transform feedback buffers start with
+    std::vector<float> positions, velocities, startTimes;
+    fillFountainData(config.particleCountFountain, positions, velocities, startTimes, &initPool());
+    fountainEmitter = new ParticleEmitter(config.particleCountFountain, positions);
+
+    fillFireData(config.particleCountFire, positions, velocities, startTimes, &initPool());
+    fireEmitter = new ParticleEmitter(config.particleCountFire, positions);
+
+    // the shape of the sprites is known, initSprites() runs first
+    fountainEmitter->setSpriteCorners(sprites->hull.cornerCount);
+    fireEmitter->setSpriteCorners(sprites->hull.cornerCount);
+}
+
+// the emitters draw from the same velocity cone as the other paths
+void setSpawnVelocity(ParticleEmitter& emitter, const ParticleParams& params) {
+    emitter.seed = params.seed;
+    emitter.spawnAngle = params.spawnAngle;
+    emitter.spawnSpeed = params.spawnSpeed;
+}
+
+void updateEmitters() {
+
+    fountainEmitter->emissionRate = config.emissionRateFountain;
+    fountainEmitter->particleLifetime = config.ParticleLifeTimeFountain;
+    fountainEmitter->acceleration = config.accelerationFountain;
+    setSpawnVelocity(*fountainEmitter, fountainParams());
+    fountainEmitter->update(emitterPrograms, config.H);
+
+    fireEmitter->emissionRate = config.emissionRateFire;
+    fireEmitter->particleLifetime = 4.0f;
+    fireEmitter->acceleration = glm::vec3(0.0f, 0.1f, 0.0f);
+    setSpawnVelocity(*fireEmitter, fireParams());
+    fireEmitter->update(emitterPrograms, config.H);
+}
+
+void renderEmitters() {
+
+    // camera parameters
     glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
     glm::mat4 view = camera.GetViewMatrix();
-    glm::mat4 model = glm::mat4(1.0f);
 
-    glm::mat4 mv = view * model;
-    fountainShader->setMat4("MVP", projection * mv);
+    emitterRenderShader->use();
+    emitterRenderShader->setSampler2D(emitterPrograms.renderParticleTexture, 0);
+    emitterRenderShader->setMat4(emitterPrograms.renderMVP, projection * view);
+    fountainEmitter->draw(emitterPrograms);
+    fireEmitter->draw(emitterPrograms);
+}
 
-	//Draw the sprites from the feedback buffer
-	glBindVertexArray(config.particleArray[config.drawBuf]);
-	glDrawTransformFeedback(GL_POINTS, config.feedback[config.drawBuf]);
+//-----------------------------------------------------------------------------------------------------------------------------------------
+//-----------------------------------------------------------------COMPUTE-----------------------------------------------------------------
+//-----------------------------------------------------------------------------------------------------------------------------------------
+// update constants of the fountain, as sent to the update() subroutine
+ParticleParams fountainParams() {
+    ParticleParams params;
+    params.Time = config.Time;
+    params.H = config.H;
+    params.ParticleLifetime = config.ParticleLifeTimeFountain;
+    params.Accel = config.accelerationFountain;
+    params.respawnPosition = glm::vec3(5.0f, 0.0f, 0.0f);
+    params.seed = config.seed;
+    params.spawnAngle = glm::pi<float>() / 6.0f;
+    params.spawnSpeed = glm::vec2(1.25f, 1.5f);
+    return params;
+}
 
-	//Swap buffers
-	config.drawBuf = 1 - config.drawBuf;
+// update constants of the fire, recycled particles keep their x coordinate
+ParticleParams fireParams() {
+    ParticleParams params;
+    params.Time = config.Time;
+    params.H = config.H;
+    params.ParticleLifetime = 4.0f;
+    params.Accel = glm::vec3(0.0f, 0.1f, 0.0f);
+    params.keepOnRespawn = glm::bvec3(true, false, false);
+    params.seed = config.seed + 1;
+    return params;
 }
 
-void drawObjectsFire()
-{
+// update constants of the small fountain with the given index, placed on a grid behind the fountain
+ParticleParams smallFountainParams(GLuint index) {
+    const GLuint perRow = 32;
+    ParticleParams params;
+    params.Time = config.Time;
+    params.H = config.H;
+    params.ParticleLifetime = 1.5f;
+    params.Accel = glm::vec3(0.0f, -2.0f, 0.0f);
+    params.respawnPosition = glm::vec3(-8.0f + 0.5f * (index % perRow), 0.0f, -4.0f - 0.5f * (index / perRow));
+    params.seed = config.seed + 2 + index;
+    params.spawnAngle = glm::pi<float>() / 12.0f;
+    params.spawnSpeed = glm::vec2(1.0f, 1.5f);
+    return params;
+}
 
-    //Select the subroutine for particle updating
-    glUniformSubroutinesuiv(GL_VERTEX_SHADER, 1, &config.updateParticles);
+// appends config.smallFountains emitters to the pool, their particles start one after another over a lifetime
+void addSmallFountains(ParticleSystem& system) {
+    GLuint count = config.particlesPerSmallFountain;
+    std::vector<float> positions(count * 3), velocities(count * 3), startTimes(count);
+    for (GLuint e = 0; e < config.smallFountains; e++)
+    {
+        ParticleParams params = smallFountainParams(e);
+        for (GLuint i = 0; i < count; i++)
+        {
+            glm::vec3 v = rngSpawnVelocity(params.seed, i, 0, params.spawnAngle, params.spawnSpeed);
+            positions[i * 3] = params.respawnPosition.x;
+            positions[i * 3 + 1] = params.respawnPosition.y;
+            positions[i * 3 + 2] = params.respawnPosition.z;
+            velocities[i * 3] = v.x;
+            velocities[i * 3 + 1] = v.y;
+            velocities[i * 3 + 2] = v.z;
+            startTimes[i] = i * params.ParticleLifetime / count;
+        }
+        system.addEmitter(params, positions, velocities, startTimes, params.respawnPosition, 4.0f);
+    }
+}
 
-    fireShader->setSampler2D("ParticleTexture", 0);
-    fireShader->setFloat("ParticleLifetime", 4.0f);
-    fireShader->setVec3("Accel", glm::vec3(0.0f, 0.1f, 0.0f));
-    fireShader->setFloat("Time", config.Time);
-    fireShader->setFloat("H", config.H);
+// the fountain is emitter 0 and the fire emitter 1, the small fountains follow
+void initParticleSystem() {
+    PROFILE_FUNCTION();
 
-    //Disable rendering
-    glEnable(GL_RASTERIZER_DISCARD);
+    if (!updateParticlesShader)
+    {
+        updateParticlesShader = loadShaderAsset("shaders/particles_update.comp");
+        updatePackedShader = loadShaderAsset("shaders/particles_update_packed.comp");
+        particleRenderShader = loadShaderAsset("shaders/particles.vert", "shaders/TF_fountain.frag");
+        packedRenderShader = loadShaderAsset("shaders/particles_packed.vert", "shaders/TF_fountain.frag");
+        updateParticlesUniforms = ParticleUniforms(*updateParticlesShader);
+        updatePackedUniforms = ParticleUniforms(*updatePackedShader);
+        particleRenderUniforms = ParticleUniforms(*particleRenderShader);
+        packedRenderUniforms = ParticleUniforms(*packedRenderShader);
+    }
 
-    //Bind the feedback obj. for the buffers to be drawn
-    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, config.feedback[config.drawBuf]);
+    particleSystem = new ParticleSystem(config.particleFormat);
 
-    //Draw points from input buffer with transform feedback
-    glBeginTransformFeedback(GL_POINTS);
-    glBindVertexArray(config.particleArray[1 - config.drawBuf]);
-    glDrawArrays(GL_POINTS, 0, config.particleCountFire);
-    glEndTransformFeedback();
+    // the packed positions are stored relative to a box around each emitter
+    std::vector<float> positions, velocities, startTimes;
+    fillFountainData(config.particleCountFountain, positions, velocities, startTimes, &initPool());
+    particleSystem->addEmitter(fountainParams(), positions, velocities, startTimes, glm::vec3(2.5f, 0.0f, 0.0f));
+
+    fillFireData(config.particleCountFire, positions, velocities, startTimes, &initPool());
+    particleSystem->addEmitter(fireParams(), positions, velocities, startTimes, glm::vec3(0.0f));
+
+    addSmallFountains(*particleSystem);
+}
+
+// recreates the pool in another storage format, the simulation restarts
+void setParticleFormat(ParticleFormat format) {
+
+    if (format == config.particleFormat)
+        return;
+    config.particleFormat = format;
+    delete particleSystem;
+    initParticleSystem();
+}
+
+void setSmallFountains(GLuint count) {
+
+    config.smallFountains = count;
+    delete particleSystem;
+    initParticleSystem();
+}
 
-    //Enable rendering
-    glDisable(GL_RASTERIZER_DISCARD);
+void updateParticleSystem() {
 
-    //Select the subroutine for particle rendering
-    glUniformSubroutinesuiv(GL_VERTEX_SHADER, 1, &config.renderParticles);
-    glClear(GL_COLOR_BUFFER_BIT);
+    // the GUI may have changed the fountain
+    particleSystem->setParams(0, fountainParams());
+
+    bool packed = config.particleFormat == PARTICLE_FORMAT_PACKED;
+    if (packed)
+        particleSystem->update(*updatePackedShader, updatePackedUniforms, config.Time, config.H);
+    else
+        particleSystem->update(*updateParticlesShader, updateParticlesUniforms, config.Time, config.H);
+}
+
+void renderParticleSystem() {
+
+    bool packed = config.particleFormat == PARTICLE_FORMAT_PACKED;
 
     // camera parameters
     glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
     glm::mat4 view = camera.GetViewMatrix();
-    glm::mat4 model = glm::mat4(1.0f);
 
-    glm::mat4 mv = view * model;
-    fireShader->setMat4("MVP", projection * mv);
+    // every emitter in one draw, the render shader looks up the lifetime (and packed box) of each particle
+    Shader* renderShader = packed ? packedRenderShader.get() : particleRenderShader.get();
+    const ParticleUniforms& uniforms = packed ? packedRenderUniforms : particleRenderUniforms;
+    renderShader->use();
+    renderShader->setSampler2D(uniforms.ParticleTexture, 0);
+    renderShader->setFloat(uniforms.Time, config.Time);
+    renderShader->setMat4(uniforms.MVP, projection * view);
+    particleSystem->draw(*renderShader, uniforms);
+}
 
-    //Draw the sprites from the feedback buffer
-    glBindVertexArray(config.particleArray[config.drawBuf]);
-    glDrawTransformFeedback(GL_POINTS, config.feedback[config.drawBuf]);
+//-----------------------------------------------------------------------------------------------------------------------------------------
+//-----------------------------------------------------------------SPRITES-----------------------------------------------------------------
+//-----------------------------------------------------------------------------------------------------------------------------------------
+// the sprite programs of every path and the hull of the particle texture, which must be loaded
+void initSprites() {
+    PROFILE_FUNCTION();
+
+    feedbackSpriteProgram.load("shaders/sprite_feedback.vert");
+    emitterSpriteProgram.load("shaders/sprite_emitter.vert");
+    particleSpriteProgram.load("shaders/sprite_particles.vert");
+    packedSpriteProgram.load("shaders/sprite_particles_packed.vert");
+    sprites = new ParticleSprites(particleTexture->id, config.spriteShape);
+
+    depthDownsampleShader = loadShaderAsset("shaders/fullscreen.vert", "shaders/depth_downsample.frag");
+    particleCompositeShader = loadShaderAsset("shaders/fullscreen.vert", "shaders/particle_composite.frag");
+    particleTargetPrograms = ParticleTargetPrograms(*depthDownsampleShader, *particleCompositeShader);
+    particleTargets[0] = new ParticleTarget(PARTICLE_RESOLUTION_HALF);
+    particleTargets[1] = new ParticleTarget(PARTICLE_RESOLUTION_QUARTER);
+}
 
-    //Swap buffers
-    config.drawBuf = 1 - config.drawBuf;
+// resolution of emitter i of the compute pool: the fountain, the fire, then the small fountains
+ParticleResolution computeEmitterResolution(GLuint emitter) {
+    return emitter == 0 ? config.resolutionFountain : emitter == 1 ? config.resolutionFire : config.resolutionSmallFountains;
 }
 
-GLuint loadTexture(const std::string& fName) {
-    string filename = fName;
+// draws the sprites of the emitters of the selected path drawn at the given resolution, the sprite program of the
+// path must be in use with its uniforms set
+void drawSprites(SpriteProgram& program, ParticleResolution resolution) {
+
+    program.shader->setFloat(program.uniforms.DepthScale, (float)resolution);
+    if (config.particlePath == PATH_EMITTER)
+    {
+        if (config.resolutionFountain == resolution)
+            fountainEmitter->drawSprites(emitterPrograms);
+        if (config.resolutionFire == resolution)
+            fireEmitter->drawSprites(emitterPrograms);
+    }
+    else if (config.particlePath == PATH_COMPUTE)
+    {
+        // one draw per run of neighbouring emitters of the same resolution
+        GLuint emitters = particleSystem->emitterCount();
+        for (GLuint first = 0, last = 0; first < emitters; first = last)
+        {
+            for (last = first + 1; last < emitters && computeEmitterResolution(last) == computeEmitterResolution(first); last++) {}
+            if (computeEmitterResolution(first) == resolution)
+                particleSystem->drawSprites(*program.shader, program.particleUniforms, sprites->hull.cornerCount, first, last - first);
+        }
+    }
+    else
+    {
+        // the latest buffer set of each system, with the lifetime its update used
+        FeedbackParticles* systems[2] = { &config.fountainFeedback, &config.fireFeedback };
+        float lifetimes[2] = { fountainParams().ParticleLifetime, fireParams().ParticleLifetime };
+        ParticleResolution resolutions[2] = { config.resolutionFountain, config.resolutionFire };
+        for (int i = 0; i < 2; i++)
+        {
+            if (resolutions[i] != resolution)
+                continue;
+            program.shader->setFloat(program.uniforms.ParticleLifetime, lifetimes[i]);
+            glBindVertexArray(systems[i]->spriteArray[systems[i]->drawBuf]);
+            glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, sprites->hull.cornerCount, systems[i]->count);
+        }
+        glBindVertexArray(0);
+    }
+}
+
+// draws the particles of the selected path as sprites over the scene drawn so far, they fade out in front of it.
+// Full resolution sprites go straight into the frame, the others into the target of their resolution, laid over
+// the frame by compositeParticles()
+void renderSprites() {
+    PROFILE_FUNCTION();
+
+    // camera parameters
+    const float nearPlane = 0.1f, farPlane = 100.0f;
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, nearPlane, farPlane);
+    glm::mat4 view = camera.GetViewMatrix();
+
+    sprites->captureDepth();
+    glDepthMask(GL_FALSE);
+
+    SpriteProgram& program = config.particlePath == PATH_EMITTER ? emitterSpriteProgram
+                           : config.particlePath == PATH_TRANSFORM_FEEDBACK ? feedbackSpriteProgram
+                           : config.particleFormat == PARTICLE_FORMAT_PACKED ? packedSpriteProgram : particleSpriteProgram;
+    program.shader->use();
+    sprites->setUniforms(*program.shader, program.uniforms, view, projection, nearPlane, farPlane);
+    program.shader->setFloat(program.uniforms.Time, config.Time);
+    drawSprites(program, PARTICLE_RESOLUTION_FULL);
+
+    ParticleResolution used[3] = { config.resolutionFountain, config.resolutionFire,
+                                   config.particlePath == PATH_COMPUTE && config.smallFountains > 0 ? config.resolutionSmallFountains
+                                                                                                    : PARTICLE_RESOLUTION_FULL };
+    for (ParticleTarget* target : particleTargets)
+    {
+        if (std::find(used, used + 3, target->resolution()) == used + 3)
+            continue;
+        target->begin(particleTargetPrograms, sprites->sceneDepth());
+        program.shader->use();
+        drawSprites(program, target->resolution());
+        target->end();
+    }
+
+    glDepthMask(GL_TRUE);
+}
+
+// blends the reduced resolution sprites drawn by renderSprites() over the frame
+void compositeParticles() {
+
+    for (ParticleTarget* target : particleTargets)
+        target->composite(particleTargetPrograms, sprites->sceneDepth(), 0.1f, 100.0f);
+}
+
+// shared with every other load of the same file or a copy of it, see AssetManager
+TextureHandle loadTexture(const std::string& fName) {
+    PROFILE_FUNCTION();
+    return AssetManager::instance().acquireFile<TextureObject>("texture2d:rgba", fName, [&](vector<unsigned char>& bytes) {
+        return createTexture(fName, bytes);
+    });
+}
+
+TextureHandle createTexture(const std::string& fName, const vector<unsigned char>& bytes) {
 
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
     int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+    unsigned char* data = bytes.empty() ? NULL : stbi_load_from_memory(bytes.data(), (int)bytes.size(), &width, &height, &nrComponents, 0);
     if (data)
     {
         glBindTexture(GL_TEXTURE_2D, textureID);
@@ -620,7 +1319,7 @@ GLuint loadTexture(const std::string& fName) {
         stbi_image_free(data);
     }
 
-    return textureID;
+    return std::make_shared<TextureObject>(textureID);
 }
 
 
@@ -701,7 +1400,15 @@ unsigned int initSkyboxBuffers() {
 // +Z (front)
 // -Z (back)
 // -------------------------------------------------------
-unsigned int loadCubemap(vector<std::string> faces)
+TextureHandle loadCubemap(vector<std::string> faces)
+{
+    PROFILE_FUNCTION();
+    return AssetManager::instance().acquireFiles<TextureObject>("cubemap", faces, [&](vector<vector<unsigned char>>& files) {
+        return createCubemap(faces, files);
+    });
+}
+
+TextureHandle createCubemap(const vector<std::string>& faces, const vector<vector<unsigned char>>& files)
 {
     unsigned int textureID;
     glGenTextures(1, &textureID);
@@ -710,7 +1417,7 @@ unsigned int loadCubemap(vector<std::string> faces)
     int width, height, nrComponents;
     for (unsigned int i = 0; i < faces.size(); i++)
     {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrComponents, 0);
+        unsigned char* data = files[i].empty() ? NULL : stbi_load_from_memory(files[i].data(), (int)files[i].size(), &width, &height, &nrComponents, 0);
         if (data)
         {
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_SRGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
@@ -732,13 +1439,14 @@ unsigned int loadCubemap(vector<std::string> faces)
 
     glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
-    return textureID;
+    return std::make_shared<TextureObject>(textureID);
 }
 
 
 
 void drawSkybox()
 {
+    PROFILE_FUNCTION();
    
     // render skybox
     glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
@@ -746,14 +1454,14 @@ void drawSkybox()
     skyboxShader->use();
     glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
     glm::mat4 view = camera.GetViewMatrix();
-    skyboxShader->setMat4("projection", projection);
-    skyboxShader->setMat4("view", view);
-    skyboxShader->setInt("skybox", 1);
+    skyboxShader->setMat4(skyboxUniforms.projection, projection);
+    skyboxShader->setMat4(skyboxUniforms.view, view);
+    skyboxShader->setInt(skyboxUniforms.skybox, 1);
 
     // skybox cube
     glBindVertexArray(skyboxVAO);
     glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture->id);
     glDrawArrays(GL_TRIANGLES, 0, 36);
     glBindVertexArray(0);
     glDepthFunc(GL_LESS); // set depth function back to default
@@ -762,7 +1470,20 @@ void drawSkybox()
 //-----------------------------------------------------------------------------------------------------------------------------------------
 //-------------------------------------------------------------------GUI-------------------------------------------------------------------
 //-----------------------------------------------------------------------------------------------------------------------------------------
+// radio buttons for the sprite resolution of one emitter, id tells the buttons of the emitters apart
+void resolutionGui(const char* label, const char* id, ParticleResolution& resolution) {
+    const ParticleResolution resolutions[3] = { PARTICLE_RESOLUTION_FULL, PARTICLE_RESOLUTION_HALF, PARTICLE_RESOLUTION_QUARTER };
+    ImGui::Text("%s", label);
+    for (ParticleResolution option : resolutions)
+    {
+        ImGui::SameLine();
+        std::string button = std::string(particleResolutionName(option)) + "##" + id;
+        if (ImGui::RadioButton(button.c_str(), resolution == option)) { resolution = option; }
+    }
+}
+
 void drawGui() {
+    PROFILE_FUNCTION();
 
     // Start the Dear ImGui frame
     ImGui_ImplOpenGL3_NewFrame();
@@ -775,13 +1496,46 @@ void drawGui() {
         ImGui::Text("Fountain: ");
         ImGui::SliderFloat("Particle Lifetime", &config.ParticleLifeTimeFountain, 2.0f, 4.0f);
         ImGui::SliderFloat("Acceleration", (float*)&config.accelerationFountain.y, 0.0f, -5.0f);
+        ImGui::SliderFloat("Emission rate", &config.emissionRateFountain, 0.0f, 5000.0f);
         ImGui::Separator();
 
-        ImGui::Text("Shading model: ");
+        ImGui::Text("Fire: ");
+        ImGui::SliderFloat("Emission rate##fire", &config.emissionRateFire, 0.0f, 5000.0f);
+        ImGui::Separator();
+
+        ImGui::Text("Update path: ");
+        {
+            if (ImGui::RadioButton("Transform feedback", config.particlePath == PATH_TRANSFORM_FEEDBACK)) { config.particlePath = PATH_TRANSFORM_FEEDBACK; }
+            if (ImGui::RadioButton("Dead/alive list emitter", config.particlePath == PATH_EMITTER)) { config.particlePath = PATH_EMITTER; }
+            if (ImGui::RadioButton("Compute (in place)", config.particlePath == PATH_COMPUTE)) { config.particlePath = PATH_COMPUTE; }
+        }
+        ImGui::Text("Compute storage: ");
         {
-            //if (ImGui::RadioButton("Fountain", shader == fountainShader)) { shader = fountainShader; }
+            if (ImGui::RadioButton("Float", config.particleFormat == PARTICLE_FORMAT_FLOAT)) { setParticleFormat(PARTICLE_FORMAT_FLOAT); }
+            ImGui::SameLine();
+            if (ImGui::RadioButton("Packed 16 bit", config.particleFormat == PARTICLE_FORMAT_PACKED)) { setParticleFormat(PARTICLE_FORMAT_PACKED); }
         }
+        ImGui::Checkbox("Point sprites", &config.pointSprites);
+        ImGui::SliderFloat("Sprite size", &sprites->size, 0.01f, 0.5f);
+        ImGui::SliderFloat("Soft distance", &sprites->softDistance, 0.01f, 2.0f);
+        ImGui::Text("Sprite fan: %u corners, %.1f%% of the quad (alpha hull %.1f%%)", sprites->hull.cornerCount,
+                    sprites->hull.area * 100.0f, sprites->hullArea * 100.0f);
+        resolutionGui("Fountain resolution:", "fountain", config.resolutionFountain);
+        resolutionGui("Fire resolution:", "fire", config.resolutionFire);
+        resolutionGui("Small fountain resolution:", "small", config.resolutionSmallFountains);
+        static int smallFountains = (int)config.smallFountains;
+        ImGui::SliderInt("Small fountains", &smallFountains, 0, 1000);
+        if (ImGui::IsItemDeactivatedAfterEdit()) { setSmallFountains((GLuint)smallFountains); }
+        // transform feedback: two copies of position, velocity and start time
+        size_t particles = config.particleCountFountain + config.particleCountFire;
+        size_t feedbackBytes = particles * 2 * (3 + 3 + 1) * sizeof(float);
+        ImGui::Text("Particle memory: transform feedback %.1f KB, compute (%s) %.1f KB", feedbackBytes / 1024.0f,
+                    particleFormatName(config.particleFormat), particleSystem->memoryBytes() / 1024.0f);
+        ImGui::Text("Compute pool: %u emitters, %u particles", particleSystem->emitterCount(), particleSystem->particleCount());
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+        ImGui::Text("GPU average %.3f ms/frame:", gpuTimer->averageTotalMs());
+        for (int pass = 0; pass < GPU_PASS_COUNT; pass++)
+            ImGui::Text("  %-8s %.3f ms", gpuPassName((GpuPass)pass), gpuTimer->averageMs((GpuPass)pass));
         ImGui::End();
     }
 
@@ -794,6 +1548,7 @@ void drawGui() {
 //------------------------------------------------------------------INPUT------------------------------------------------------------------
 //-----------------------------------------------------------------------------------------------------------------------------------------
 void processInput(GLFWwindow *window) {
+    PROFILE_FUNCTION();
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
@@ -55,30 +55,15 @@ public:
     }
 
     // render the mesh
-    void Draw(Shader shader)
+    void Draw(const Shader& shader)
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int ambientNr   = 1;
+        if (locationsProgram != shader.ID)
+            findLocations(shader);
         for(unsigned int i = 0; i < textures.size(); i++)
         {
             glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if(name == "texture_ambient")
-                number = std::to_string(ambientNr++); // transfer unsigned int to stream
-
             // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+            glUniform1i(samplerLocations[i], i);
             // and finally bind the texture
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
@@ -95,8 +80,37 @@ public:
 private:
     /*  Render data  */
     unsigned int VBO, EBO;
+    // sampler locations in the program they were found for, so drawing does not look them up again
+    unsigned int locationsProgram = 0;
+    vector<GLint> samplerLocations; // of every texture
 
     /*  Functions    */
+    // the sampler of every texture, the N-th texture of a type is sampled by typeN (e.g. texture_diffuse1)
+    void findLocations(const Shader& shader)
+    {
+        unsigned int diffuseNr  = 1;
+        unsigned int specularNr = 1;
+        unsigned int normalNr   = 1;
+        unsigned int ambientNr   = 1;
+        samplerLocations.resize(textures.size());
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            // retrieve texture number (the N in diffuse_textureN)
+            string number;
+            string name = textures[i].type;
+            if(name == "texture_diffuse")
+                number = std::to_string(diffuseNr++);
+            else if(name == "texture_specular")
+                number = std::to_string(specularNr++); // transfer unsigned int to stream
+            else if(name == "texture_normal")
+                number = std::to_string(normalNr++); // transfer unsigned int to stream
+            else if(name == "texture_ambient")
+                number = std::to_string(ambientNr++); // transfer unsigned int to stream
+            samplerLocations[i] = shader.uniform((name + number).c_str());
+        }
+        locationsProgram = shader.ID;
+    }
+
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
@@ -0,0 +1,263 @@
+// GPU particle emitter with dead/alive index lists
+#ifndef PARTICLE_EMITTER_H
+#define PARTICLE_EMITTER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "particle_sprites.h"
+
+#include <cmath>
+#include <vector>
+
+// Instead of recycling a slot when Time - StartTime > ParticleLifetime, every slot of the pool is either
+// on the dead list (free) or on the alive list. Each frame:
+//  1. emitter_kickoff.comp clamps the requested emission to the dead count and writes the indirect dispatch sizes
+//  2. emitter_emit.comp pops slots from the dead list and appends them to the current alive list
+//  3. emitter_simulate.comp integrates the current alive list, dead particles are pushed back on the dead list
+//     and survivors are appended to the next alive list
+//  4. the alive count of the next list is copied into the indirect draw commands, so only live particles are drawn:
+//     as the vertex count of the points and the instance count of the sprites
+// The list sizes are atomic counters, the CPU never reads them back.
+
+// binding points shared with the emitter shaders
+// ----------------------------------------------
+const GLuint EMITTER_PARTICLES_BINDING = 0;
+const GLuint EMITTER_DEAD_LIST_BINDING = 1;
+const GLuint EMITTER_ALIVE_CURRENT_BINDING = 2;
+const GLuint EMITTER_ALIVE_NEXT_BINDING = 3;
+const GLuint EMITTER_SPAWN_POSITION_BINDING = 4;
+const GLuint EMITTER_COUNTERS_BINDING = 6; // counters as SSBO (kickoff) and as atomic counter buffer
+const GLuint EMITTER_ARGS_BINDING = 7;
+const GLuint EMITTER_WORKGROUP_SIZE = 64;
+
+// layout of the indirect argument buffer (in uints)
+// -------------------------------------------------
+const GLuint EMITTER_ARGS_EMIT_DISPATCH = 0; // x, y, z
+const GLuint EMITTER_ARGS_SIMULATE_DISPATCH = 3; // x, y, z
+const GLuint EMITTER_ARGS_EMIT_COUNT = 6;
+const GLuint EMITTER_ARGS_DRAW = 7; // count, instanceCount, first, baseInstance
+const GLuint EMITTER_ARGS_SPRITE_DRAW = 11; // same, one instance per particle
+const GLuint EMITTER_ARGS_SIZE = 15;
+
+// the programs of the emitter passes and the locations of the uniforms update() and draw() set, looked up once
+struct EmitterPrograms {
+    Shader* kickoff = nullptr;
+    Shader* emit = nullptr;
+    Shader* simulate = nullptr;
+    Shader* render = nullptr;
+    Shader* sprites = nullptr; // shaders/sprite_emitter.vert, see particle_sprites.h
+    GLint kickoffRequestedCount = -1, kickoffCurrent = -1;
+    GLint emitCurrent = -1, emitGeneration = -1, emitSeed = -1, emitSpawnAngle = -1, emitSpawnSpeed = -1;
+    GLint simulateCurrent = -1, simulateH = -1, simulateAccel = -1, simulateParticleLifetime = -1;
+    GLint renderParticleTexture = -1, renderMVP = -1, renderParticleLifetime = -1;
+    GLint spritesParticleLifetime = -1;
+
+    EmitterPrograms() {}
+
+    EmitterPrograms(Shader& kickoff, Shader& emit, Shader& simulate, Shader& render, Shader& sprites)
+        : kickoff(&kickoff), emit(&emit), simulate(&simulate), render(&render), sprites(&sprites)
+    {
+        kickoffRequestedCount = kickoff.uniform("RequestedCount");
+        kickoffCurrent = kickoff.uniform("Current");
+        emitCurrent = emit.uniform("Current");
+        emitGeneration = emit.uniform("Generation");
+        emitSeed = emit.uniform("Seed");
+        emitSpawnAngle = emit.uniform("SpawnAngle");
+        emitSpawnSpeed = emit.uniform("SpawnSpeed");
+        simulateCurrent = simulate.uniform("Current");
+        simulateH = simulate.uniform("H");
+        simulateAccel = simulate.uniform("Accel");
+        simulateParticleLifetime = simulate.uniform("ParticleLifetime");
+        renderParticleTexture = render.uniform("ParticleTexture");
+        renderMVP = render.uniform("MVP");
+        renderParticleLifetime = render.uniform("ParticleLifetime");
+        spritesParticleLifetime = sprites.uniform("ParticleLifetime");
+    }
+};
+
+class ParticleEmitter
+{
+public:
+    GLuint capacity; // pool size, the most particles that can be alive at once
+    float emissionRate = 1000.0f; // particles per second
+    float particleLifetime = 3.5f;
+    glm::vec3 acceleration = glm::vec3(0.0f, -0.6f, 0.0f);
+    // emitted particles draw their velocity from (slot, frame) with counter_rng.glsl
+    GLuint seed = 0;
+    float spawnAngle = 0.0f; // half opening of the velocity cone around +y in radians
+    glm::vec2 spawnSpeed = glm::vec2(0.0f); // min, max
+
+    // spawnPositions holds one vec3 per slot (same layout as posBuf), a particle emitted into slot i starts there
+    ParticleEmitter(GLuint capacity, const std::vector<float>& spawnPositions)
+        : capacity(capacity), current(0), generation(0), emitAccumulator(0.0f)
+    {
+        setupBuffers(spawnPositions);
+    }
+
+    ~ParticleEmitter()
+    {
+        GLuint buffers[] = { particleBuf, deadList, aliveList[0], aliveList[1], spawnPosBuf, counterBuf, argsBuf };
+        glDeleteBuffers(7, buffers);
+        glDeleteVertexArrays(1, &emptyVAO);
+    }
+
+    ParticleEmitter(const ParticleEmitter&) = delete;
+    ParticleEmitter& operator=(const ParticleEmitter&) = delete;
+
+    // emits and simulates one frame, H is the elapsed time since the last update
+    // ------------------------------------------------------------------------
+    void update(const EmitterPrograms& programs, float H)
+    {
+        // emission is independent from the pool size and the lifetime
+        emitAccumulator += emissionRate * H;
+        GLuint requested = (GLuint)std::floor(emitAccumulator);
+        emitAccumulator -= (float)requested;
+
+        bindBuffers();
+
+        programs.kickoff->use();
+        programs.kickoff->setUInt(programs.kickoffRequestedCount, requested);
+        programs.kickoff->setUInt(programs.kickoffCurrent, current);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_ATOMIC_COUNTER_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+        programs.emit->use();
+        programs.emit->setUInt(programs.emitCurrent, current);
+        programs.emit->setUInt(programs.emitGeneration, generation++);
+        programs.emit->setUInt(programs.emitSeed, seed);
+        programs.emit->setFloat(programs.emitSpawnAngle, spawnAngle);
+        programs.emit->setVec2(programs.emitSpawnSpeed, spawnSpeed);
+        glDispatchComputeIndirect(EMITTER_ARGS_EMIT_DISPATCH * sizeof(GLuint));
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_ATOMIC_COUNTER_BARRIER_BIT);
+
+        programs.simulate->use();
+        programs.simulate->setUInt(programs.simulateCurrent, current);
+        programs.simulate->setFloat(programs.simulateH, H);
+        programs.simulate->setVec3(programs.simulateAccel, acceleration);
+        programs.simulate->setFloat(programs.simulateParticleLifetime, particleLifetime);
+        glDispatchComputeIndirect(EMITTER_ARGS_SIMULATE_DISPATCH * sizeof(GLuint));
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_ATOMIC_COUNTER_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+        // the survivors are the vertex count of the points and the instance count of the sprites
+        glBindBuffer(GL_COPY_READ_BUFFER, counterBuf);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, argsBuf);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (1 + (1 - current)) * sizeof(GLuint),
+                            EMITTER_ARGS_DRAW * sizeof(GLuint), sizeof(GLuint));
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (1 + (1 - current)) * sizeof(GLuint),
+                            (EMITTER_ARGS_SPRITE_DRAW + 1) * sizeof(GLuint), sizeof(GLuint));
+
+        current = 1 - current;
+    }
+
+    // draws the alive particles as points, the render program must be in use with its MVP set
+    // ------------------------------------------------------------------------
+    void draw(const EmitterPrograms& programs)
+    {
+        programs.render->setFloat(programs.renderParticleLifetime, particleLifetime);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EMITTER_PARTICLES_BINDING, particleBuf);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EMITTER_ALIVE_CURRENT_BINDING, aliveList[current]);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+        glBindVertexArray(emptyVAO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, argsBuf);
+        glDrawArraysIndirect(GL_POINTS, (void*)(EMITTER_ARGS_DRAW * sizeof(GLuint)));
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
+    // vertices of the sprite fan of every particle, SPRITE_HULL_CORNERS until set
+    // ------------------------------------------------------------------------
+    void setSpriteCorners(GLuint corners)
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, argsBuf);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, EMITTER_ARGS_SPRITE_DRAW * sizeof(GLuint), sizeof(GLuint), &corners);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    // draws the alive particles as sprites, the sprite program must be in use with its sprite uniforms set
+    // ------------------------------------------------------------------------
+    void drawSprites(const EmitterPrograms& programs)
+    {
+        programs.sprites->setFloat(programs.spritesParticleLifetime, particleLifetime);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EMITTER_PARTICLES_BINDING, particleBuf);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EMITTER_ALIVE_CURRENT_BINDING, aliveList[current]);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+        glBindVertexArray(emptyVAO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, argsBuf);
+        glDrawArraysIndirect(GL_TRIANGLE_FAN, (void*)(EMITTER_ARGS_SPRITE_DRAW * sizeof(GLuint)));
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
+private:
+    GLuint particleBuf; // vec4 position (w = age), vec4 velocity per slot
+    GLuint deadList;
+    GLuint aliveList[2];
+    GLuint spawnPosBuf;
+    GLuint counterBuf; // dead count, alive count 0, alive count 1
+    GLuint argsBuf;
+    GLuint emptyVAO; // the render pass fetches everything from the storage buffers
+    GLuint current; // alive list filled by the last update
+    GLuint generation; // frames emitted so far, part of the random number counter
+    float emitAccumulator; // fractional particles carried to the next frame
+
+    void setupBuffers(const std::vector<float>& spawnPositions)
+    {
+        glGenBuffers(1, &particleBuf);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, particleBuf);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * 2 * sizeof(glm::vec4), NULL, GL_DYNAMIC_COPY);
+
+        // every slot starts out dead
+        std::vector<GLuint> slots(capacity);
+        for (GLuint i = 0; i < capacity; i++)
+            slots[i] = capacity - 1 - i;
+        glGenBuffers(1, &deadList);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, deadList);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(GLuint), slots.data(), GL_DYNAMIC_COPY);
+
+        glGenBuffers(2, aliveList);
+        for (GLuint i = 0; i < 2; i++)
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, aliveList[i]);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+        }
+
+        glGenBuffers(1, &spawnPosBuf);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, spawnPosBuf);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * 3 * sizeof(float), spawnPositions.data(), GL_STATIC_DRAW);
+
+        GLuint counters[3] = { capacity, 0, 0 };
+        glGenBuffers(1, &counterBuf);
+        glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, counterBuf);
+        glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(counters), counters, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+
+        GLuint args[EMITTER_ARGS_SIZE] = { 0, 1, 1, 0, 1, 1, 0, 0, 1, 0, 0, SPRITE_HULL_CORNERS, 0, 0, 0 };
+        glGenBuffers(1, &argsBuf);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, argsBuf);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(args), args, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        glGenVertexArrays(1, &emptyVAO);
+    }
+
+    void bindBuffers()
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EMITTER_PARTICLES_BINDING, particleBuf);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EMITTER_DEAD_LIST_BINDING, deadList);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EMITTER_ALIVE_CURRENT_BINDING, aliveList[current]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EMITTER_ALIVE_NEXT_BINDING, aliveList[1 - current]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EMITTER_SPAWN_POSITION_BINDING, spawnPosBuf);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EMITTER_COUNTERS_BINDING, counterBuf);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EMITTER_ARGS_BINDING, argsBuf);
+        glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, counterBuf);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, argsBuf);
+    }
+};
+#endif
@@ -0,0 +1,229 @@
+// Camera-facing sprites for the particles, expanded in the vertex shader and faded against the depth of the scene
+#ifndef PARTICLE_SPRITES_H
+#define PARTICLE_SPRITES_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+// Points are limited to the point sizes of the implementation, can not turn and disappear as soon as their
+// center leaves the screen. Sprites are drawn instead as one instance per particle of a triangle fan: the vertex
+// shader (shaders/sprite.glsl) reads the particle of gl_InstanceID from the same buffers the points use and
+// places corner gl_VertexID of the sprite around it in view space, no geometry shader involved.
+//
+// The corners are those of the alpha hull of the sprite texture rather than of the full quad: the box of its
+// visible texels with the corners cut off at 45 degrees, eight corners. The transparent parts of the quad that
+// are not drawn at all cost no blending, which is most of the fill of a particle system. A hull covering most of
+// the quad saves less fill than its six triangles cost over the two of the quad (water/bluewater.png: 98.3%,
+// 73 ms against 59 ms of render time on llvmpipe), so above SPRITE_HULL_MAX_AREA the plain quad is drawn.
+//
+// shaders/sprite.frag fades each fragment over SoftDistance in front of the scene, read from a copy of the depth
+// buffer taken by captureDepth() before the particles are drawn, so sprites crossing geometry show no hard edge.
+const GLuint SPRITE_HULL_CORNERS = 8;
+const GLuint SPRITE_QUAD_CORNERS = 4;
+const float SPRITE_HULL_MAX_AREA = 0.85f; // of the quad, the largest hull drawn instead of the quad
+const GLuint SPRITE_SCENE_DEPTH_UNIT = 2; // 0 holds the particle texture, 1 the skybox
+
+// the corners of a triangle fan around the visible texels of a sprite, in texture coordinates, counter clockwise
+struct SpriteHull {
+    glm::vec2 corners[SPRITE_HULL_CORNERS];
+    GLuint cornerCount; // vertices of the fan, SPRITE_QUAD_CORNERS for the quad
+    float area; // of the fan, the full quad is 1
+
+    // the full quad in the first four corners
+    static SpriteHull quad()
+    {
+        SpriteHull hull;
+        const glm::vec2 square[4] = { glm::vec2(0.0f), glm::vec2(1.0f, 0.0f), glm::vec2(1.0f), glm::vec2(0.0f, 1.0f) };
+        for (GLuint i = 0; i < SPRITE_HULL_CORNERS; i++)
+            hull.corners[i] = square[std::min(i, SPRITE_QUAD_CORNERS - 1)];
+        hull.cornerCount = SPRITE_QUAD_CORNERS;
+        hull.area = 1.0f;
+        return hull;
+    }
+};
+
+// what the sprites are drawn as
+enum SpriteShape {
+    SPRITE_SHAPE_AUTO, // the alpha hull if it covers at most SPRITE_HULL_MAX_AREA of the quad, the quad otherwise
+    SPRITE_SHAPE_HULL,
+    SPRITE_SHAPE_QUAD
+};
+
+// hull of the texels of an RGBA image whose alpha is above threshold. Every texel counts with half a texel
+// around it, as far as the bilinear filter spreads it
+// ------------------------------------------------------------------------
+inline SpriteHull spriteHull(const std::vector<unsigned char>& rgba, int width, int height, unsigned char threshold = 0)
+{
+    // the box and the four diagonal support lines, x + y and x - y at their extremes
+    float lowX = 1.0f, lowY = 1.0f, highX = 0.0f, highY = 0.0f;
+    float lowSum = 2.0f, highSum = 0.0f, lowDifference = 1.0f, highDifference = -1.0f;
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            if (rgba[((size_t)y * width + x) * 4 + 3] <= threshold)
+                continue;
+            float x0 = (x - 0.5f) / width, x1 = (x + 1.5f) / width;
+            float y0 = (y - 0.5f) / height, y1 = (y + 1.5f) / height;
+            lowX = std::min(lowX, x0);
+            highX = std::max(highX, x1);
+            lowY = std::min(lowY, y0);
+            highY = std::max(highY, y1);
+            lowSum = std::min(lowSum, x0 + y0);
+            highSum = std::max(highSum, x1 + y1);
+            lowDifference = std::min(lowDifference, x0 - y1);
+            highDifference = std::max(highDifference, x1 - y0);
+        }
+    if (lowX > highX)
+        return SpriteHull::quad();
+    lowX = std::max(lowX, 0.0f);
+    lowY = std::max(lowY, 0.0f);
+    highX = std::min(highX, 1.0f);
+    highY = std::min(highY, 1.0f);
+
+    // where each cut meets the two sides of its corner, inside the box
+    SpriteHull hull;
+    hull.cornerCount = SPRITE_HULL_CORNERS;
+    glm::vec2* c = hull.corners;
+    c[0] = glm::vec2(std::max(lowSum - lowY, lowX), lowY);
+    c[1] = glm::vec2(std::min(highDifference + lowY, highX), lowY);
+    c[2] = glm::vec2(highX, std::max(highX - highDifference, lowY));
+    c[3] = glm::vec2(highX, std::min(highSum - highX, highY));
+    c[4] = glm::vec2(std::min(highSum - highY, highX), highY);
+    c[5] = glm::vec2(std::max(highY + lowDifference, lowX), highY);
+    c[6] = glm::vec2(lowX, std::min(lowX - lowDifference, highY));
+    c[7] = glm::vec2(lowX, std::max(lowSum - lowX, lowY));
+
+    float twiceArea = 0.0f;
+    for (GLuint i = 0; i < SPRITE_HULL_CORNERS; i++)
+    {
+        const glm::vec2& a = c[i];
+        const glm::vec2& b = c[(i + 1) % SPRITE_HULL_CORNERS];
+        twiceArea += a.x * b.y - b.x * a.y;
+    }
+    hull.area = 0.5f * twiceArea;
+    return hull;
+}
+
+// locations of the uniforms every sprite program has, -1 where a program lacks one
+struct SpriteUniforms {
+    GLint ModelView = -1, Projection = -1, SpriteSize = -1, SpriteSpin = -1, SpriteHull = -1;
+    GLint ParticleTexture = -1, SceneDepth = -1, DepthScale = -1, DepthRange = -1, SoftDistance = -1;
+    GLint Time = -1, ParticleLifetime = -1;
+
+    SpriteUniforms() {}
+
+    explicit SpriteUniforms(const Shader& shader)
+        : ModelView(shader.uniform("ModelView")), Projection(shader.uniform("Projection")), SpriteSize(shader.uniform("SpriteSize")),
+          SpriteSpin(shader.uniform("SpriteSpin")), SpriteHull(shader.uniform("SpriteHull")),
+          ParticleTexture(shader.uniform("ParticleTexture")), SceneDepth(shader.uniform("SceneDepth")),
+          DepthScale(shader.uniform("DepthScale")), DepthRange(shader.uniform("DepthRange")),
+          SoftDistance(shader.uniform("SoftDistance")), Time(shader.uniform("Time")), ParticleLifetime(shader.uniform("ParticleLifetime"))
+    {
+    }
+};
+
+class ParticleSprites
+{
+public:
+    float size = 0.06f; // edge of the quad in world units, about the 10 pixel points at the default distance
+    float spin = 1.0f; // radians per second of age
+    float softDistance = 0.5f; // world units in front of the scene over which the sprites fade out
+    SpriteHull hull; // the fan drawn
+    float hullArea; // of the alpha hull of the texture, 1 if it was not read
+
+    // texture is the sprite of every particle, its hull is read back once and drawn as shape says
+    ParticleSprites(GLuint texture, SpriteShape shape = SPRITE_SHAPE_AUTO)
+        : hull(SpriteHull::quad()), hullArea(1.0f), depthTexture(0), depthWidth(0), depthHeight(0)
+    {
+        if (shape == SPRITE_SHAPE_QUAD)
+            return;
+        GLint previous = 0, width = 0, height = 0;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+        if (width > 0 && height > 0)
+        {
+            std::vector<unsigned char> rgba((size_t)width * height * 4);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+            SpriteHull alphaHull = spriteHull(rgba, width, height);
+            hullArea = alphaHull.area;
+            if (shape == SPRITE_SHAPE_HULL || hullArea <= SPRITE_HULL_MAX_AREA)
+                hull = alphaHull;
+        }
+        glBindTexture(GL_TEXTURE_2D, previous);
+    }
+
+    ~ParticleSprites()
+    {
+        glDeleteTextures(1, &depthTexture);
+    }
+
+    ParticleSprites(const ParticleSprites&) = delete;
+    ParticleSprites& operator=(const ParticleSprites&) = delete;
+
+    // copies the depth buffer of the read framebuffer within the viewport, call once the scene is drawn
+    // ------------------------------------------------------------------------
+    void captureDepth()
+    {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glActiveTexture(GL_TEXTURE0 + SPRITE_SCENE_DEPTH_UNIT);
+        if (!depthTexture || viewport[2] != depthWidth || viewport[3] != depthHeight)
+        {
+            if (!depthTexture)
+                glGenTextures(1, &depthTexture);
+            depthWidth = viewport[2];
+            depthHeight = viewport[3];
+            glBindTexture(GL_TEXTURE_2D, depthTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, depthWidth, depthHeight, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, viewport[0], viewport[1], depthWidth, depthHeight);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // the copy of the last captureDepth()
+    GLuint sceneDepth() const { return depthTexture; }
+
+    // sets what every sprite program shares, shader must be in use. nearPlane and farPlane are those of projection.
+    // Sprites drawn into a reduced target (particle_target.h) set DepthScale to its divisor afterwards
+    // ------------------------------------------------------------------------
+    void setUniforms(const Shader& shader, const SpriteUniforms& uniforms, const glm::mat4& view, const glm::mat4& projection,
+                     float nearPlane, float farPlane) const
+    {
+        shader.setMat4(uniforms.ModelView, view);
+        shader.setMat4(uniforms.Projection, projection);
+        shader.setFloat(uniforms.SpriteSize, size);
+        shader.setFloat(uniforms.SpriteSpin, spin);
+        glUniform2fv(uniforms.SpriteHull, SPRITE_HULL_CORNERS, &hull.corners[0][0]);
+        shader.setSampler2D(uniforms.ParticleTexture, 0);
+        shader.setSampler2D(uniforms.SceneDepth, SPRITE_SCENE_DEPTH_UNIT);
+        shader.setFloat(uniforms.DepthScale, 1.0f);
+        shader.setVec2(uniforms.DepthRange, nearPlane, farPlane);
+        shader.setFloat(uniforms.SoftDistance, softDistance);
+    }
+
+    void printStats() const
+    {
+        std::printf("Sprites: %u corner fan covering %.1f%% of the quad (alpha hull %.1f%%), %.2f units, soft over %.2f\n",
+                    hull.cornerCount, hull.area * 100.0f, hullArea * 100.0f, size, softDistance);
+    }
+
+private:
+    GLuint depthTexture;
+    GLint depthWidth, depthHeight;
+};
+#endif
@@ -0,0 +1,440 @@
+// Registry of particle emitters sharing one pool, updated in place by a single compute dispatch
+#ifndef PARTICLE_SYSTEM_H
+#define PARTICLE_SYSTEM_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "shader.h"
+#include "particles_cpu.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// Every emitter owns a contiguous slice [first, first + count) of one set of particle buffers and one entry of
+// the emitter table, a shader storage buffer with its update constants. shaders/particles_update.comp runs one
+// invocation per particle of the whole pool and finds the emitter of its particle with a binary search over
+// the slice offsets (shaders/particle_emitters.glsl). A second table holds the emitter of every 256th particle,
+// which narrows the search to the few emitters overlapping a block, so the cost of an update depends on the
+// particle count and not on how many emitters share it. The render pass draws the pool with one draw call the
+// same way.
+const GLuint PARTICLE_COMPUTE_WORKGROUP_SIZE = 256;
+const GLuint PARTICLE_EMITTERS_BINDING = 3; // after the position/velocity/start time buffers of the float format
+const GLuint PARTICLE_EMITTER_BLOCKS_BINDING = 4;
+const GLuint PARTICLE_EMITTER_BLOCK_SIZE = 256; // particles per entry of the block table
+
+// locations of the uniforms update() and draw() and their callers set in one program, -1 where it has none
+struct ParticleUniforms {
+    GLint ParticleCount = -1, Time = -1, H = -1, TimeWrap = -1, ParticleTexture = -1, MVP = -1, FirstParticle = -1;
+
+    ParticleUniforms() {}
+
+    explicit ParticleUniforms(const Shader& shader)
+        : ParticleCount(shader.uniform("ParticleCount")), Time(shader.uniform("Time")), H(shader.uniform("H")),
+          TimeWrap(shader.uniform("TimeWrap")), ParticleTexture(shader.uniform("ParticleTexture")), MVP(shader.uniform("MVP")),
+          FirstParticle(shader.uniform("FirstParticle"))
+    {
+    }
+};
+
+// storage of the particle attributes
+enum ParticleFormat {
+    PARTICLE_FORMAT_FLOAT, // one float buffer per attribute, 28 bytes per particle
+    PARTICLE_FORMAT_PACKED // one interleaved buffer of PackedParticle, 16 bytes per particle
+};
+
+// PARTICLE_FORMAT_PACKED record, read by shaders/particles_update_packed.comp as four uints and by the
+// render pass as normalized shorts / half floats. Positions are relative to the origin of their emitter and
+// divided by its extent, particles leaving that box are clamped to its faces. The start time is kept modulo
+// PARTICLE_PACKED_TIME_WRAP, the age Time - StartTime is recovered in [-wrap / 2, wrap / 2) without
+// accumulating rounding errors from frame to frame.
+struct PackedParticle {
+    GLuint positionXY; // snorm16 x, y
+    GLuint positionZStart; // snorm16 z, snorm16 start time phase
+    GLuint velocityXY; // half x, y
+    GLuint velocityZ; // half z, the high half is unused
+};
+const float PARTICLE_PACKED_TIME_WRAP = 16.0f; // seconds, twice the longest lifetime or start delay of the demo
+
+// start time -> snorm value of the packed phase, same as packStartTime() in particles_update_packed.comp
+inline float packedStartPhase(float startTime)
+{
+    float phase = startTime / PARTICLE_PACKED_TIME_WRAP;
+    return 2.0f * (phase - std::floor(phase + 0.5f));
+}
+
+// start time of a particle that has not started yet, folded into the window the packed phase can tell apart.
+// The demo seeds particle i at i * 1 ms, so an emitter of more than 8000 particles would have particles whose
+// start wraps to the past and that appear already started. Those are spread over the lifetime instead.
+inline float packedStartTime(float startTime, float lifetime)
+{
+    const float window = 0.5f * PARTICLE_PACKED_TIME_WRAP;
+    if (startTime < window)
+        return startTime;
+    return std::fmod(startTime, std::min(lifetime, window));
+}
+
+inline const char* particleFormatName(ParticleFormat format)
+{
+    return format == PARTICLE_FORMAT_PACKED ? "packed 16 bit" : "float";
+}
+
+// one entry of the emitter table, std430 layout of Emitter in shaders/particle_emitters.glsl
+struct EmitterBlock {
+    glm::vec4 respawnPosition; // w = particle lifetime
+    glm::vec4 accel; // w = half opening of the spawn cone
+    glm::vec4 keepOnRespawn; // 1.0 for the kept components, w = extent of the packed position box
+    glm::vec4 origin; // center of the packed position box
+    glm::vec2 spawnSpeed;
+    GLuint seed;
+    GLuint first; // first particle of the slice
+};
+
+class ParticleSystem
+{
+public:
+    ParticleFormat format;
+
+    explicit ParticleSystem(ParticleFormat format = PARTICLE_FORMAT_FLOAT)
+        : format(format), count(0), capacity(0), emitterCapacity(0), dirtyBegin(0), dirtyEnd(0), blocksDirty(false)
+    {
+        posBuf = velBuf = startTime = emitterBuf = blockBuf = 0;
+        glGenVertexArrays(1, &particleArray);
+        glGenVertexArrays(1, &spriteArray);
+    }
+
+    ~ParticleSystem()
+    {
+        GLuint buffers[] = { posBuf, velBuf, startTime, emitterBuf, blockBuf };
+        glDeleteBuffers(5, buffers);
+        glDeleteVertexArrays(1, &particleArray);
+        glDeleteVertexArrays(1, &spriteArray);
+    }
+
+    ParticleSystem(const ParticleSystem&) = delete;
+    ParticleSystem& operator=(const ParticleSystem&) = delete;
+
+    // appends an emitter and its particles to the pool and returns its index. positions/velocities are vec3 per
+    // particle and startTimes one float per particle, as filled for the TF buffers. Packed positions are stored
+    // relative to the box origin +- extent.
+    // ------------------------------------------------------------------------
+    GLuint addEmitter(const ParticleParams& params, const std::vector<float>& positions, const std::vector<float>& velocities,
+                      const std::vector<float>& startTimes, glm::vec3 origin = glm::vec3(0.0f), float extent = 8.0f)
+    {
+        GLuint emitter = (GLuint)emitters.size();
+        GLuint particles = (GLuint)startTimes.size();
+
+        EmitterBlock block;
+        block.first = count;
+        block.origin = glm::vec4(origin, 0.0f);
+        block.keepOnRespawn.w = extent;
+        emitters.push_back(block);
+        emitterCounts.push_back(particles);
+        setParams(emitter, params);
+        markDirty(emitter);
+
+        // geometric growth keeps adding many small emitters linear
+        if (count + particles > capacity)
+            reserve(std::max(count + particles, capacity * 2));
+        uploadParticles(count, particles, positions, velocities, startTimes, params.ParticleLifetime, origin, extent);
+        count += particles;
+        updateBlocks();
+        return emitter;
+    }
+
+    // new update constants for an emitter, uploaded with the next update() unless they are the ones it already has
+    // ------------------------------------------------------------------------
+    void setParams(GLuint emitter, const ParticleParams& params)
+    {
+        EmitterBlock block = emitters[emitter];
+        block.respawnPosition = glm::vec4(params.respawnPosition, params.ParticleLifetime);
+        block.accel = glm::vec4(params.Accel, params.spawnAngle);
+        block.keepOnRespawn = glm::vec4(glm::vec3(params.keepOnRespawn), block.keepOnRespawn.w);
+        block.spawnSpeed = params.spawnSpeed;
+        block.seed = params.seed;
+        if (std::memcmp(&block, &emitters[emitter], sizeof(EmitterBlock)) == 0)
+            return;
+        emitters[emitter] = block;
+        markDirty(emitter);
+    }
+
+    GLuint emitterCount() const { return (GLuint)emitters.size(); }
+    GLuint particleCount() const { return count; }
+    GLuint emitterParticleCount(GLuint emitter) const { return emitterCounts[emitter]; }
+
+    // GPU memory of the particle attributes
+    size_t memoryBytes() const
+    {
+        return (size_t)count * particleBytes();
+    }
+
+    // advances the particles of every emitter by H, one invocation per particle. updateShader is
+    // shaders/particles_update.comp for PARTICLE_FORMAT_FLOAT and particles_update_packed.comp otherwise
+    // ------------------------------------------------------------------------
+    void update(Shader& updateShader, const ParticleUniforms& uniforms, float Time, float H)
+    {
+        if (count == 0)
+            return;
+        uploadEmitters();
+
+        updateShader.use();
+        updateShader.setUInt(uniforms.ParticleCount, count);
+        updateShader.setFloat(uniforms.Time, Time);
+        updateShader.setFloat(uniforms.H, H);
+        if (format == PARTICLE_FORMAT_PACKED)
+            updateShader.setFloat(uniforms.TimeWrap, PARTICLE_PACKED_TIME_WRAP);
+
+        bindBuffers();
+        glDispatchCompute((count + PARTICLE_COMPUTE_WORKGROUP_SIZE - 1) / PARTICLE_COMPUTE_WORKGROUP_SIZE, 1, 1);
+
+        // the render pass fetches the results as vertex attributes, the next update loads them from the same
+        // storage buffers
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    }
+
+    // draws every emitter as points with one draw call, renderShader is shaders/particles.vert or
+    // particles_packed.vert and must be in use with its MVP and Time set
+    // ------------------------------------------------------------------------
+    void draw(Shader& renderShader, const ParticleUniforms& uniforms)
+    {
+        if (count == 0)
+            return;
+        uploadEmitters();
+
+        if (format == PARTICLE_FORMAT_PACKED)
+            renderShader.setFloat(uniforms.TimeWrap, PARTICLE_PACKED_TIME_WRAP);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLE_EMITTERS_BINDING, emitterBuf);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLE_EMITTER_BLOCKS_BINDING, blockBuf);
+
+        glBindVertexArray(particleArray);
+        glDrawArrays(GL_POINTS, 0, count);
+        glBindVertexArray(0);
+    }
+
+    // draws the emitters [firstEmitter, firstEmitter + drawnEmitters), by default all of them, as sprites (see
+    // particle_sprites.h) with one instanced draw call, one instance of corners vertices per particle. spriteShader is
+    // shaders/sprite_particles.vert or sprite_particles_packed.vert and must be in use with its sprite uniforms and
+    // Time set
+    // ------------------------------------------------------------------------
+    void drawSprites(Shader& spriteShader, const ParticleUniforms& uniforms, GLsizei corners, GLuint firstEmitter = 0,
+                     GLuint drawnEmitters = ~0u)
+    {
+        GLuint lastEmitter = (GLuint)std::min<size_t>((size_t)firstEmitter + drawnEmitters, emitters.size());
+        if (firstEmitter >= lastEmitter)
+            return;
+        GLuint first = emitters[firstEmitter].first;
+        GLuint particles = (lastEmitter < emitters.size() ? emitters[lastEmitter].first : count) - first;
+        if (particles == 0)
+            return;
+        uploadEmitters();
+
+        if (format == PARTICLE_FORMAT_PACKED)
+            spriteShader.setFloat(uniforms.TimeWrap, PARTICLE_PACKED_TIME_WRAP);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLE_EMITTERS_BINDING, emitterBuf);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLE_EMITTER_BLOCKS_BINDING, blockBuf);
+
+        // the base instance offsets the attributes, the shader adds FirstParticle to gl_InstanceID
+        spriteShader.setUInt(uniforms.FirstParticle, first);
+        glBindVertexArray(spriteArray);
+        glDrawArraysInstancedBaseInstance(GL_TRIANGLE_FAN, 0, corners, particles, first);
+        glBindVertexArray(0);
+    }
+
+private:
+    GLuint count; // particles of all emitters
+    GLuint capacity; // particles the buffers can hold
+    GLuint posBuf, velBuf, startTime; // PARTICLE_FORMAT_PACKED only uses posBuf
+    GLuint particleArray;
+    GLuint spriteArray; // the same attributes, advancing once per instance
+
+    std::vector<EmitterBlock> emitters;
+    std::vector<GLuint> emitterCounts;
+    GLuint emitterBuf;
+    GLuint emitterCapacity;
+    GLuint dirtyBegin, dirtyEnd; // emitters changed since the last upload
+    std::vector<GLuint> blockEmitters; // emitter of every PARTICLE_EMITTER_BLOCK_SIZE-th particle
+    GLuint blockBuf;
+    bool blocksDirty;
+
+    size_t particleBytes() const
+    {
+        return format == PARTICLE_FORMAT_PACKED ? sizeof(PackedParticle) : (3 + 3 + 1) * sizeof(float);
+    }
+
+    // grows the pool to newCapacity particles, keeping the particles already in it
+    // ------------------------------------------------------------------------
+    void reserve(GLuint newCapacity)
+    {
+        const int streams = format == PARTICLE_FORMAT_PACKED ? 1 : 3;
+        GLuint* buffers[] = { &posBuf, &velBuf, &startTime };
+        const size_t bytes[] = {
+            format == PARTICLE_FORMAT_PACKED ? sizeof(PackedParticle) : 3 * sizeof(float), 3 * sizeof(float), sizeof(float)
+        };
+
+        for (int i = 0; i < streams; i++)
+        {
+            GLuint grown;
+            glGenBuffers(1, &grown);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+            glBufferData(GL_COPY_WRITE_BUFFER, newCapacity * bytes[i], NULL, GL_DYNAMIC_COPY);
+            if (*buffers[i])
+            {
+                // the copy reads what the last update dispatch wrote
+                glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+                glBindBuffer(GL_COPY_READ_BUFFER, *buffers[i]);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, count * bytes[i]);
+                glDeleteBuffers(1, buffers[i]);
+            }
+            *buffers[i] = grown;
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        capacity = newCapacity;
+        setupVertexArray(particleArray, 0);
+        setupVertexArray(spriteArray, 1);
+    }
+
+    // the attribute locations of the render shaders, the start phase of the packed format takes
+    // the place of the start time
+    // ------------------------------------------------------------------------
+    void setupVertexArray(GLuint array, GLuint divisor)
+    {
+        glBindVertexArray(array);
+        if (format == PARTICLE_FORMAT_PACKED)
+        {
+            const GLsizei stride = sizeof(PackedParticle);
+            glBindBuffer(GL_ARRAY_BUFFER, posBuf);
+            glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, stride, (void*)0);
+            glVertexAttribPointer(1, 3, GL_HALF_FLOAT, GL_FALSE, stride, (void*)(2 * sizeof(GLuint)));
+            glVertexAttribPointer(2, 1, GL_SHORT, GL_TRUE, stride, (void*)(sizeof(GLuint) + sizeof(GLshort)));
+        }
+        else
+        {
+            GLuint buffers[] = { posBuf, velBuf, startTime };
+            const GLint components[] = { 3, 3, 1 };
+            for (GLuint i = 0; i < 3; i++)
+            {
+                glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+                glVertexAttribPointer(i, components[i], GL_FLOAT, GL_FALSE, 0, NULL);
+            }
+        }
+        for (GLuint i = 0; i < 3; i++)
+        {
+            glEnableVertexAttribArray(i);
+            glVertexAttribDivisor(i, divisor);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void uploadParticles(GLuint first, GLuint particles, const std::vector<float>& positions, const std::vector<float>& velocities,
+                         const std::vector<float>& startTimes, float lifetime, glm::vec3 origin, float extent)
+    {
+        if (format == PARTICLE_FORMAT_FLOAT)
+        {
+            GLuint buffers[] = { posBuf, velBuf, startTime };
+            const std::vector<float>* data[] = { &positions, &velocities, &startTimes };
+            const GLuint components[] = { 3, 3, 1 };
+            for (int i = 0; i < 3; i++)
+            {
+                glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+                glBufferSubData(GL_ARRAY_BUFFER, first * components[i] * sizeof(float), particles * components[i] * sizeof(float), data[i]->data());
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            return;
+        }
+
+        std::vector<PackedParticle> packed(particles);
+        for (GLuint i = 0; i < particles; i++)
+        {
+            glm::vec3 p = (glm::vec3(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]) - origin) / extent;
+            glm::vec3 v(velocities[i * 3], velocities[i * 3 + 1], velocities[i * 3 + 2]);
+
+            packed[i].positionXY = glm::packSnorm2x16(glm::vec2(p.x, p.y));
+            packed[i].positionZStart = glm::packSnorm2x16(glm::vec2(p.z, packedStartPhase(packedStartTime(startTimes[i], lifetime))));
+            packed[i].velocityXY = glm::packHalf2x16(glm::vec2(v.x, v.y));
+            packed[i].velocityZ = glm::packHalf2x16(glm::vec2(v.z, 0.0f));
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, posBuf);
+        glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(PackedParticle), particles * sizeof(PackedParticle), packed.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // rebuilds the block table after the slices changed, one entry per block plus one past the end
+    // ------------------------------------------------------------------------
+    void updateBlocks()
+    {
+        GLuint blocks = (count + PARTICLE_EMITTER_BLOCK_SIZE - 1) / PARTICLE_EMITTER_BLOCK_SIZE;
+        blockEmitters.resize(blocks + 1);
+        GLuint emitter = 0;
+        for (GLuint b = 0; b < blocks; b++)
+        {
+            GLuint first = b * PARTICLE_EMITTER_BLOCK_SIZE;
+            while (emitter + 1 < emitters.size() && emitters[emitter + 1].first <= first)
+                emitter++;
+            blockEmitters[b] = emitter;
+        }
+        blockEmitters[blocks] = (GLuint)emitters.size() - 1;
+        blocksDirty = true;
+    }
+
+    void markDirty(GLuint emitter)
+    {
+        dirtyBegin = dirtyBegin == dirtyEnd ? emitter : std::min(dirtyBegin, emitter);
+        dirtyEnd = std::max(dirtyEnd, emitter + 1);
+    }
+
+    // sends the emitters changed by setParams()/addEmitter() to the emitter table and the block table if the
+    // slices changed. Buffer uploads are ordered before later shader reads without a memory barrier.
+    // ------------------------------------------------------------------------
+    void uploadEmitters()
+    {
+        if (blocksDirty)
+        {
+            if (!blockBuf)
+                glGenBuffers(1, &blockBuf);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, blockBuf);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, blockEmitters.size() * sizeof(GLuint), blockEmitters.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            blocksDirty = false;
+        }
+        if (dirtyBegin != dirtyEnd)
+            uploadEmitterTable();
+    }
+
+    void uploadEmitterTable()
+    {
+        if (emitterCapacity < emitters.size())
+        {
+            if (!emitterBuf)
+                glGenBuffers(1, &emitterBuf);
+            emitterCapacity = std::max((GLuint)emitters.size(), emitterCapacity * 2);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, emitterBuf);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, emitterCapacity * sizeof(EmitterBlock), NULL, GL_DYNAMIC_DRAW);
+            dirtyBegin = 0;
+            dirtyEnd = (GLuint)emitters.size();
+        }
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, emitterBuf);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, dirtyBegin * sizeof(EmitterBlock), (dirtyEnd - dirtyBegin) * sizeof(EmitterBlock),
+                        &emitters[dirtyBegin]);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        dirtyBegin = dirtyEnd = 0;
+    }
+
+    void bindBuffers()
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, posBuf);
+        if (format == PARTICLE_FORMAT_FLOAT)
+        {
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, velBuf);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, startTime);
+        }
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLE_EMITTERS_BINDING, emitterBuf);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLE_EMITTER_BLOCKS_BINDING, blockBuf);
+    }
+};
+#endif
@@ -0,0 +1,234 @@
+// Reduced resolution offscreen target for particles, composited back over the full resolution frame
+#ifndef PARTICLE_TARGET_H
+#define PARTICLE_TARGET_H
+
+#include <glad/glad.h>
+
+#include "shader.h"
+#include "particle_sprites.h"
+
+#include <cstdio>
+#include <iostream>
+
+// Large blended sprites are bound by fill rate, and drawing them at half resolution blends a quarter of the
+// fragments (a sixteenth at quarter resolution). A ParticleTarget of divisor d holds a color buffer of 1/d of the
+// viewport in each direction and a depth buffer downsampled from the scene:
+//
+//   begin()      downsamples the scene depth to the farthest depth of every d x d block
+//                (shaders/depth_downsample.frag), clears the color and binds the target. Sprites drawn until end()
+//                are depth tested against the downsampled depth and blend into the target as premultiplied color
+//                plus coverage, so the result can be laid over the frame later in one pass.
+//   composite()  blends the target over the frame (shaders/particle_composite.frag) with a nearest-depth
+//                upsample: where the four target texels around a pixel lie at the depth of the pixel in the scene
+//                they are filtered bilinearly, at depth edges the texel of the closest depth is taken, so the
+//                particles of a low resolution block do not bleed over geometry in front of them.
+//
+// The sprites fade against the full resolution scene depth in both cases, scaled by DepthScale in sprite.frag.
+const GLuint PARTICLE_TARGET_COLOR_UNIT = 3; // after the particle texture, the skybox and the scene depth
+const GLuint PARTICLE_TARGET_DEPTH_UNIT = 4;
+
+// resolution divisor of the particles of an emitter
+enum ParticleResolution {
+    PARTICLE_RESOLUTION_FULL = 1, // drawn straight into the frame
+    PARTICLE_RESOLUTION_HALF = 2,
+    PARTICLE_RESOLUTION_QUARTER = 4
+};
+
+inline ParticleResolution particleResolution(unsigned int divisor)
+{
+    return divisor == 4 ? PARTICLE_RESOLUTION_QUARTER : divisor == 2 ? PARTICLE_RESOLUTION_HALF : PARTICLE_RESOLUTION_FULL;
+}
+
+inline const char* particleResolutionName(ParticleResolution resolution)
+{
+    return resolution == PARTICLE_RESOLUTION_QUARTER ? "quarter" : resolution == PARTICLE_RESOLUTION_HALF ? "half" : "full";
+}
+
+// the programs every target shares: shaders/fullscreen.vert with depth_downsample.frag and particle_composite.frag,
+// and the locations of their uniforms
+struct ParticleTargetPrograms {
+    Shader* downsample = nullptr;
+    Shader* composite = nullptr;
+    GLint downsampleSceneDepth = -1, downsampleDivisor = -1;
+    GLint compositeColor = -1, compositeDepth = -1, compositeSceneDepth = -1, compositeDivisor = -1;
+    GLint compositeDepthRange = -1, compositeDepthTolerance = -1;
+
+    ParticleTargetPrograms() {}
+
+    ParticleTargetPrograms(Shader& downsampleShader, Shader& compositeShader)
+        : downsample(&downsampleShader), composite(&compositeShader),
+          downsampleSceneDepth(downsampleShader.uniform("SceneDepth")), downsampleDivisor(downsampleShader.uniform("Divisor")),
+          compositeColor(compositeShader.uniform("ParticleColor")), compositeDepth(compositeShader.uniform("ParticleDepth")),
+          compositeSceneDepth(compositeShader.uniform("SceneDepth")), compositeDivisor(compositeShader.uniform("Divisor")),
+          compositeDepthRange(compositeShader.uniform("DepthRange")), compositeDepthTolerance(compositeShader.uniform("DepthTolerance"))
+    {
+    }
+};
+
+class ParticleTarget
+{
+public:
+    float depthTolerance = 0.05f; // relative difference in distance beyond which the upsample treats texels as another surface
+
+    explicit ParticleTarget(ParticleResolution resolution)
+        : divisor(resolution), width(0), height(0), framebuffer(0), colorTexture(0), depthTexture(0), emptyVAO(0),
+          previousFramebuffer(0), drawn(false), frames(0)
+    {
+        glGenVertexArrays(1, &emptyVAO);
+    }
+
+    ~ParticleTarget()
+    {
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteTextures(1, &colorTexture);
+        glDeleteTextures(1, &depthTexture);
+        glDeleteVertexArrays(1, &emptyVAO);
+    }
+
+    ParticleTarget(const ParticleTarget&) = delete;
+    ParticleTarget& operator=(const ParticleTarget&) = delete;
+
+    ParticleResolution resolution() const { return divisor; }
+
+    // downsamples sceneDepth, a copy of the depth buffer of the viewport, clears the target and draws into it until
+    // end(). Leaves the downsample program in use
+    // ------------------------------------------------------------------------
+    void begin(const ParticleTargetPrograms& programs, GLuint sceneDepth)
+    {
+        glGetIntegerv(GL_VIEWPORT, previousViewport);
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        resize((previousViewport[2] + divisor - 1) / divisor, (previousViewport[3] + divisor - 1) / divisor);
+
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+
+        // the farthest depth of every block, written through gl_FragDepth
+        programs.downsample->use();
+        programs.downsample->setSampler2D(programs.downsampleSceneDepth, SPRITE_SCENE_DEPTH_UNIT);
+        programs.downsample->setInt(programs.downsampleDivisor, divisor);
+        glActiveTexture(GL_TEXTURE0 + SPRITE_SCENE_DEPTH_UNIT);
+        glBindTexture(GL_TEXTURE_2D, sceneDepth);
+        glActiveTexture(GL_TEXTURE0);
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_ALWAYS);
+        glDepthMask(GL_TRUE);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+        // sprites are tested against it without writing depth, color accumulates premultiplied with its coverage
+        const GLfloat clear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        glClearBufferfv(GL_COLOR, 0, clear);
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_FALSE);
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        drawn = true;
+    }
+
+    // back to the framebuffer and viewport begin() found
+    // ------------------------------------------------------------------------
+    void end()
+    {
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDisable(GL_DEPTH_TEST);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousFramebuffer);
+        glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    }
+
+    // blends what was drawn since the last composite over the current framebuffer, sceneDepth is the depth copy
+    // begin() was given. nearPlane and farPlane are those of the projection it was drawn with
+    // ------------------------------------------------------------------------
+    void composite(const ParticleTargetPrograms& programs, GLuint sceneDepth, float nearPlane, float farPlane)
+    {
+        if (!drawn)
+            return;
+        drawn = false;
+        frames++;
+
+        Shader& shader = *programs.composite;
+        shader.use();
+        shader.setSampler2D(programs.compositeColor, PARTICLE_TARGET_COLOR_UNIT);
+        shader.setSampler2D(programs.compositeDepth, PARTICLE_TARGET_DEPTH_UNIT);
+        shader.setSampler2D(programs.compositeSceneDepth, SPRITE_SCENE_DEPTH_UNIT);
+        shader.setFloat(programs.compositeDivisor, (float)divisor);
+        shader.setVec2(programs.compositeDepthRange, nearPlane, farPlane);
+        shader.setFloat(programs.compositeDepthTolerance, depthTolerance);
+        glActiveTexture(GL_TEXTURE0 + PARTICLE_TARGET_COLOR_UNIT);
+        glBindTexture(GL_TEXTURE_2D, colorTexture);
+        glActiveTexture(GL_TEXTURE0 + PARTICLE_TARGET_DEPTH_UNIT);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glActiveTexture(GL_TEXTURE0 + SPRITE_SCENE_DEPTH_UNIT);
+        glBindTexture(GL_TEXTURE_2D, sceneDepth);
+        glActiveTexture(GL_TEXTURE0);
+
+        // the target holds premultiplied color
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+
+    void printStats() const
+    {
+        if (frames > 0)
+            std::printf("Particle target 1/%d: %dx%d, composited %d frames\n", (int)divisor, width, height, frames);
+    }
+
+private:
+    ParticleResolution divisor;
+    GLint width, height;
+    GLuint framebuffer;
+    GLuint colorTexture; // RGBA16F, premultiplied color and coverage
+    GLuint depthTexture; // downsampled scene depth
+    GLuint emptyVAO; // the full screen triangle is made from gl_VertexID
+    GLint previousViewport[4];
+    GLint previousFramebuffer;
+    bool drawn; // since the last composite
+    int frames; // composited so far
+
+    // (re)allocates the buffers for a new size of the viewport
+    void resize(GLint targetWidth, GLint targetHeight)
+    {
+        if (framebuffer && targetWidth == width && targetHeight == height)
+            return;
+        width = targetWidth;
+        height = targetHeight;
+        if (!framebuffer)
+        {
+            glGenFramebuffers(1, &framebuffer);
+            glGenTextures(1, &colorTexture);
+            glGenTextures(1, &depthTexture);
+        }
+
+        // bound where composite() reads them, unit 0 keeps the particle texture
+        glActiveTexture(GL_TEXTURE0 + PARTICLE_TARGET_COLOR_UNIT);
+        glBindTexture(GL_TEXTURE_2D, colorTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glActiveTexture(GL_TEXTURE0 + PARTICLE_TARGET_DEPTH_UNIT);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glActiveTexture(GL_TEXTURE0);
+
+        GLint bound = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &bound);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::PARTICLE_TARGET::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, bound);
+    }
+};
+#endif
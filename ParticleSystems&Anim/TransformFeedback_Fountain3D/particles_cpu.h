@@ -0,0 +1,408 @@
+// CPU mirror of the update() subroutine in shaders/TF_fountain.vert and shaders/fire.vert
+#ifndef PARTICLES_CPU_H
+#define PARTICLES_CPU_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <utility>
+
+#include "counter_rng.h"
+#include "thread_pool.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PARTICLES_CPU_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define PARTICLES_CPU_TARGET_AVX2
+#else
+#define PARTICLES_CPU_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// Particle attributes are stored as a structure of arrays: one 64-byte aligned float array per component.
+// The arrays are padded to a multiple of PARTICLE_CPU_LANES, padding particles get an infinite start time
+// so they never spawn, which lets every kernel run over whole cache lines without a remainder loop.
+const unsigned int PARTICLE_CPU_ALIGNMENT = 64;
+const unsigned int PARTICLE_CPU_LANES = PARTICLE_CPU_ALIGNMENT / sizeof(float);
+// particles per work item of the threaded update, a multiple of PARTICLE_CPU_LANES so no two chunks share a cache line
+// (4096 particles = 16 KB per array, the seven arrays of a chunk stay within L2)
+const unsigned int PARTICLE_CPU_CHUNK = 4096;
+
+enum ParticleKernel {
+    PARTICLE_KERNEL_SCALAR,
+    PARTICLE_KERNEL_SSE,
+    PARTICLE_KERNEL_AVX2
+};
+
+inline const char* particleKernelName(ParticleKernel kernel)
+{
+    switch (kernel)
+    {
+    case PARTICLE_KERNEL_SSE: return "SSE";
+    case PARTICLE_KERNEL_AVX2: return "AVX2";
+    default: return "scalar";
+    }
+}
+
+// widest kernel supported by the CPU we are running on
+inline ParticleKernel detectParticleKernel()
+{
+#if defined(PARTICLES_CPU_X86)
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7)
+    {
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        __cpuidex(info, 7, 0);
+        bool avx2 = (info[1] & (1 << 5)) != 0;
+        if (osxsave && avx && avx2 && (_xgetbv(0) & 0x6) == 0x6)
+            return PARTICLE_KERNEL_AVX2;
+    }
+    return PARTICLE_KERNEL_SSE;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return PARTICLE_KERNEL_AVX2;
+    return PARTICLE_KERNEL_SSE;
+#endif
+#else
+    return PARTICLE_KERNEL_SCALAR;
+#endif
+}
+
+// emitter constants, the same values main.cpp sends as uniforms to the update pass
+struct ParticleParams {
+    float Time = 0.0f; // animation time
+    float H = 0.0f; // elapsed time between frames
+    float ParticleLifetime = 3.5f;
+    glm::vec3 Accel = glm::vec3(0.0f, -0.6f, 0.0f);
+    // where a recycled particle is placed; components flagged in keepOnRespawn keep their current value
+    // fountain: (5, 0, 0) and nothing kept, fire: (x, 0, 0) with x kept
+    glm::vec3 respawnPosition = glm::vec3(0.0f);
+    glm::bvec3 keepOnRespawn = glm::bvec3(false);
+    // velocity of a recycled particle, drawn by rngSpawnVelocity() from (particle index, bits of Time)
+    glm::uint seed = 0;
+    float spawnAngle = 0.0f; // half opening of the cone around +y in radians
+    glm::vec2 spawnSpeed = glm::vec2(0.0f); // min, max
+};
+
+// velocity of particle i recycled at params.Time, same numbers as the update shaders draw
+inline glm::vec3 respawnVelocity(const ParticleParams& params, unsigned int i)
+{
+    return rngSpawnVelocity(params.seed, i, rngTimeGeneration(params.Time), params.spawnAngle, params.spawnSpeed);
+}
+
+class CpuParticleSystem
+{
+public:
+    float* px; float* py; float* pz; // position
+    float* vx; float* vy; float* vz; // velocity
+    float* startTime;
+
+    CpuParticleSystem() : count(0), capacity(0), storage(nullptr)
+    {
+        assignArrays();
+    }
+
+    explicit CpuParticleSystem(unsigned int particleCount) : CpuParticleSystem()
+    {
+        resize(particleCount);
+    }
+
+    ~CpuParticleSystem()
+    {
+        freeStorage(storage);
+    }
+
+    CpuParticleSystem(const CpuParticleSystem&) = delete;
+    CpuParticleSystem& operator=(const CpuParticleSystem&) = delete;
+
+    unsigned int size() const { return count; }
+    unsigned int paddedSize() const { return capacity; }
+
+    // (re)allocates the arrays, all particles start at the origin and never spawn until load() is called.
+    // With a pool the pages are first touched by the threads that will update them later on.
+    // ------------------------------------------------------------------------
+    void resize(unsigned int particleCount, WorkStealingPool* pool = nullptr)
+    {
+        freeStorage(storage);
+        count = particleCount;
+        capacity = (particleCount + PARTICLE_CPU_LANES - 1) / PARTICLE_CPU_LANES * PARTICLE_CPU_LANES;
+        storage = allocStorage((size_t)capacity * STREAM_COUNT);
+        assignArrays();
+
+        auto clear = [this](unsigned int begin, unsigned int end) {
+            float** streams[STREAM_COUNT] = { &px, &py, &pz, &vx, &vy, &vz, &startTime };
+            for (unsigned int s = 0; s < STREAM_COUNT; s++)
+                std::memset(*streams[s] + begin, 0, (end - begin) * sizeof(float));
+            for (unsigned int i = begin; i < end; i++)
+                startTime[i] = std::numeric_limits<float>::infinity();
+        };
+        if (pool)
+            pool->parallelFor(capacity, PARTICLE_CPU_CHUNK, clear);
+        else
+            clear(0, capacity);
+    }
+
+    // fills the arrays from the tightly packed vec3/float layout used by the GL buffers (posBuf, velBuf, startTime)
+    // ------------------------------------------------------------------------
+    void load(const float* positions, const float* velocities, const float* startTimes)
+    {
+        for (unsigned int i = 0; i < count; i++)
+        {
+            px[i] = positions[i * 3]; py[i] = positions[i * 3 + 1]; pz[i] = positions[i * 3 + 2];
+            vx[i] = velocities[i * 3]; vy[i] = velocities[i * 3 + 1]; vz[i] = velocities[i * 3 + 2];
+            startTime[i] = startTimes[i];
+        }
+    }
+
+    // writes positions and velocities back in the vec3 layout of posBuf/velBuf
+    // ------------------------------------------------------------------------
+    void store(float* positions, float* velocities) const
+    {
+        for (unsigned int i = 0; i < count; i++)
+        {
+            positions[i * 3] = px[i]; positions[i * 3 + 1] = py[i]; positions[i * 3 + 2] = pz[i];
+            velocities[i * 3] = vx[i]; velocities[i * 3 + 1] = vy[i]; velocities[i * 3 + 2] = vz[i];
+        }
+    }
+
+    // largest absolute difference against a readback of posBuf/velBuf (glGetBufferSubData)
+    // ------------------------------------------------------------------------
+    float maxDeviation(const float* positions, const float* velocities) const
+    {
+        float deviation = 0.0f;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            deviation = std::fmax(deviation, std::fabs(positions[i * 3] - px[i]));
+            deviation = std::fmax(deviation, std::fabs(positions[i * 3 + 1] - py[i]));
+            deviation = std::fmax(deviation, std::fabs(positions[i * 3 + 2] - pz[i]));
+            deviation = std::fmax(deviation, std::fabs(velocities[i * 3] - vx[i]));
+            deviation = std::fmax(deviation, std::fabs(velocities[i * 3 + 1] - vy[i]));
+            deviation = std::fmax(deviation, std::fabs(velocities[i * 3 + 2] - vz[i]));
+        }
+        return deviation;
+    }
+
+    // advances every particle by one step of params.H
+    // ------------------------------------------------------------------------
+    void update(const ParticleParams& params, ParticleKernel kernel)
+    {
+        updateRange(params, kernel, 0, capacity);
+    }
+
+    // same as update() with the arrays split into PARTICLE_CPU_CHUNK sized pieces spread over the pool
+    // ------------------------------------------------------------------------
+    void update(const ParticleParams& params, ParticleKernel kernel, WorkStealingPool& pool)
+    {
+        pool.parallelFor(capacity, PARTICLE_CPU_CHUNK, [this, &params, kernel](unsigned int begin, unsigned int end) {
+            updateRange(params, kernel, begin, end);
+        });
+    }
+
+    // advances the particles in [begin, end), both bounds must be multiples of PARTICLE_CPU_LANES
+    // ------------------------------------------------------------------------
+    void updateRange(const ParticleParams& params, ParticleKernel kernel, unsigned int begin, unsigned int end)
+    {
+        switch (kernel)
+        {
+#if defined(PARTICLES_CPU_X86)
+        case PARTICLE_KERNEL_AVX2: updateAVX2(params, begin, end); break;
+        case PARTICLE_KERNEL_SSE: updateSSE(params, begin, end); break;
+#endif
+        default: updateScalar(params, begin, end); break;
+        }
+    }
+
+private:
+    static const unsigned int STREAM_COUNT = 7;
+
+    unsigned int count;
+    unsigned int capacity;
+    float* storage;
+
+    void assignArrays()
+    {
+        float** streams[STREAM_COUNT] = { &px, &py, &pz, &vx, &vy, &vz, &startTime };
+        for (unsigned int s = 0; s < STREAM_COUNT; s++)
+            *streams[s] = storage ? storage + (size_t)s * capacity : nullptr;
+    }
+
+    static float* allocStorage(size_t floats)
+    {
+        if (floats == 0)
+            return nullptr;
+        // over-allocate and stash the original pointer in front of the aligned block
+        void* raw = std::malloc(floats * sizeof(float) + PARTICLE_CPU_ALIGNMENT + sizeof(void*));
+        if (!raw)
+            throw std::bad_alloc();
+        size_t address = reinterpret_cast<size_t>(raw) + sizeof(void*);
+        address = (address + PARTICLE_CPU_ALIGNMENT - 1) & ~(size_t)(PARTICLE_CPU_ALIGNMENT - 1);
+        reinterpret_cast<void**>(address)[-1] = raw;
+        return reinterpret_cast<float*>(address);
+    }
+
+    static void freeStorage(float* block)
+    {
+        if (block)
+            std::free(reinterpret_cast<void**>(block)[-1]);
+    }
+
+    // reference implementation, a line by line port of update() in the vertex shaders
+    // ------------------------------------------------------------------------
+    void updateScalar(const ParticleParams& p, unsigned int begin, unsigned int end)
+    {
+        for (unsigned int i = begin; i < end; i++)
+        {
+            //Particle doesn't exist until the start Time
+            if (!(p.Time >= startTime[i]))
+                continue;
+
+            float t = p.Time - startTime[i]; //Time since start (age)
+            if (t > p.ParticleLifetime) {
+                //Particle is dead, recycle
+                px[i] = p.keepOnRespawn.x ? px[i] : p.respawnPosition.x;
+                py[i] = p.keepOnRespawn.y ? py[i] : p.respawnPosition.y;
+                pz[i] = p.keepOnRespawn.z ? pz[i] : p.respawnPosition.z;
+                glm::vec3 velocity = respawnVelocity(p, i);
+                vx[i] = velocity.x;
+                vy[i] = velocity.y;
+                vz[i] = velocity.z;
+                startTime[i] = p.Time;
+            } else {
+                //Particle is alive
+                px[i] += vx[i] * p.H;
+                py[i] += vy[i] * p.H;
+                pz[i] += vz[i] * p.H;
+                vx[i] += p.Accel.x * p.H;
+                vy[i] += p.Accel.y * p.H;
+                vz[i] += p.Accel.z * p.H;
+            }
+        }
+    }
+
+#if defined(PARTICLES_CPU_X86)
+    // the SIMD kernels compute both branches and blend them with the alive/dead masks,
+    // mul and add are kept separate (no FMA) so the results match the scalar loop bit for bit.
+    // Respawns are rare (one per lifetime), their random velocities are drawn lane by lane afterwards.
+    // ------------------------------------------------------------------------
+    void updateSSE(const ParticleParams& p, unsigned int begin, unsigned int end)
+    {
+        const __m128 time = _mm_set1_ps(p.Time);
+        const __m128 h = _mm_set1_ps(p.H);
+        const __m128 lifetime = _mm_set1_ps(p.ParticleLifetime);
+        const __m128 dvx = _mm_mul_ps(_mm_set1_ps(p.Accel.x), h);
+        const __m128 dvy = _mm_mul_ps(_mm_set1_ps(p.Accel.y), h);
+        const __m128 dvz = _mm_mul_ps(_mm_set1_ps(p.Accel.z), h);
+        const __m128 rx = _mm_set1_ps(p.respawnPosition.x);
+        const __m128 ry = _mm_set1_ps(p.respawnPosition.y);
+        const __m128 rz = _mm_set1_ps(p.respawnPosition.z);
+        const __m128 keepX = _mm_castsi128_ps(_mm_set1_epi32(p.keepOnRespawn.x ? -1 : 0));
+        const __m128 keepY = _mm_castsi128_ps(_mm_set1_epi32(p.keepOnRespawn.y ? -1 : 0));
+        const __m128 keepZ = _mm_castsi128_ps(_mm_set1_epi32(p.keepOnRespawn.z ? -1 : 0));
+
+        for (unsigned int i = begin; i < end; i += 4)
+        {
+            __m128 start = _mm_load_ps(startTime + i);
+            __m128 started = _mm_cmpge_ps(time, start);
+            __m128 dead = _mm_and_ps(started, _mm_cmpgt_ps(_mm_sub_ps(time, start), lifetime));
+            __m128 alive = _mm_andnot_ps(dead, started);
+
+            __m128 x = _mm_load_ps(px + i), y = _mm_load_ps(py + i), z = _mm_load_ps(pz + i);
+            __m128 u = _mm_load_ps(vx + i), v = _mm_load_ps(vy + i), w = _mm_load_ps(vz + i);
+
+            // alive: integrate, dead: respawn, not started: keep
+            x = selectSSE(alive, _mm_add_ps(x, _mm_mul_ps(u, h)), x);
+            y = selectSSE(alive, _mm_add_ps(y, _mm_mul_ps(v, h)), y);
+            z = selectSSE(alive, _mm_add_ps(z, _mm_mul_ps(w, h)), z);
+            x = selectSSE(_mm_andnot_ps(keepX, dead), rx, x);
+            y = selectSSE(_mm_andnot_ps(keepY, dead), ry, y);
+            z = selectSSE(_mm_andnot_ps(keepZ, dead), rz, z);
+
+            u = selectSSE(alive, _mm_add_ps(u, dvx), u);
+            v = selectSSE(alive, _mm_add_ps(v, dvy), v);
+            w = selectSSE(alive, _mm_add_ps(w, dvz), w);
+
+            _mm_store_ps(px + i, x); _mm_store_ps(py + i, y); _mm_store_ps(pz + i, z);
+            _mm_store_ps(vx + i, u); _mm_store_ps(vy + i, v); _mm_store_ps(vz + i, w);
+            _mm_store_ps(startTime + i, selectSSE(dead, time, start));
+            respawnVelocities(p, i, _mm_movemask_ps(dead));
+        }
+    }
+
+    static __m128 selectSSE(__m128 mask, __m128 a, __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    // new velocities for the lanes of first set in the dead mask
+    void respawnVelocities(const ParticleParams& p, unsigned int first, int deadMask)
+    {
+        for (unsigned int lane = 0; deadMask != 0; lane++, deadMask >>= 1)
+        {
+            if ((deadMask & 1) == 0)
+                continue;
+            glm::vec3 velocity = respawnVelocity(p, first + lane);
+            vx[first + lane] = velocity.x;
+            vy[first + lane] = velocity.y;
+            vz[first + lane] = velocity.z;
+        }
+    }
+
+    PARTICLES_CPU_TARGET_AVX2
+    void updateAVX2(const ParticleParams& p, unsigned int begin, unsigned int end)
+    {
+        const __m256 time = _mm256_set1_ps(p.Time);
+        const __m256 h = _mm256_set1_ps(p.H);
+        const __m256 lifetime = _mm256_set1_ps(p.ParticleLifetime);
+        const __m256 dvx = _mm256_mul_ps(_mm256_set1_ps(p.Accel.x), h);
+        const __m256 dvy = _mm256_mul_ps(_mm256_set1_ps(p.Accel.y), h);
+        const __m256 dvz = _mm256_mul_ps(_mm256_set1_ps(p.Accel.z), h);
+        const __m256 rx = _mm256_set1_ps(p.respawnPosition.x);
+        const __m256 ry = _mm256_set1_ps(p.respawnPosition.y);
+        const __m256 rz = _mm256_set1_ps(p.respawnPosition.z);
+        const __m256 keepX = _mm256_castsi256_ps(_mm256_set1_epi32(p.keepOnRespawn.x ? -1 : 0));
+        const __m256 keepY = _mm256_castsi256_ps(_mm256_set1_epi32(p.keepOnRespawn.y ? -1 : 0));
+        const __m256 keepZ = _mm256_castsi256_ps(_mm256_set1_epi32(p.keepOnRespawn.z ? -1 : 0));
+
+        for (unsigned int i = begin; i < end; i += 8)
+        {
+            __m256 start = _mm256_load_ps(startTime + i);
+            __m256 started = _mm256_cmp_ps(time, start, _CMP_GE_OQ);
+            __m256 dead = _mm256_and_ps(started, _mm256_cmp_ps(_mm256_sub_ps(time, start), lifetime, _CMP_GT_OQ));
+            __m256 alive = _mm256_andnot_ps(dead, started);
+
+            __m256 x = _mm256_load_ps(px + i), y = _mm256_load_ps(py + i), z = _mm256_load_ps(pz + i);
+            __m256 u = _mm256_load_ps(vx + i), v = _mm256_load_ps(vy + i), w = _mm256_load_ps(vz + i);
+
+            // alive: integrate, dead: respawn, not started: keep
+            x = _mm256_blendv_ps(x, _mm256_add_ps(x, _mm256_mul_ps(u, h)), alive);
+            y = _mm256_blendv_ps(y, _mm256_add_ps(y, _mm256_mul_ps(v, h)), alive);
+            z = _mm256_blendv_ps(z, _mm256_add_ps(z, _mm256_mul_ps(w, h)), alive);
+            x = _mm256_blendv_ps(x, rx, _mm256_andnot_ps(keepX, dead));
+            y = _mm256_blendv_ps(y, ry, _mm256_andnot_ps(keepY, dead));
+            z = _mm256_blendv_ps(z, rz, _mm256_andnot_ps(keepZ, dead));
+
+            u = _mm256_blendv_ps(u, _mm256_add_ps(u, dvx), alive);
+            v = _mm256_blendv_ps(v, _mm256_add_ps(v, dvy), alive);
+            w = _mm256_blendv_ps(w, _mm256_add_ps(w, dvz), alive);
+
+            _mm256_store_ps(px + i, x); _mm256_store_ps(py + i, y); _mm256_store_ps(pz + i, z);
+            _mm256_store_ps(vx + i, u); _mm256_store_ps(vy + i, v); _mm256_store_ps(vz + i, w);
+            _mm256_store_ps(startTime + i, _mm256_blendv_ps(start, time, dead));
+            respawnVelocities(p, i, _mm256_movemask_ps(dead));
+        }
+    }
+#endif
+};
+#endif
@@ -0,0 +1,210 @@
+// CPU scope profiler with Chrome trace event export
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <iostream>
+#include <string>
+
+// PROFILE_ZONE("name") times the rest of the enclosing scope, PROFILE_FUNCTION() names the zone after the
+// function. Zone names must be string literals, only the pointer is stored. Every thread records into its own
+// ring buffer of the last PROFILER_RING_SIZE zones, without locks: a zone costs two time stamp reads and one
+// 24 byte store. profilerWriteChromeTrace() writes all rings as Chrome trace event JSON (chrome://tracing,
+// ui.perfetto.dev), call it while the recording threads are idle.
+//
+// Build with -DPROFILER_ENABLED=0 and the macros expand to nothing.
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+#if PROFILER_ENABLED
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define PROFILER_RDTSC
+#endif
+
+// time stamp counter where available, converted to microseconds on export against steady_clock
+inline uint64_t profilerTicks()
+{
+#if defined(PROFILER_RDTSC)
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct ProfileEvent {
+    const char* name;
+    uint64_t start, end; // ticks
+};
+
+const uint32_t PROFILER_RING_SIZE = 1 << 16; // zones kept per thread, the oldest are overwritten
+
+struct ProfilerThread {
+    ProfileEvent events[PROFILER_RING_SIZE];
+    std::atomic<uint64_t> written; // zones recorded so far, published after the event is stored
+    uint32_t id;
+    std::string name;
+};
+
+class Profiler
+{
+public:
+    static Profiler& instance()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    // called once per thread by profilerThread(), the rings outlive their threads so they can still be exported
+    // ------------------------------------------------------------------------
+    ProfilerThread* registerThread()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        threads.emplace_back(new ProfilerThread());
+        ProfilerThread* thread = threads.back().get();
+        thread->written.store(0);
+        thread->id = (uint32_t)threads.size();
+        thread->name = "thread " + std::to_string(thread->id);
+        return thread;
+    }
+
+    void setThreadName(ProfilerThread* thread, const char* name)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        thread->name = name;
+    }
+
+    // complete ("X") events with microsecond time stamps relative to the start of the profiler
+    // ------------------------------------------------------------------------
+    bool writeChromeTrace(const std::string& path)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        FILE* file = std::fopen(path.c_str(), "w");
+        if (!file)
+        {
+            std::cout << "ERROR::PROFILER::TRACE_NOT_WRITTEN " << path << std::endl;
+            return false;
+        }
+
+        // ticks per microsecond, measured over the whole run
+        uint64_t ticks = profilerTicks() - startTicks;
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime).count();
+        double scale = us > 0.0 && ticks > 0 ? us / (double)ticks : 1e-3;
+
+        size_t zones = 0;
+        std::fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+        bool first = true;
+        for (const std::unique_ptr<ProfilerThread>& thread : threads)
+        {
+            std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                         first ? "" : ",\n", thread->id, escaped(thread->name.c_str()).c_str());
+            first = false;
+
+            uint64_t written = thread->written.load(std::memory_order_acquire);
+            uint64_t begin = written > PROFILER_RING_SIZE ? written - PROFILER_RING_SIZE : 0;
+            for (uint64_t i = begin; i < written; i++)
+            {
+                const ProfileEvent& event = thread->events[i & (PROFILER_RING_SIZE - 1)];
+                std::fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                             escaped(event.name).c_str(), thread->id, (double)(int64_t)(event.start - startTicks) * scale,
+                             (double)(event.end - event.start) * scale);
+            }
+            zones += (size_t)(written - begin);
+        }
+        std::fprintf(file, "\n]}\n");
+        std::fclose(file);
+        std::cout << "Profiler: " << zones << " zones of " << threads.size() << " threads written to " << path << std::endl;
+        return true;
+    }
+
+private:
+    std::mutex lock;
+    std::vector<std::unique_ptr<ProfilerThread>> threads;
+    uint64_t startTicks;
+    std::chrono::steady_clock::time_point startTime;
+
+    Profiler() : startTicks(profilerTicks()), startTime(std::chrono::steady_clock::now()) {}
+
+    static std::string escaped(const char* text)
+    {
+        std::string out;
+        for (; *text; text++)
+        {
+            if (*text == '"' || *text == '\\')
+                out += '\\';
+            out += *text;
+        }
+        return out;
+    }
+};
+
+inline ProfilerThread* profilerThread()
+{
+    static thread_local ProfilerThread* thread = Profiler::instance().registerThread();
+    return thread;
+}
+
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char* name) : name(name), start(profilerTicks()) {}
+
+    ~ProfileZone()
+    {
+        uint64_t end = profilerTicks();
+        ProfilerThread* thread = profilerThread();
+        uint64_t index = thread->written.load(std::memory_order_relaxed);
+        ProfileEvent& event = thread->events[index & (PROFILER_RING_SIZE - 1)];
+        event.name = name;
+        event.start = start;
+        event.end = end;
+        thread->written.store(index + 1, std::memory_order_release);
+    }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+    const char* name;
+    uint64_t start;
+};
+
+inline bool profilerWriteChromeTrace(const std::string& path)
+{
+    return Profiler::instance().writeChromeTrace(path);
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#define PROFILE_THREAD_NAME(name) Profiler::instance().setThreadName(profilerThread(), name)
+
+#else
+
+inline bool profilerWriteChromeTrace(const std::string& path)
+{
+    std::cout << "ERROR::PROFILER::COMPILED_OUT " << path << " not written, build with PROFILER_ENABLED=1" << std::endl;
+    return false;
+}
+
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_FUNCTION() ((void)0)
+#define PROFILE_THREAD_NAME(name) ((void)0)
+
+#endif
+#endif
@@ -0,0 +1,199 @@
+// Linked shader programs kept on disk as driver binaries, so later runs skip compiling and linking
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+// Shader hands the final source of every stage to load() before compiling anything. A program stored by an earlier
+// run under the same key is recreated with glProgramBinary; store() saves what glGetProgramBinary returns after a
+// successful link. The key hashes the sources together with the GL vendor, renderer and version strings, so editing
+// a shader or updating the driver selects a different file. A driver may still reject a binary it wrote itself (it
+// is free to, e.g. after a change in state it depends on), then load() deletes the program and the caller compiles
+// the sources as if there was no cache; the new binary replaces the rejected one.
+class ProgramCache
+{
+public:
+    bool enabled = true;
+    unsigned int hits = 0, misses = 0, rejected = 0;
+    double milliseconds = 0.0; // spent creating programs, from the cache or not
+
+    static ProgramCache& shared()
+    {
+        static ProgramCache cache("shader_cache");
+        return cache;
+    }
+
+    // the program stored for source, 0 if there is none or the driver rejects it
+    // ------------------------------------------------------------------------
+    GLuint load(const std::string& source)
+    {
+        if (!available())
+        {
+            misses++;
+            return 0;
+        }
+        std::vector<unsigned char> file;
+        FileHeader header;
+        if (!read(pathOf(source), file) || file.size() < sizeof(header))
+        {
+            misses++;
+            return 0;
+        }
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (header.magic != MAGIC || header.check != checkOf(source) || header.length != file.size() - sizeof(header))
+        {
+            misses++;
+            return 0;
+        }
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, header.format, file.data() + sizeof(header), (GLsizei)header.length);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            glDeleteProgram(program);
+            rejected++;
+            return 0;
+        }
+        hits++;
+        return program;
+    }
+
+    // call before linking a program that store() is going to save
+    // ------------------------------------------------------------------------
+    void prepare(GLuint program)
+    {
+        if (available())
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // saves the binary of a linked program for source
+    // ------------------------------------------------------------------------
+    void store(const std::string& source, GLuint program)
+    {
+        GLint length = 0;
+        if (!available() || (glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length), length <= 0))
+            return;
+        std::vector<unsigned char> file(sizeof(FileHeader) + length);
+        FileHeader header;
+        header.magic = MAGIC;
+        header.check = checkOf(source);
+        glGetProgramBinary(program, length, &length, &header.format, file.data() + sizeof(header));
+        header.length = (uint32_t)length;
+        std::memcpy(file.data(), &header, sizeof(header));
+        file.resize(sizeof(header) + length);
+
+        // written under a temporary name, a second process never reads half a file
+        std::string path = pathOf(source), temporary = path + ".tmp";
+        FILE* out = std::fopen(temporary.c_str(), "wb");
+        if (!out)
+            return;
+        bool written = std::fwrite(file.data(), 1, file.size(), out) == file.size();
+        if (std::fclose(out) == 0 && written)
+        {
+            std::remove(path.c_str());
+            std::rename(temporary.c_str(), path.c_str());
+        }
+        else
+            std::remove(temporary.c_str());
+    }
+
+    void printStats() const
+    {
+        std::printf("Programs: %u from cache, %u compiled, %u rejected, %.1f ms\n", hits, misses + rejected, rejected, milliseconds);
+    }
+
+private:
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t format; // binary format of the driver
+        uint64_t check; // second hash of the key, against collisions of the file names
+        uint64_t length;
+    };
+    static const uint32_t MAGIC = 0x31425047; // "GPB1"
+
+    std::string directory;
+    std::string driver; // vendor, renderer and version, empty until the first use
+    int binaryFormats = -1;
+
+    explicit ProgramCache(const std::string& directory) : directory(directory) {}
+
+    // needs the context, so it is asked on first use rather than at construction
+    bool available()
+    {
+        if (!enabled)
+            return false;
+        if (binaryFormats < 0)
+        {
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+            driver = std::string((const char*)glGetString(GL_VENDOR)) + "|" + (const char*)glGetString(GL_RENDERER) + "|" +
+                     (const char*)glGetString(GL_VERSION) + "|";
+#ifdef _WIN32
+            _mkdir(directory.c_str());
+#else
+            mkdir(directory.c_str(), 0755);
+#endif
+        }
+        return binaryFormats > 0;
+    }
+
+    // FNV-1a, 64 bit
+    static uint64_t hash(const std::string& text, uint64_t seed)
+    {
+        uint64_t value = seed;
+        for (unsigned char c : text)
+            value = (value ^ c) * 0x100000001b3ull;
+        return value;
+    }
+
+    std::string pathOf(const std::string& source) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)hash(driver + source, 0xcbf29ce484222325ull));
+        return directory + name;
+    }
+
+    uint64_t checkOf(const std::string& source) const
+    {
+        return hash(driver + source, 0x84222325cbf29ce4ull);
+    }
+
+    static bool read(const std::string& path, std::vector<unsigned char>& bytes)
+    {
+        FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file)
+            return false;
+        std::fseek(file, 0, SEEK_END);
+        long size = std::ftell(file);
+        std::fseek(file, 0, SEEK_SET);
+        bytes.resize(size > 0 ? (size_t)size : 0);
+        bool ok = size > 0 && std::fread(bytes.data(), 1, bytes.size(), file) == bytes.size();
+        std::fclose(file);
+        return ok;
+    }
+};
+
+// times the creation of one program into ProgramCache::milliseconds
+struct ProgramCacheTimer {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    ~ProgramCacheTimer()
+    {
+        ProgramCache::shared().milliseconds +=
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+#endif
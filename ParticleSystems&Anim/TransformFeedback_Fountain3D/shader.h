@@ -5,7 +5,13 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "profiler.h"
+#include "program_cache.h"
+
+#include <algorithm>
+#include <cstdint>
 #include <string>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -18,6 +24,7 @@ public:
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
     {
+        PROFILE_ZONE("Shader::Shader");
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
         std::string fragmentCode;
@@ -42,8 +49,8 @@ public:
             vShaderFile.close();
             fShaderFile.close();
             // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
+            vertexCode = expandIncludes(vShaderStream.str(), vertexPath);
+            fragmentCode = expandIncludes(fShaderStream.str(), fragmentPath);
             // if geometry shader path is present, also load a geometry shader
             if (geometryPath != nullptr)
             {
@@ -51,16 +58,26 @@ public:
                 std::stringstream gShaderStream;
                 gShaderStream << gShaderFile.rdbuf();
                 gShaderFile.close();
-                geometryCode = gShaderStream.str();
+                geometryCode = expandIncludes(gShaderStream.str(), geometryPath);
             }
         }
         catch (std::ifstream::failure e)
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
+        // 2. reuse the program binary of an earlier run, see program_cache.h
+        ProgramCacheTimer timer;
+        ProgramCache& cache = ProgramCache::shared();
+        std::string source = "vertex\n" + vertexCode + "fragment\n" + fragmentCode + "geometry\n" + geometryCode;
+        ID = cache.load(source);
+        if (ID)
+        {
+            reflectUniforms();
+            return;
+        }
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
+        // 3. compile shaders
         unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
@@ -88,8 +105,11 @@ public:
         glAttachShader(ID, fragment);
         if (geometryPath != nullptr)
             glAttachShader(ID, geometry);
+        cache.prepare(ID);
         glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+        if (checkCompileErrors(ID, "PROGRAM"))
+            cache.store(source, ID);
+        reflectUniforms();
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
         glDeleteShader(fragment);
@@ -97,81 +117,278 @@ public:
             glDeleteShader(geometry);
 
     }
+    // constructor for a compute program
+    // ------------------------------------------------------------------------
+    explicit Shader(const char* computePath)
+    {
+        PROFILE_ZONE("Shader::Shader");
+        std::string computeCode;
+        std::ifstream cShaderFile;
+        cShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        try
+        {
+            cShaderFile.open(computePath);
+            std::stringstream cShaderStream;
+            cShaderStream << cShaderFile.rdbuf();
+            cShaderFile.close();
+            computeCode = expandIncludes(cShaderStream.str(), computePath);
+        }
+        catch (const std::ifstream::failure& e)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+        }
+        ProgramCacheTimer timer;
+        ProgramCache& cache = ProgramCache::shared();
+        std::string source = "compute\n" + computeCode;
+        ID = cache.load(source);
+        if (ID)
+        {
+            reflectUniforms();
+            return;
+        }
+        const char* cShaderCode = computeCode.c_str();
+        unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(compute, 1, &cShaderCode, NULL);
+        glCompileShader(compute);
+        checkCompileErrors(compute, "COMPUTE");
+        ID = glCreateProgram();
+        glAttachShader(ID, compute);
+        cache.prepare(ID);
+        glLinkProgram(ID);
+        if (checkCompileErrors(ID, "PROGRAM"))
+            cache.store(source, ID);
+        reflectUniforms();
+        glDeleteShader(compute);
+    }
     // activate the shader
     // ------------------------------------------------------------------------
     void use()
     {
         glUseProgram(ID);
     }
-    // utility uniform functions
+    // the location of an active uniform, -1 if the program has none of that name. The uniforms are reflected when
+    // the program is created, so this searches a table instead of asking GL; look the locations up once and pass
+    // them to the setters every frame
     // ------------------------------------------------------------------------
-    void setBool(const std::string &name, bool value) const
+    GLint uniform(const char* name) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        uint32_t hash = uniformHash(name);
+        std::vector<Uniform>::const_iterator entry = std::lower_bound(uniforms.begin(), uniforms.end(), hash,
+            [](const Uniform& uniform, uint32_t hash) { return uniform.hash < hash; });
+        for (; entry != uniforms.end() && entry->hash == hash; ++entry)
+            if (entry->name == name)
+                return entry->location;
+        return -1;
     }
+    // utility uniform functions: the setters taking a location are meant for the per-frame path, the ones taking
+    // a name look it up in the reflected table first
     // ------------------------------------------------------------------------
-    void setInt(const std::string &name, int value) const
+    void setBool(const char* name, bool value) const
+    {
+        setBool(uniform(name), value);
+    }
+    void setBool(GLint location, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(location, (int)value);
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string &name, float value) const
+    void setInt(const char* name, int value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        setInt(uniform(name), value);
+    }
+    void setInt(GLint location, int value) const
+    {
+        glUniform1i(location, value);
     }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string &name, const glm::vec2 &value) const
+    void setUInt(const char* name, unsigned int value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setUInt(uniform(name), value);
     }
-    void setVec2(const std::string &name, float x, float y) const
+    void setUInt(GLint location, unsigned int value) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform1ui(location, value);
     }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string &name, const glm::vec3 &value) const
+    void setFloat(const char* name, float value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setFloat(uniform(name), value);
     }
-    void setVec3(const std::string &name, float x, float y, float z) const
+    void setFloat(GLint location, float value) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform1f(location, value);
     }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string &name, const glm::vec4 &value) const
+    void setVec2(const char* name, const glm::vec2 &value) const
+    {
+        setVec2(uniform(name), value);
+    }
+    void setVec2(GLint location, const glm::vec2 &value) const
+    {
+        glUniform2fv(location, 1, &value[0]);
+    }
+    void setVec2(const char* name, float x, float y) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec2(uniform(name), x, y);
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w)
+    void setVec2(GLint location, float x, float y) const
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform2f(location, x, y);
     }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string &name, const glm::mat2 &mat) const
+    void setVec3(const char* name, const glm::vec3 &value) const
+    {
+        setVec3(uniform(name), value);
+    }
+    void setVec3(GLint location, const glm::vec3 &value) const
+    {
+        glUniform3fv(location, 1, &value[0]);
+    }
+    void setVec3(const char* name, float x, float y, float z) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setVec3(uniform(name), x, y, z);
+    }
+    void setVec3(GLint location, float x, float y, float z) const
+    {
+        glUniform3f(location, x, y, z);
     }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string &name, const glm::mat3 &mat) const
+    void setVec4(const char* name, const glm::vec4 &value) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setVec4(uniform(name), value);
+    }
+    void setVec4(GLint location, const glm::vec4 &value) const
+    {
+        glUniform4fv(location, 1, &value[0]);
+    }
+    void setVec4(const char* name, float x, float y, float z, float w) const
+    {
+        setVec4(uniform(name), x, y, z, w);
+    }
+    void setVec4(GLint location, float x, float y, float z, float w) const
+    {
+        glUniform4f(location, x, y, z, w);
     }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string &name, const glm::mat4 &mat) const
+    void setMat2(const char* name, const glm::mat2 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat2(uniform(name), mat);
+    }
+    void setMat2(GLint location, const glm::mat2 &mat) const
+    {
+        glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]);
+    }
+    // ------------------------------------------------------------------------
+    void setMat3(const char* name, const glm::mat3 &mat) const
+    {
+        setMat3(uniform(name), mat);
+    }
+    void setMat3(GLint location, const glm::mat3 &mat) const
+    {
+        glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]);
     }
-
     // ------------------------------------------------------------------------
-	void setSampler2D(const std::string &name, int value) const
-	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
-	}
+    void setMat4(const char* name, const glm::mat4 &mat) const
+    {
+        setMat4(uniform(name), mat);
+    }
+    void setMat4(GLint location, const glm::mat4 &mat) const
+    {
+        glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+    }
+    // ------------------------------------------------------------------------
+    void setSampler2D(const char* name, int value) const
+    {
+        setSampler2D(uniform(name), value);
+    }
+    void setSampler2D(GLint location, int value) const
+    {
+        glUniform1i(location, value);
+    }
 
 private:
-    // utility function for checking shader compilation/linking errors.
+    struct Uniform {
+        uint32_t hash; // of the name, the table is sorted by it
+        GLint location;
+        std::string name;
+    };
+    std::vector<Uniform> uniforms;
+
+    // FNV-1a, 32 bit
+    static uint32_t uniformHash(const char* name)
+    {
+        uint32_t hash = 2166136261u;
+        for (; *name; name++)
+            hash = (hash ^ (unsigned char)*name) * 16777619u;
+        return hash;
+    }
+
+    // reads the location of every active uniform outside of a block into the table, an array under its name with
+    // and without "[0]"
+    // ------------------------------------------------------------------------
+    void reflectUniforms()
+    {
+        uniforms.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+        glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_MAX_NAME_LENGTH, &maxLength);
+        std::vector<char> name(maxLength + 1);
+        const GLenum property = GL_LOCATION;
+        for (GLint i = 0; i < count; i++)
+        {
+            Uniform uniform;
+            glGetProgramResourceiv(ID, GL_UNIFORM, i, 1, &property, 1, NULL, &uniform.location);
+            if (uniform.location < 0)
+                continue;
+            glGetProgramResourceName(ID, GL_UNIFORM, i, (GLsizei)name.size(), NULL, name.data());
+            uniform.name = name.data();
+            uniform.hash = uniformHash(uniform.name.c_str());
+            uniforms.push_back(uniform);
+            size_t length = uniform.name.size();
+            if (length > 3 && uniform.name.compare(length - 3, 3, "[0]") == 0)
+            {
+                uniform.name.resize(length - 3);
+                uniform.hash = uniformHash(uniform.name.c_str());
+                uniforms.push_back(uniform);
+            }
+        }
+        std::sort(uniforms.begin(), uniforms.end(), [](const Uniform& a, const Uniform& b) { return a.hash < b.hash; });
+    }
+    // replaces every #include "file" line with the contents of file, relative to the directory of path
+    // ------------------------------------------------------------------------
+    static std::string expandIncludes(const std::string& code, const std::string& path)
+    {
+        std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+        std::istringstream lines(code);
+        std::stringstream expanded;
+        std::string line;
+        while (std::getline(lines, line))
+        {
+            size_t directive = line.find("#include");
+            size_t open = line.find('"');
+            size_t close = line.rfind('"');
+            if (directive == std::string::npos || directive != line.find_first_not_of(" \t") || open == std::string::npos || close <= open)
+            {
+                expanded << line << '\n';
+                continue;
+            }
+            std::string includePath = directory + line.substr(open + 1, close - open - 1);
+            std::ifstream includeFile(includePath);
+            if (!includeFile)
+            {
+                std::cout << "ERROR::SHADER::INCLUDE_NOT_FOUND " << includePath << std::endl;
+                continue;
+            }
+            std::stringstream includeStream;
+            includeStream << includeFile.rdbuf();
+            expanded << expandIncludes(includeStream.str(), includePath) << '\n';
+        }
+        return expanded.str();
+    }
+
+    // utility function for checking shader compilation/linking errors, false if there were any.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -193,6 +410,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success != GL_FALSE;
     }
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,35 @@
+//Counter-based random numbers (Philox4x32-10), same bits as counter_rng.h
+//Included by the update shaders with #include "counter_rng.glsl" after the #version line
+
+const uint RNG_STREAM_VELOCITY = 0u;
+const uint RNG_STREAM_POSITION = 1u;
+
+uvec4 philox4x32(uvec4 counter, uvec2 key){
+	for(int round = 0; round < 10; round++){
+		uint hi0, lo0, hi1, lo1;
+		umulExtended(0xD2511F53u, counter.x, hi0, lo0);
+		umulExtended(0xCD9E8D57u, counter.z, hi1, lo1);
+		counter = uvec4(hi1 ^ counter.y ^ key.x, lo1, hi0 ^ counter.w ^ key.y, lo0);
+		key += uvec2(0x9E3779B9u, 0xBB67AE85u);
+	}
+	return counter;
+}
+
+//Uniform float in [0, 1)
+float rngUnitFloat(uint bits){
+	return float(bits >> 8) * (1.0 / 16777216.0);
+}
+
+vec4 rngUniform4(uint seed, uint id, uint generation, uint stream){
+	uvec4 bits = philox4x32(uvec4(id, generation, stream, 0u), uvec2(seed, 0u));
+	return vec4(rngUnitFloat(bits.x), rngUnitFloat(bits.y), rngUnitFloat(bits.z), rngUnitFloat(bits.w));
+}
+
+//Velocity in a cone around +y, angle = half opening in radians, speed = (min, max) magnitude
+vec3 rngSpawnVelocity(uint seed, uint id, uint generation, float angle, vec2 speed){
+	vec4 u = rngUniform4(seed, id, generation, RNG_STREAM_VELOCITY);
+	float theta = angle * u.x;
+	float phi = 6.28318530718 * u.y;
+	float magnitude = mix(speed.x, speed.y, u.z);
+	return vec3(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi)) * magnitude;
+}
@@ -0,0 +1,17 @@
+#version 440 core
+
+uniform sampler2D SceneDepth; //Full resolution depth of the scene
+uniform int Divisor; //Full resolution pixels per target pixel in each direction
+
+void main()
+{
+	//The farthest depth of the block: particles behind a near edge stay in the target and the upsample
+	//decides per full resolution pixel whether they are visible
+	ivec2 first = ivec2(gl_FragCoord.xy) * Divisor;
+	ivec2 last = textureSize(SceneDepth, 0) - 1;
+	float depth = 0.0;
+	for(int y = 0; y < Divisor; y++)
+		for(int x = 0; x < Divisor; x++)
+			depth = max(depth, texelFetch(SceneDepth, min(first + ivec2(x, y), last), 0).r);
+	gl_FragDepth = depth;
+}
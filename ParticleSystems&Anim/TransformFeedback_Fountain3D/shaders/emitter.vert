@@ -0,0 +1,22 @@
+#version 440 core
+
+struct Particle {
+	vec4 Position; //xyz = position, w = age
+	vec4 Velocity;
+};
+
+layout (std430, binding = 0) readonly buffer Particles { Particle particles[]; };
+layout (std430, binding = 2) readonly buffer AliveList { uint aliveList[]; };
+
+out float Transp; //Transparency of the particle
+
+uniform float ParticleLifetime; //Max particle lifetime
+uniform mat4 MVP; //Model-view-projection matrix
+
+void main(){
+	//Only alive particles are drawn, the vertex id indexes the alive list
+	Particle p = particles[aliveList[gl_VertexID]];
+
+	Transp = 1.0 - p.Position.w / ParticleLifetime;
+	gl_Position = MVP * vec4(p.Position.xyz, 1.0);
+}
@@ -1,11 +1,11 @@
 #version 440 core
+#include "counter_rng.glsl"
 subroutine void RenderPassType();
 subroutine uniform RenderPassType RenderPass;
 
 layout (location = 0) in vec3 VertexPosition;
 layout (location = 1) in vec3 VertexVelocity;
 layout (location = 2) in float VertexStartTime;
-layout (location = 3) in vec3 VertexInitialVelocity;
 
 out float Transp; //Transparency of the particle
 layout( xfb_buffer = 0, xfb_offset=0 ) out vec3 Position; //Position of the particle to tranform feedback
@@ -16,6 +16,9 @@ uniform float Time; //Animation time
 uniform float H; //Elapsed time between frames
 uniform vec3 Accel; //Particle acceleration
 uniform float ParticleLifetime; //Max particle lifetime
+uniform uint Seed; //Key of the random numbers
+uniform float SpawnAngle; //Half opening of the velocity cone of recycled particles
+uniform vec2 SpawnSpeed; //Min and max speed of recycled particles
 
 uniform mat4 MVP; //Model-view-projection matrix
 
@@ -34,7 +37,7 @@ void update(){
 		if(t > ParticleLifetime){
 			//Particle is dead, recycle
 			Position = vec3(VertexPosition.x, 0.0, 0.0);
-			Velocity = VertexInitialVelocity;
+			Velocity = rngSpawnVelocity(Seed, uint(gl_VertexID), floatBitsToUint(Time), SpawnAngle, SpawnSpeed);
 			StartTime = Time;
 		} else {
 			//Particle is alive
@@ -0,0 +1,46 @@
+#version 440 core
+
+uniform sampler2D ParticleColor; //Premultiplied color and coverage of the reduced target
+uniform sampler2D ParticleDepth; //Its downsampled depth
+uniform sampler2D SceneDepth; //Full resolution depth of the scene
+uniform float Divisor; //Full resolution pixels per target pixel in each direction
+uniform vec2 DepthRange; //Near and far plane of the projection
+uniform float DepthTolerance; //Relative difference in distance at which a texel belongs to another surface
+
+layout (location = 0) out vec4 FragColor;
+
+//Window depth back to the distance from the camera
+float linearDepth(float depth){
+	return DepthRange.x * DepthRange.y / (DepthRange.y - depth * (DepthRange.y - DepthRange.x));
+}
+
+void main()
+{
+	vec2 size = vec2(textureSize(ParticleColor, 0));
+	vec2 coord = gl_FragCoord.xy / Divisor; //In target pixels
+
+	//Most of the frame has no particles, none of the four texels is covered there
+	vec4 filtered = texture(ParticleColor, coord / size);
+	if(filtered.a == 0.0)
+		discard;
+	float depth = linearDepth(texelFetch(SceneDepth, ivec2(gl_FragCoord.xy), 0).r);
+
+	//The four texels the bilinear filter would mix, and the one closest in depth to this pixel
+	ivec2 first = ivec2(floor(coord - 0.5));
+	ivec2 last = ivec2(size) - 1;
+	ivec2 nearest = first;
+	float nearestDifference = 1e30;
+	bool edge = false;
+	for(int i = 0; i < 4; i++){
+		ivec2 texel = clamp(first + ivec2(i & 1, i >> 1), ivec2(0), last);
+		float difference = abs(linearDepth(texelFetch(ParticleDepth, texel, 0).r) - depth);
+		edge = edge || difference > DepthTolerance * depth;
+		if(difference < nearestDifference){
+			nearestDifference = difference;
+			nearest = texel;
+		}
+	}
+
+	//Filtered where the block is one surface, nearest-depth across edges
+	FragColor = edge ? texelFetch(ParticleColor, nearest, 0) : filtered;
+}
@@ -0,0 +1,32 @@
+//Emitter table of particle_system.h (EmitterBlock), emitter k owns the particles from emitters[k].First
+//up to the First of emitter k + 1
+
+struct Emitter {
+	vec4 RespawnPosition; //xyz = where a recycled particle is placed, w = max particle lifetime
+	vec4 Accel; //xyz = particle acceleration, w = half opening of the velocity cone of recycled particles
+	vec4 KeepOnRespawn; //xyz = 1.0 for the components that keep their value on respawn, w = extent of the packed box
+	vec4 Origin; //xyz = center of the packed box
+	vec2 SpawnSpeed; //Min and max speed of recycled particles
+	uint Seed; //Key of the random numbers
+	uint First; //First particle of the emitter
+};
+
+layout (std430, binding = 3) readonly buffer Emitters { Emitter emitters[]; };
+
+//FirstEmitter[b] is the emitter of particle b * 256 (the last emitter past the end of the pool)
+layout (std430, binding = 4) readonly buffer EmitterBlocks { uint FirstEmitter[]; };
+
+//Emitter of particle i: the last one whose slice starts at or before i. Only the emitters overlapping
+//the block of 256 particles around i are searched, usually one or two
+uint findEmitter(uint i){
+	uint block = i / 256u;
+	uint lo = FirstEmitter[block], hi = FirstEmitter[block + 1u];
+	while(lo < hi){
+		uint mid = (lo + hi + 1u) / 2u;
+		if(emitters[mid].First <= i)
+			lo = mid;
+		else
+			hi = mid - 1u;
+	}
+	return lo;
+}
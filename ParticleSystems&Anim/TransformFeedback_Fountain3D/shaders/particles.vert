@@ -0,0 +1,17 @@
+#version 440 core
+#include "particle_emitters.glsl"
+
+//Float buffers of particle_system.h, same locations as TF_fountain.vert
+layout (location = 0) in vec3 VertexPosition;
+layout (location = 2) in float VertexStartTime;
+
+out float Transp; //Transparency of the particle
+
+uniform float Time; //Animation time
+uniform mat4 MVP; //Model-view-projection matrix
+
+void main(){
+	float lifetime = emitters[findEmitter(uint(gl_VertexID))].RespawnPosition.w;
+	Transp = 1.0 - (Time - VertexStartTime) / lifetime;
+	gl_Position = MVP * vec4(VertexPosition, 1.0);
+}
@@ -0,0 +1,20 @@
+#version 440 core
+#include "particle_emitters.glsl"
+
+//PackedParticle of particle_system.h, the normalized attributes arrive in [-1, 1]
+layout (location = 0) in vec3 VertexPosition;
+layout (location = 2) in float VertexStartPhase; //Start time modulo TimeWrap
+
+out float Transp; //Transparency of the particle
+
+uniform float Time; //Animation time
+uniform float TimeWrap;
+
+uniform mat4 MVP; //Model-view-projection matrix
+
+void main(){
+	Emitter e = emitters[findEmitter(uint(gl_VertexID))];
+	float t = (Time - VertexStartPhase * 0.5 * TimeWrap) / TimeWrap;
+	Transp = 1.0 - (t - floor(t + 0.5)) * TimeWrap / e.RespawnPosition.w;
+	gl_Position = MVP * vec4(VertexPosition * e.KeepOnRespawn.w + e.Origin.xyz, 1.0);
+}
@@ -0,0 +1,26 @@
+#version 440 core
+
+in float Transp;
+in vec2 SpriteCoord;
+in float ViewDepth;
+
+uniform sampler2D ParticleTexture;
+uniform sampler2D SceneDepth; //Depth buffer of the scene behind the particles
+uniform float DepthScale; //Scene pixels per pixel of the target the sprites are drawn into
+uniform vec2 DepthRange; //Near and far plane of the projection
+uniform float SoftDistance; //The sprites fade out over this distance in front of the scene
+
+layout (location = 0) out vec4 FragColor;
+
+void main()
+{
+	FragColor = texture(ParticleTexture, SpriteCoord);
+
+	//Window depth back to the distance from the camera
+	ivec2 pixel = min(ivec2(gl_FragCoord.xy * DepthScale), textureSize(SceneDepth, 0) - 1);
+	float depth = texelFetch(SceneDepth, pixel, 0).r;
+	float sceneDepth = DepthRange.x * DepthRange.y / (DepthRange.y - depth * (DepthRange.y - DepthRange.x));
+	float fade = clamp((sceneDepth - ViewDepth) / SoftDistance, 0.0, 1.0);
+
+	FragColor.a *= Transp * fade;
+}
@@ -0,0 +1,26 @@
+//Camera-facing sprites of particle_sprites.h: one instance per particle, drawn as a triangle fan through the
+//corners of the sprite's alpha hull
+
+uniform mat4 ModelView;
+uniform mat4 Projection;
+uniform float SpriteSize; //Edge of the quad in world units
+uniform float SpriteSpin; //Turn of the sprite in radians per second of age
+uniform vec2 SpriteHull[8]; //Corners in texture coordinates
+
+out vec2 SpriteCoord;
+out float ViewDepth; //Distance in front of the camera, for the soft fade
+
+//Places corner gl_VertexID of the sprite of particle index at position, in the plane facing the camera
+void emitSprite(vec3 position, uint index, float age){
+	vec2 corner = SpriteHull[gl_VertexID];
+	//Every particle starts at another angle
+	float angle = 6.2831853 * fract(float(index) * 0.61803399) + SpriteSpin * age;
+	float c = cos(angle), s = sin(angle);
+	//The first texel row is the top of the sprite, as with gl_PointCoord
+	vec2 offset = mat2(c, s, -s, c) * (vec2(corner.x, 1.0 - corner.y) - 0.5) * SpriteSize;
+
+	vec4 viewPosition = ModelView * vec4(position, 1.0) + vec4(offset, 0.0, 0.0);
+	SpriteCoord = corner;
+	ViewDepth = -viewPosition.z;
+	gl_Position = Projection * viewPosition;
+}
@@ -0,0 +1,23 @@
+#version 440 core
+#include "sprite.glsl"
+
+struct Particle {
+	vec4 Position; //xyz = position, w = age
+	vec4 Velocity;
+};
+
+layout (std430, binding = 0) readonly buffer Particles { Particle particles[]; };
+layout (std430, binding = 2) readonly buffer AliveList { uint aliveList[]; };
+
+out float Transp; //Transparency of the particle
+
+uniform float ParticleLifetime; //Max particle lifetime
+
+void main(){
+	//One instance per alive particle, the instance id indexes the alive list
+	uint slot = aliveList[gl_InstanceID];
+	Particle p = particles[slot];
+
+	Transp = 1.0 - p.Position.w / ParticleLifetime;
+	emitSprite(p.Position.xyz, slot, p.Position.w);
+}
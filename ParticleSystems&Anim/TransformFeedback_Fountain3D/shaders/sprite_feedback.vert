@@ -0,0 +1,17 @@
+#version 440 core
+#include "sprite.glsl"
+
+//Buffer set of TF_fountain.vert or fire.vert, one particle per instance
+layout (location = 0) in vec3 VertexPosition;
+layout (location = 2) in float VertexStartTime;
+
+out float Transp; //Transparency of the particle
+
+uniform float Time; //Animation time
+uniform float ParticleLifetime; //Max particle lifetime
+
+void main(){
+	float age = Time - VertexStartTime;
+	Transp = 1.0 - age / ParticleLifetime;
+	emitSprite(VertexPosition, uint(gl_InstanceID), age);
+}
@@ -0,0 +1,20 @@
+#version 440 core
+#include "particle_emitters.glsl"
+#include "sprite.glsl"
+
+//Float buffers of particle_system.h, one particle per instance
+layout (location = 0) in vec3 VertexPosition;
+layout (location = 2) in float VertexStartTime;
+
+out float Transp; //Transparency of the particle
+
+uniform float Time; //Animation time
+uniform uint FirstParticle; //Of the emitters drawn, the instances start there
+
+void main(){
+	uint particle = FirstParticle + uint(gl_InstanceID);
+	float lifetime = emitters[findEmitter(particle)].RespawnPosition.w;
+	float age = Time - VertexStartTime;
+	Transp = 1.0 - age / lifetime;
+	emitSprite(VertexPosition, particle, age);
+}
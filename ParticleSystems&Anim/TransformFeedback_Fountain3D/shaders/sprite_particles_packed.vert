@@ -0,0 +1,22 @@
+#version 440 core
+#include "particle_emitters.glsl"
+#include "sprite.glsl"
+
+//PackedParticle of particle_system.h, one particle per instance
+layout (location = 0) in vec3 VertexPosition;
+layout (location = 2) in float VertexStartPhase; //Start time modulo TimeWrap
+
+out float Transp; //Transparency of the particle
+
+uniform float Time; //Animation time
+uniform uint FirstParticle; //Of the emitters drawn, the instances start there
+uniform float TimeWrap;
+
+void main(){
+	uint particle = FirstParticle + uint(gl_InstanceID);
+	Emitter e = emitters[findEmitter(particle)];
+	float t = (Time - VertexStartPhase * 0.5 * TimeWrap) / TimeWrap;
+	float age = (t - floor(t + 0.5)) * TimeWrap;
+	Transp = 1.0 - age / e.RespawnPosition.w;
+	emitSprite(VertexPosition * e.KeepOnRespawn.w + e.Origin.xyz, particle, age);
+}
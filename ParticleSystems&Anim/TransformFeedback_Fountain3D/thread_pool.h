@@ -0,0 +1,202 @@
+// Work-stealing thread pool used by the CPU particle simulation
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "profiler.h"
+
+// parallelFor() splits [0, count) into fixed size chunks and hands every worker a contiguous run of them.
+// A worker consumes its own run from the front; once it is empty it steals the back half of the run of
+// another worker, so uneven chunks (or a busy core) get rebalanced without a shared queue.
+// The calling thread takes part as worker 0.
+class WorkStealingPool
+{
+public:
+    // threads = 0 uses one worker per hardware thread
+    explicit WorkStealingPool(unsigned int threads = 0) : queues(nullptr), stop(false), generation(0), pending(0), job(nullptr)
+    {
+        if (threads == 0)
+            threads = std::thread::hardware_concurrency();
+        if (threads == 0)
+            threads = 1;
+
+        workerCount = threads;
+        queues = new WorkerQueue[workerCount];
+        for (unsigned int i = 1; i < workerCount; i++)
+            workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+
+    ~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(wakeLock);
+            stop = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+        delete[] queues;
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned int size() const { return workerCount; }
+
+    // calls task(begin, end) for every chunk of [0, count) and returns once all of them are done,
+    // chunk boundaries are multiples of chunkSize
+    // ------------------------------------------------------------------------
+    void parallelFor(unsigned int count, unsigned int chunkSize, const std::function<void(unsigned int, unsigned int)>& task)
+    {
+        if (count == 0)
+            return;
+        if (chunkSize == 0)
+            chunkSize = count;
+
+        unsigned int chunks = (count + chunkSize - 1) / chunkSize;
+        if (workerCount == 1 || chunks == 1)
+        {
+            for (unsigned int c = 0; c < chunks; c++)
+                task(c * chunkSize, std::min(count, (c + 1) * chunkSize));
+            return;
+        }
+
+        // a worker from the previous job may still be looking for chunks to steal,
+        // the queues are only refilled once every worker has left runChunks()
+        std::unique_lock<std::mutex> lock(wakeLock);
+        done.wait(lock, [this] { return active == 0; });
+
+        // contiguous runs of chunks per worker keep neighbouring cache lines on the same core
+        for (unsigned int w = 0; w < workerCount; w++)
+        {
+            std::lock_guard<std::mutex> guard(queues[w].lock);
+            queues[w].next = (unsigned int)((unsigned long long)chunks * w / workerCount);
+            queues[w].end = (unsigned int)((unsigned long long)chunks * (w + 1) / workerCount);
+        }
+        job = &task;
+        jobCount = count;
+        jobChunkSize = chunkSize;
+        pending.store(chunks);
+        generation++;
+        lock.unlock();
+        wake.notify_all();
+
+        runChunks(0);
+
+        // wait for the chunks other workers are still running
+        lock.lock();
+        done.wait(lock, [this] { return pending.load() == 0; });
+        job = nullptr;
+    }
+
+private:
+    struct WorkerQueue {
+        std::mutex lock;
+        unsigned int next = 0; // first chunk not taken yet
+        unsigned int end = 0;
+        char padding[64]; // keeps the queues of two workers off the same cache line
+    };
+
+    unsigned int workerCount;
+    WorkerQueue* queues;
+    std::vector<std::thread> workers;
+
+    std::mutex wakeLock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    bool stop;
+    unsigned long long generation;
+    unsigned int active = 0; // workers inside runChunks(), guarded by wakeLock
+
+    std::atomic<unsigned int> pending; // chunks of the current job that have not finished
+    const std::function<void(unsigned int, unsigned int)>* job;
+    unsigned int jobCount = 0;
+    unsigned int jobChunkSize = 0;
+
+    void workerLoop(unsigned int index)
+    {
+        PROFILE_THREAD_NAME("pool worker");
+        unsigned long long seen = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(wakeLock);
+                wake.wait(lock, [this, seen] { return stop || generation != seen; });
+                if (stop)
+                    return;
+                seen = generation;
+                active++;
+            }
+            runChunks(index);
+
+            std::lock_guard<std::mutex> guard(wakeLock);
+            if (--active == 0)
+                done.notify_all();
+        }
+    }
+
+    // runs chunks from our own queue, then steals until every queue is empty
+    // ------------------------------------------------------------------------
+    void runChunks(unsigned int self)
+    {
+        PROFILE_ZONE("WorkStealingPool::runChunks");
+        unsigned int chunk;
+        while (takeOwn(self, chunk) || steal(self, chunk))
+        {
+            unsigned int begin = chunk * jobChunkSize;
+            unsigned int end = std::min(jobCount, begin + jobChunkSize);
+            (*job)(begin, end);
+
+            if (pending.fetch_sub(1) == 1)
+            {
+                std::lock_guard<std::mutex> guard(wakeLock);
+                done.notify_all();
+            }
+        }
+    }
+
+    bool takeOwn(unsigned int self, unsigned int& chunk)
+    {
+        std::lock_guard<std::mutex> guard(queues[self].lock);
+        if (queues[self].next == queues[self].end)
+            return false;
+        chunk = queues[self].next++;
+        return true;
+    }
+
+    // moves the back half of the next non-empty queue into ours and takes its first chunk
+    // ------------------------------------------------------------------------
+    bool steal(unsigned int self, unsigned int& chunk)
+    {
+        for (unsigned int offset = 1; offset < workerCount; offset++)
+        {
+            WorkerQueue& victim = queues[(self + offset) % workerCount];
+            unsigned int begin, end;
+            {
+                std::lock_guard<std::mutex> guard(victim.lock);
+                unsigned int remaining = victim.end - victim.next;
+                if (remaining == 0)
+                    continue;
+                unsigned int stolen = (remaining + 1) / 2;
+                begin = victim.end - stolen;
+                end = victim.end;
+                victim.end = begin;
+            }
+
+            std::lock_guard<std::mutex> guard(queues[self].lock);
+            chunk = begin;
+            queues[self].next = begin + 1;
+            queues[self].end = end;
+            return true;
+        }
+        return false;
+    }
+};
+#endif
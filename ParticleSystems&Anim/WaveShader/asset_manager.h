@@ -0,0 +1,241 @@
+// Process-wide cache of loaded assets, shared through reference counted handles
+#ifndef ASSET_MANAGER_H
+#define ASSET_MANAGER_H
+
+#include <glad/glad.h>
+
+#include "shader.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// FNV-1a, 64 bit. Keys of different kinds of assets start from different seeds so they never meet in the cache.
+inline uint64_t assetHash(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ull)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+inline uint64_t assetHash(const std::string& text, uint64_t seed = 0xcbf29ce484222325ull)
+{
+    return assetHash(text.data(), text.size(), seed);
+}
+
+// key of the asset loaded from path, kind names the type and every option that changes the result ("texture2d:srgb")
+inline uint64_t assetPathKey(const std::string& kind, const std::string& path)
+{
+    return assetHash(path, assetHash(kind + ":path:"));
+}
+
+// keys of an asset made from several files, e.g. the faces of a cubemap
+inline uint64_t assetFilesPathKey(const std::string& kind, const std::vector<std::string>& paths)
+{
+    std::string joined;
+    for (const std::string& path : paths)
+        joined += path + "|";
+    return assetPathKey(kind, joined);
+}
+
+inline uint64_t assetFilesContentKey(const std::string& kind, const std::vector<std::vector<unsigned char>>& files)
+{
+    uint64_t key = assetHash(kind + ":content:");
+    for (const std::vector<unsigned char>& bytes : files)
+    {
+        uint64_t size = bytes.size();
+        key = assetHash(&size, sizeof(size), key);
+        key = assetHash(bytes.data(), bytes.size(), key);
+    }
+    return key;
+}
+
+inline bool readAssetFile(const std::string& path, std::vector<unsigned char>& bytes)
+{
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    std::fseek(file, 0, SEEK_END);
+    long size = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+    bytes.resize(size > 0 ? (size_t)size : 0);
+    bool ok = size >= 0 && std::fread(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    std::fclose(file);
+    return ok;
+}
+
+// GL texture owned by its handles, deleted together with the last one
+struct TextureObject {
+    GLuint id;
+
+    explicit TextureObject(GLuint id) : id(id) {}
+    ~TextureObject() { glDeleteTextures(1, &id); }
+
+    TextureObject(const TextureObject&) = delete;
+    TextureObject& operator=(const TextureObject&) = delete;
+};
+
+typedef std::shared_ptr<TextureObject> TextureHandle;
+typedef std::shared_ptr<Shader> ShaderHandle;
+
+// The cache only holds weak references: an asset lives as long as somebody holds a handle to it, the GL objects are
+// freed by the handle that goes last. A key that is looked up again after that loads the asset anew.
+// Lookups by path are counted as hits, lookups by content that find a copy under another path as content hits.
+// Handles that own GL objects have to be released while the context is still current.
+class AssetManager
+{
+public:
+    enum Lookup { BY_PATH, BY_CONTENT };
+
+    static AssetManager& instance()
+    {
+        static AssetManager manager;
+        return manager;
+    }
+
+    // the live asset stored under key or an empty handle
+    // ------------------------------------------------------------------------
+    template <class T>
+    std::shared_ptr<T> find(uint64_t key, Lookup lookup = BY_PATH)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::unordered_map<uint64_t, std::weak_ptr<void>>::iterator entry = assets.find(key);
+        if (entry == assets.end())
+            return std::shared_ptr<T>();
+        std::shared_ptr<T> asset = std::static_pointer_cast<T>(entry->second.lock());
+        if (!asset)
+        {
+            assets.erase(entry);
+            return asset;
+        }
+        if (lookup == BY_PATH)
+            hits++;
+        else
+            contentHits++;
+        return asset;
+    }
+
+    // stores an asset that was just loaded, counted as a miss
+    template <class T>
+    const std::shared_ptr<T>& add(uint64_t key, const std::shared_ptr<T>& asset)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        misses++;
+        assets[key] = asset;
+        return asset;
+    }
+
+    // stores a second key of an asset that is already cached, e.g. its path after a content hit
+    template <class T>
+    void alias(uint64_t key, const std::shared_ptr<T>& asset)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        assets[key] = asset;
+    }
+
+    // the asset under key, or the one load() returns on a miss. Failed loads (empty handles) are not cached.
+    // ------------------------------------------------------------------------
+    template <class T, class Load>
+    std::shared_ptr<T> acquire(uint64_t key, Load load)
+    {
+        std::shared_ptr<T> asset = find<T>(key);
+        if (asset)
+            return asset;
+        asset = load();
+        if (asset)
+            add(key, asset);
+        return asset;
+    }
+
+    // the asset decoded from the given files: cached by their paths first, then by their content so copies of a
+    // file under other names share it. load(files) gets the bytes of every file, an unreadable one is left empty
+    // and the result is not cached; load() reports the error and returns a placeholder or an empty handle.
+    // ------------------------------------------------------------------------
+    template <class T, class Load>
+    std::shared_ptr<T> acquireFiles(const std::string& kind, const std::vector<std::string>& paths, Load load)
+    {
+        uint64_t pathKey = assetFilesPathKey(kind, paths);
+        std::shared_ptr<T> asset = find<T>(pathKey);
+        if (asset)
+            return asset;
+
+        std::vector<std::vector<unsigned char>> files(paths.size());
+        bool complete = true;
+        for (size_t i = 0; i < paths.size(); i++)
+            complete = readAssetFile(paths[i], files[i]) && complete;
+        if (!complete)
+            return load(files);
+
+        uint64_t contentKey = assetFilesContentKey(kind, files);
+        asset = find<T>(contentKey, BY_CONTENT);
+        if (asset)
+        {
+            alias(pathKey, asset);
+            return asset;
+        }
+        asset = load(files);
+        if (asset)
+        {
+            add(pathKey, asset);
+            alias(contentKey, asset);
+        }
+        return asset;
+    }
+
+    template <class T, class Load>
+    std::shared_ptr<T> acquireFile(const std::string& kind, const std::string& path, Load load)
+    {
+        return acquireFiles<T>(kind, std::vector<std::string>(1, path),
+                               [&](std::vector<std::vector<unsigned char>>& files) { return load(files[0]); });
+    }
+
+    // assets that are still referenced by at least one handle
+    unsigned int liveCount()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::unordered_set<const void*> live; // an asset cached under its path and its content counts once
+        for (std::unordered_map<uint64_t, std::weak_ptr<void>>::iterator entry = assets.begin(); entry != assets.end(); ++entry)
+        {
+            std::shared_ptr<void> asset = entry->second.lock();
+            if (asset)
+                live.insert(asset.get());
+        }
+        return (unsigned int)live.size();
+    }
+
+    void printStats()
+    {
+        unsigned int live = liveCount();
+        std::lock_guard<std::mutex> guard(lock);
+        std::printf("Assets: %u hits, %u content hits, %u misses, %u live\n", hits, contentHits, misses, live);
+    }
+
+private:
+    std::mutex lock;
+    std::unordered_map<uint64_t, std::weak_ptr<void>> assets;
+    unsigned int hits = 0, contentHits = 0, misses = 0;
+
+    AssetManager() {}
+};
+
+// shader program shared by everything that uses the same files, the program is deleted with the last handle
+// ------------------------------------------------------------------------
+inline ShaderHandle loadShaderAsset(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+{
+    std::string paths = std::string(vertexPath) + "|" + fragmentPath + "|" + (geometryPath ? geometryPath : "");
+    return AssetManager::instance().acquire<Shader>(assetPathKey("shader", paths), [&]() {
+        return ShaderHandle(new Shader(vertexPath, fragmentPath, geometryPath), [](Shader* shader) {
+            glDeleteProgram(shader->ID);
+            delete shader;
+        });
+    });
+}
+#endif
@@ -0,0 +1,274 @@
+// Frustum culling of the meshes of a model, through a bounding volume hierarchy over their bounds
+#ifndef FRUSTUM_CULLING_H
+#define FRUSTUM_CULLING_H
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// eight boxes are tested at once: in one AVX register when the compiler targets AVX (-mavx), in two SSE registers on
+// any other x86-64 build and one after the other elsewhere
+#if defined(__AVX__)
+#define FRUSTUM_CULLING_AVX 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_CULLING_SSE 1
+#include <emmintrin.h>
+#endif
+
+// the planes of the view frustum of a clip space transform, in the space it transforms from (model space for an MVP),
+// with unit normals pointing inside: a point p is inside a plane if dot(plane.xyz, p) + plane.w >= 0
+struct Frustum {
+    glm::vec4 planes[6];
+
+    explicit Frustum(const glm::mat4& clip)
+    {
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+        // left, right, bottom, top, near, far
+        for (int i = 0; i < 3; i++)
+        {
+            planes[2 * i] = rows[3] + rows[i];
+            planes[2 * i + 1] = rows[3] - rows[i];
+        }
+        for (glm::vec4& plane : planes)
+            plane /= glm::length(glm::vec3(plane));
+    }
+};
+
+// Built once per model over the bounds of its meshes: nodes split at the median of their mesh centers along the
+// longest axis until at most eight meshes remain, whose boxes and spheres the leaf keeps side by side (one array per
+// component) for the eight wide test. cull() walks the nodes with the planes that still cut them; a node inside all
+// of them takes its meshes without testing any.
+//
+// A mesh is outside a plane when its center is further behind it than the extent of its volume towards the plane.
+// That extent is the smaller of the sphere radius and the box's projection onto the normal, both bound the mesh.
+// Vertices a shader moves by up to displacement along each axis stay inside the volumes grown by it: the box's
+// extent by displacement, the sphere's radius by its length.
+class MeshBVH
+{
+public:
+    static const int LEAF_SIZE = 8;
+
+    // of the last cull()
+    unsigned int tested = 0, culled = 0;
+
+    void build(const std::vector<Mesh>& meshes)
+    {
+        PROFILE_FUNCTION();
+        nodes.clear();
+        leaves.clear();
+        order.resize(meshes.size());
+        bounds.resize(meshes.size());
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            order[i] = i;
+            bounds[i] = meshes[i].bounds;
+        }
+        if (!meshes.empty())
+            buildNode(0, (unsigned int)meshes.size());
+    }
+
+    // appends the indices of the meshes that are at least partly inside the frustum to visible, once the vertex
+    // shader moved their vertices by up to displacement
+    // ------------------------------------------------------------------------
+    void cull(const Frustum& frustum, std::vector<unsigned int>& visible, const glm::vec3& displacement = glm::vec3(0.0f))
+    {
+        PROFILE_FUNCTION();
+        size_t before = visible.size();
+        tested = (unsigned int)order.size();
+        Culling culling = { frustum, displacement, glm::length(displacement) };
+        if (!nodes.empty())
+            cullNode(0, culling, (1u << 6) - 1, visible);
+        culled = tested - (unsigned int)(visible.size() - before);
+    }
+
+private:
+    struct Node {
+        glm::vec3 lower, upper;
+        unsigned int first, count; // the meshes below, a range of order
+        int left, right; // children, -1 for a leaf
+        int leaf; // index into leaves
+    };
+
+    // the volumes of up to eight meshes, one array per component; unused lanes have a negative radius
+    struct Leaf {
+        float centerX[LEAF_SIZE], centerY[LEAF_SIZE], centerZ[LEAF_SIZE];
+        float extentX[LEAF_SIZE], extentY[LEAF_SIZE], extentZ[LEAF_SIZE];
+        float radius[LEAF_SIZE];
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Leaf> leaves;
+    std::vector<unsigned int> order; // mesh indices, every node covers a range
+    std::vector<MeshBounds> bounds;
+
+    struct Culling {
+        const Frustum& frustum;
+        glm::vec3 displacement;
+        float growth; // of the radius
+    };
+
+    int buildNode(unsigned int first, unsigned int count)
+    {
+        Node node;
+        node.first = first;
+        node.count = count;
+        node.left = node.right = node.leaf = -1;
+        node.lower = bounds[order[first]].lower;
+        node.upper = bounds[order[first]].upper;
+        glm::vec3 centerLower = bounds[order[first]].center(), centerUpper = centerLower;
+        for (unsigned int i = first + 1; i < first + count; i++)
+        {
+            const MeshBounds& box = bounds[order[i]];
+            node.lower = glm::min(node.lower, box.lower);
+            node.upper = glm::max(node.upper, box.upper);
+            centerLower = glm::min(centerLower, box.center());
+            centerUpper = glm::max(centerUpper, box.center());
+        }
+        int index = (int)nodes.size();
+        nodes.push_back(node);
+
+        if (count <= LEAF_SIZE)
+        {
+            Leaf leaf;
+            for (int lane = 0; lane < LEAF_SIZE; lane++)
+            {
+                MeshBounds box = lane < (int)count ? bounds[order[first + lane]] : MeshBounds();
+                glm::vec3 center = box.center(), extent = (box.upper - box.lower) * 0.5f;
+                leaf.centerX[lane] = center.x;
+                leaf.centerY[lane] = center.y;
+                leaf.centerZ[lane] = center.z;
+                leaf.extentX[lane] = extent.x;
+                leaf.extentY[lane] = extent.y;
+                leaf.extentZ[lane] = extent.z;
+                leaf.radius[lane] = lane < (int)count ? box.radius : -1.0f;
+            }
+            nodes[index].leaf = (int)leaves.size();
+            leaves.push_back(leaf);
+            return index;
+        }
+
+        glm::vec3 size = centerUpper - centerLower;
+        int axis = size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2);
+        unsigned int half = count / 2;
+        std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+                         [&](unsigned int a, unsigned int b) { return bounds[a].center()[axis] < bounds[b].center()[axis]; });
+        int left = buildNode(first, half);
+        int right = buildNode(first + half, count - half);
+        nodes[index].left = left;
+        nodes[index].right = right;
+        return index;
+    }
+
+    // planes is a bit mask of the planes the parent was not inside of
+    void cullNode(int index, const Culling& culling, unsigned int planes, std::vector<unsigned int>& visible)
+    {
+        const Node& node = nodes[index];
+        glm::vec3 center = (node.lower + node.upper) * 0.5f, extent = (node.upper - node.lower) * 0.5f + culling.displacement;
+        for (int p = 0; p < 6; p++)
+        {
+            if (!(planes & (1u << p)))
+                continue;
+            const glm::vec4& plane = culling.frustum.planes[p];
+            float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            float reach = glm::dot(glm::abs(glm::vec3(plane)), extent);
+            if (distance < -reach)
+                return;
+            if (distance >= reach)
+                planes &= ~(1u << p);
+        }
+        if (planes == 0)
+        {
+            visible.insert(visible.end(), order.begin() + node.first, order.begin() + node.first + node.count);
+            return;
+        }
+        if (node.leaf >= 0)
+        {
+            unsigned int outside = cullLeaf(leaves[node.leaf], culling, planes);
+            for (unsigned int lane = 0; lane < node.count; lane++)
+                if (!(outside & (1u << lane)))
+                    visible.push_back(order[node.first + lane]);
+            return;
+        }
+        cullNode(node.left, culling, planes, visible);
+        cullNode(node.right, culling, planes, visible);
+    }
+
+    // how much further the boxes reach towards a plane once displaced
+    static float slack(const glm::vec4& plane, const Culling& culling)
+    {
+        return glm::dot(glm::abs(glm::vec3(plane)), culling.displacement);
+    }
+
+    // a bit for every lane of the leaf that is outside one of the planes
+    static unsigned int cullLeaf(const Leaf& leaf, const Culling& culling, unsigned int planes)
+    {
+#if defined(FRUSTUM_CULLING_AVX)
+        __m256 cx = _mm256_loadu_ps(leaf.centerX), cy = _mm256_loadu_ps(leaf.centerY), cz = _mm256_loadu_ps(leaf.centerZ);
+        __m256 ex = _mm256_loadu_ps(leaf.extentX), ey = _mm256_loadu_ps(leaf.extentY), ez = _mm256_loadu_ps(leaf.extentZ);
+        __m256 radius = _mm256_add_ps(_mm256_loadu_ps(leaf.radius), _mm256_set1_ps(culling.growth));
+        __m256 outside = _mm256_setzero_ps();
+        for (int p = 0; p < 6; p++)
+        {
+            if (!(planes & (1u << p)))
+                continue;
+            const glm::vec4& plane = culling.frustum.planes[p];
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), cx), _mm256_mul_ps(_mm256_set1_ps(plane.y), cy)),
+                                            _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), cz), _mm256_set1_ps(plane.w)));
+            __m256 reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(std::abs(plane.x)), ex),
+                                                       _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.y)), ey)),
+                                         _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.z)), ez));
+            reach = _mm256_min_ps(_mm256_add_ps(reach, _mm256_set1_ps(slack(plane, culling))), radius);
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+        return (unsigned int)_mm256_movemask_ps(outside);
+#elif defined(FRUSTUM_CULLING_SSE)
+        unsigned int outsideMask = 0;
+        for (int half = 0; half < LEAF_SIZE; half += 4)
+        {
+            __m128 cx = _mm_loadu_ps(leaf.centerX + half), cy = _mm_loadu_ps(leaf.centerY + half), cz = _mm_loadu_ps(leaf.centerZ + half);
+            __m128 ex = _mm_loadu_ps(leaf.extentX + half), ey = _mm_loadu_ps(leaf.extentY + half), ez = _mm_loadu_ps(leaf.extentZ + half);
+            __m128 radius = _mm_add_ps(_mm_loadu_ps(leaf.radius + half), _mm_set1_ps(culling.growth));
+            __m128 outside = _mm_setzero_ps();
+            for (int p = 0; p < 6; p++)
+            {
+                if (!(planes & (1u << p)))
+                    continue;
+                const glm::vec4& plane = culling.frustum.planes[p];
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), cx), _mm_mul_ps(_mm_set1_ps(plane.y), cy)),
+                                             _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), cz), _mm_set1_ps(plane.w)));
+                __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::abs(plane.x)), ex),
+                                                     _mm_mul_ps(_mm_set1_ps(std::abs(plane.y)), ey)),
+                                          _mm_mul_ps(_mm_set1_ps(std::abs(plane.z)), ez));
+                reach = _mm_min_ps(_mm_add_ps(reach, _mm_set1_ps(slack(plane, culling))), radius);
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+            }
+            outsideMask |= (unsigned int)_mm_movemask_ps(outside) << half;
+        }
+        return outsideMask;
+#else
+        unsigned int outsideMask = 0;
+        for (int lane = 0; lane < LEAF_SIZE; lane++)
+            for (int p = 0; p < 6; p++)
+            {
+                if (!(planes & (1u << p)))
+                    continue;
+                const glm::vec4& plane = culling.frustum.planes[p];
+                float distance = plane.x * leaf.centerX[lane] + plane.y * leaf.centerY[lane] + plane.z * leaf.centerZ[lane] + plane.w;
+                float reach = std::abs(plane.x) * leaf.extentX[lane] + std::abs(plane.y) * leaf.extentY[lane] +
+                              std::abs(plane.z) * leaf.extentZ[lane];
+                if (distance + std::min(reach + slack(plane, culling), leaf.radius[lane] + culling.growth) < 0.0f)
+                    outsideMask |= 1u << lane;
+            }
+        return outsideMask;
+#endif
+    }
+};
+#endif
@@ -0,0 +1,215 @@
+// Vertex and index buffers shared by many meshes, so they draw from one vertex array
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// one attribute of a vertex layout, the arguments of glVertexAttribPointer
+struct VertexAttribute {
+    GLuint location;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    GLuint offset;
+};
+
+// first fit over the free ranges of a buffer, in elements; neighbouring free ranges are joined
+class RangeAllocator
+{
+public:
+    size_t capacity = 0, used = 0;
+
+    // the first element of count free ones, capacity or more if the buffer has to grow first
+    size_t allocate(size_t count)
+    {
+        for (size_t i = 0; i < freeRanges.size(); i++)
+        {
+            Range& range = freeRanges[i];
+            if (range.count < count)
+                continue;
+            size_t first = range.first;
+            range.first += count;
+            range.count -= count;
+            if (range.count == 0)
+                freeRanges.erase(freeRanges.begin() + i);
+            used += count;
+            return first;
+        }
+        // at the end, joined with a free range that reaches the end
+        size_t first = capacity;
+        if (!freeRanges.empty() && freeRanges.back().first + freeRanges.back().count == capacity)
+        {
+            first = freeRanges.back().first;
+            freeRanges.pop_back();
+        }
+        capacity = first + count;
+        used += count;
+        return first;
+    }
+
+    void free(size_t first, size_t count)
+    {
+        if (count == 0)
+            return;
+        used -= count;
+        Range range = { first, count };
+        std::vector<Range>::iterator next = std::lower_bound(freeRanges.begin(), freeRanges.end(), range,
+            [](const Range& a, const Range& b) { return a.first < b.first; });
+        next = freeRanges.insert(next, range);
+        if (next + 1 != freeRanges.end() && next->first + next->count == (next + 1)->first)
+        {
+            next->count += (next + 1)->count;
+            freeRanges.erase(next + 1);
+        }
+        if (next != freeRanges.begin() && (next - 1)->first + (next - 1)->count == next->first)
+        {
+            (next - 1)->count += next->count;
+            freeRanges.erase(next);
+        }
+    }
+
+private:
+    struct Range {
+        size_t first, count;
+    };
+    std::vector<Range> freeRanges; // sorted by first
+};
+
+// The vertices of many meshes in one buffer and their indices in another, behind one vertex array. A mesh is a range
+// of each: its indices are relative to its first vertex (drawn with base vertex) and start at firstIndex, so meshes
+// of any size share the 16 bit index arena. The buffers double when they run out, the copy is done by the GPU and
+// the vertex array is pointed at the new ones, the ranges stay valid.
+//
+// Besides the vertex attributes the vertex array has attributes 5 and 6 (vec3 DrawPositionOffset and
+// DrawPositionScale) at binding 1 with a divisor of 1: a multi-draw selects the record of each draw through its base
+// instance, see RenderQueue. Until a queue binds its records there, binding 1 holds the identity decode.
+class GeometryArena
+{
+public:
+    // per-draw record of binding 1
+    struct DrawRecord {
+        float positionOffset[3];
+        float positionScale[3];
+    };
+
+    GeometryArena(const std::vector<VertexAttribute>& attributes, GLsizei vertexSize, GLenum indexType)
+        : attributes(attributes), vertexSize(vertexSize), indexType(indexType),
+          indexSize(indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int))
+    {
+    }
+
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    GLuint vertexArray() const { return VAO; }
+    GLuint vertexBuffer() const { return VBO; }
+    GLuint indexBuffer() const { return EBO; }
+    GLenum indices() const { return indexType; }
+    size_t vertexCount() const { return vertices.used; }
+    size_t indexCount() const { return indexRanges.used; }
+    size_t bufferSize() const { return vertexBytes + indexBytes; }
+
+    // ranges for a mesh, the buffers grow if they have to
+    // ------------------------------------------------------------------------
+    void allocate(size_t vertexCount, size_t indexCount, GLint& baseVertex, GLuint& firstIndex)
+    {
+        PROFILE_FUNCTION();
+        if (!VAO)
+            create();
+        baseVertex = (GLint)vertices.allocate(vertexCount);
+        firstIndex = (GLuint)indexRanges.allocate(indexCount);
+        reserve(VBO, vertexBytes, vertices.capacity * vertexSize);
+        reserve(EBO, indexBytes, indexRanges.capacity * indexSize);
+    }
+
+    void free(size_t vertexCount, size_t indexCount, GLint baseVertex, GLuint firstIndex)
+    {
+        vertices.free((size_t)baseVertex, vertexCount);
+        indexRanges.free((size_t)firstIndex, indexCount);
+    }
+
+    // deletes the buffers while the context is current, the ranges handed out are invalid afterwards
+    void release()
+    {
+        if (!VAO)
+            return;
+        glDeleteVertexArrays(1, &VAO);
+        GLuint buffers[3] = { VBO, EBO, identityRecord };
+        glDeleteBuffers(3, buffers);
+        VAO = VBO = EBO = identityRecord = 0;
+        vertexBytes = indexBytes = 0;
+        vertices = RangeAllocator();
+        indexRanges = RangeAllocator();
+    }
+
+private:
+    std::vector<VertexAttribute> attributes;
+    GLsizei vertexSize;
+    GLenum indexType;
+    size_t indexSize;
+    GLuint VAO = 0, VBO = 0, EBO = 0, identityRecord = 0;
+    size_t vertexBytes = 0, indexBytes = 0; // allocated, at least what the allocators need
+    RangeAllocator vertices, indexRanges;
+
+    void create()
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glGenBuffers(1, &identityRecord);
+        DrawRecord identity = { { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f } };
+        glBindBuffer(GL_ARRAY_BUFFER, identityRecord);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(identity), &identity, GL_STATIC_DRAW);
+
+        glBindVertexArray(VAO);
+        for (const VertexAttribute& attribute : attributes)
+        {
+            glEnableVertexAttribArray(attribute.location);
+            glVertexAttribFormat(attribute.location, attribute.size, attribute.type, attribute.normalized, attribute.offset);
+            glVertexAttribBinding(attribute.location, 0);
+        }
+        glEnableVertexAttribArray(5);
+        glVertexAttribFormat(5, 3, GL_FLOAT, GL_FALSE, offsetof(DrawRecord, positionOffset));
+        glVertexAttribBinding(5, 1);
+        glEnableVertexAttribArray(6);
+        glVertexAttribFormat(6, 3, GL_FLOAT, GL_FALSE, offsetof(DrawRecord, positionScale));
+        glVertexAttribBinding(6, 1);
+        glVertexBindingDivisor(1, 1);
+        glBindVertexBuffer(1, identityRecord, 0, sizeof(DrawRecord));
+        glBindVertexArray(0);
+    }
+
+    // grows buffer to hold needed bytes, by doubling, keeping its contents
+    void reserve(GLuint& buffer, size_t& allocated, size_t needed)
+    {
+        if (needed <= allocated)
+            return;
+        size_t size = std::max(needed, allocated * 2);
+        GLuint grown;
+        glGenBuffers(1, &grown);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+        glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STATIC_DRAW);
+        if (allocated)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, allocated);
+        }
+        glDeleteBuffers(1, &buffer);
+        buffer = grown;
+        allocated = size;
+
+        glBindVertexArray(VAO);
+        if (&buffer == &VBO)
+            glBindVertexBuffer(0, VBO, 0, vertexSize);
+        else
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBindVertexArray(0);
+    }
+};
+#endif
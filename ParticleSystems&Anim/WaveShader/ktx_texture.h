@@ -0,0 +1,167 @@
+// KTX2 files with block compressed mip chains, written offline by tools/TextureCompressor
+#ifndef KTX_TEXTURE_H
+#define KTX_TEXTURE_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "profiler.h"
+
+// S3TC is not part of core GL, every desktop driver exposes it through EXT_texture_compression_s3tc
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+// Only what the tool writes is read back: one 2D image (no array layers, faces or depth) with a full or partial mip
+// chain in one of the formats below, without supercompression. The levels are block compressed already, so loading
+// is a copy into glCompressedTexImage2D; the GPU keeps them compressed, 4 to 8 times smaller than RGBA8.
+const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// the Vulkan format numbers KTX2 uses to name them
+enum Ktx2Format {
+    KTX2_BC1_RGB_UNORM = 131,
+    KTX2_BC1_RGB_SRGB = 132,
+    KTX2_BC3_UNORM = 137,
+    KTX2_BC3_SRGB = 138,
+    KTX2_BC4_UNORM = 139,
+    KTX2_BC5_UNORM = 141,
+    KTX2_BC7_UNORM = 145,
+    KTX2_BC7_SRGB = 146
+};
+
+struct Ktx2Header {
+    unsigned char identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize; // 1 for block compressed formats
+    uint32_t pixelWidth, pixelHeight, pixelDepth;
+    uint32_t layerCount, faceCount, levelCount;
+    uint32_t supercompressionScheme;
+    // index
+    uint32_t dfdByteOffset, dfdByteLength; // data format descriptor
+    uint32_t kvdByteOffset, kvdByteLength; // key/value data
+    uint64_t sgdByteOffset, sgdByteLength; // supercompression global data
+};
+
+// follows the header, one per level starting with level 0; the data itself is stored smallest level first
+struct Ktx2Level {
+    uint64_t byteOffset, byteLength, uncompressedByteLength;
+};
+
+// GL internal format and bytes per 4x4 block of a format, false if the loader does not know it
+inline bool ktx2GLFormat(uint32_t vkFormat, GLenum& internalFormat, unsigned int& blockBytes)
+{
+    blockBytes = 16;
+    switch (vkFormat)
+    {
+    case KTX2_BC1_RGB_UNORM: internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT; blockBytes = 8; return true;
+    case KTX2_BC1_RGB_SRGB: internalFormat = GL_COMPRESSED_SRGB_S3TC_DXT1_EXT; blockBytes = 8; return true;
+    case KTX2_BC3_UNORM: internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; return true;
+    case KTX2_BC3_SRGB: internalFormat = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT; return true;
+    case KTX2_BC4_UNORM: internalFormat = GL_COMPRESSED_RED_RGTC1; blockBytes = 8; return true;
+    case KTX2_BC5_UNORM: internalFormat = GL_COMPRESSED_RG_RGTC2; return true;
+    case KTX2_BC7_UNORM: internalFormat = GL_COMPRESSED_RGBA_BPTC_UNORM; return true;
+    case KTX2_BC7_SRGB: internalFormat = GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM; return true;
+    }
+    return false;
+}
+
+// bytes of a level of width x height texels in 4x4 blocks
+inline size_t ktx2LevelSize(int width, int height, unsigned int blockBytes)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+}
+
+struct Ktx2Image {
+    GLenum internalFormat;
+    unsigned int blockBytes;
+    int width, height;
+    std::vector<const unsigned char*> levels; // point into the file, level 0 first
+    std::vector<size_t> levelSizes;
+};
+
+// checks the header and the level index of a KTX2 file in memory, the levels of image point into data
+// ------------------------------------------------------------------------
+inline bool parseKtx2(const unsigned char* data, size_t size, Ktx2Image& image)
+{
+    if (size < sizeof(Ktx2Header))
+        return false;
+    Ktx2Header header;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0 ||
+        !ktx2GLFormat(header.vkFormat, image.internalFormat, image.blockBytes) || header.pixelWidth == 0 ||
+        header.pixelHeight == 0 || header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1 ||
+        header.supercompressionScheme != 0)
+        return false;
+
+    unsigned int levelCount = header.levelCount > 0 ? header.levelCount : 1;
+    if (levelCount > 32 || sizeof(Ktx2Header) + levelCount * sizeof(Ktx2Level) > size)
+        return false;
+    image.width = (int)header.pixelWidth;
+    image.height = (int)header.pixelHeight;
+    image.levels.clear();
+    image.levelSizes.clear();
+    int width = image.width, height = image.height;
+    for (unsigned int i = 0; i < levelCount; i++)
+    {
+        Ktx2Level level;
+        std::memcpy(&level, data + sizeof(Ktx2Header) + i * sizeof(Ktx2Level), sizeof(level));
+        if (level.byteLength != ktx2LevelSize(width, height, image.blockBytes) || level.byteOffset > size ||
+            level.byteLength > size - level.byteOffset)
+            return false;
+        image.levels.push_back(data + level.byteOffset);
+        image.levelSizes.push_back((size_t)level.byteLength);
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    return true;
+}
+
+inline void setCompressedTextureParameters(unsigned int levelCount)
+{
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levelCount - 1); // a partial chain is complete too
+}
+
+// uploads every level of a parsed file into textureID, on the GL thread
+// ------------------------------------------------------------------------
+inline void uploadCompressedTexture2D(unsigned int textureID, const Ktx2Image& image)
+{
+    PROFILE_FUNCTION();
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    int width = image.width, height = image.height;
+    for (unsigned int i = 0; i < image.levels.size(); i++)
+    {
+        glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, image.internalFormat, width, height, 0, (GLsizei)image.levelSizes[i],
+                               image.levels[i]);
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    setCompressedTextureParameters((unsigned int)image.levels.size());
+}
+
+// the compressed version of an image file next to it, "car/BodyAlbedo.png" -> "car/BodyAlbedo.ktx2", or an empty
+// string if there is none
+// ------------------------------------------------------------------------
+inline std::string compressedTexturePath(const std::string& filename)
+{
+    size_t slash = filename.find_last_of("/\\");
+    size_t dot = filename.find_last_of('.');
+    std::string path = (dot == std::string::npos || (slash != std::string::npos && dot < slash) ? filename : filename.substr(0, dot)) + ".ktx2";
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 ? path : std::string();
+}
+#endif
@@ -1,11 +1,19 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <string>
 #include <vector>
 
 #include "shader.h"
 #include "camera.h"
 #include "model.h"
+#include "model_stream.h"
+#include "render_queue.h"
+#include "headless.h"
+#include "profiler.h"
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -30,9 +38,38 @@ const unsigned int SCR_HEIGHT = 720;
 
 // global variables used for rendering
 // -----------------------------------
-Shader* shader;
-Shader* wave_shading;
-Model* floorModel;
+ShaderHandle shader;
+ShaderHandle wave_shading;
+// locations of the uniforms the frame sets, looked up once the shader is loaded
+struct FrameUniforms {
+    GLint Time, ModelViewMatrix, NormalMatrix, MVP;
+} frameUniforms;
+glm::vec3 waveDisplacement; // how far wave.vert can move a vertex of the floor, grows its meshes for culling
+RenderQueue renderQueue; // sorts the draws of the meshes, see render_queue.h
+bool useRenderQueue = true;
+bool useCulling = true; // submit only the floor meshes in the view frustum, see frustum_culling.h
+// meshes the frustum test saw and rejected, in the last frame and over the run
+struct CullingStats {
+    unsigned int lastTested = 0, lastCulled = 0;
+    unsigned long long tested = 0, culled = 0;
+
+    void add(const MeshBVH& bvh)
+    {
+        lastTested = bvh.tested;
+        lastCulled = bvh.culled;
+        tested += bvh.tested;
+        culled += bvh.culled;
+    }
+
+    void print() const
+    {
+        std::printf("Culling: %u of %u meshes culled in the last frame, %.1f%% of %llu tested over the run\n", lastCulled,
+                    lastTested, tested ? 100.0 * culled / tested : 0.0, tested);
+    }
+} cullingStats;
+bool mergeGeometry = false; // draw the floor from the shared geometry arena, see Model::mergeGeometry()
+ModelStream* floorStream = NULL; // the floor model, streamed in while the render loop runs
+std::shared_ptr<Model> floorModel; // set once the stream is ready
 Camera camera(glm::vec3(0.0f, 1.6f, 5.0f));
 
 // global variables used for control
@@ -57,49 +94,102 @@ struct Config {
 
 
 
-int main()
+int main(int argc, char** argv)
 {
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // uncomment this statement to fix compilation on OS X
-#endif
+    // --headless [frames] renders offscreen at a fixed timestep and prints frame statistics, see headless.h
+    HeadlessRun headless;
+    headless.parseArgs(argc, argv);
+    // --trace path writes the CPU zones of the run as Chrome trace JSON on exit, see profiler.h
+    std::string tracePath;
+    for (int i = 1; i + 1 < argc; i++)
+        if (std::strcmp(argv[i], "--trace") == 0)
+            tracePath = argv[++i];
+    // --load-frame N starts loading the floor at frame N, --sync-load loads it in one go like before, for comparison
+    // --compact-vertices uploads it in the quantized vertex layout, see PackedVertex in mesh.h
+    // --no-program-cache compiles every shader instead of loading the binaries of the last run, see program_cache.h
+    // --no-render-queue draws the meshes in import order, binding everything every draw, for comparison
+    // --merge-geometry moves the floor meshes into one shared buffer once loaded, drawn by one multi-draw
+    // --no-culling submits every floor mesh to the render queue, also those outside the view frustum
+    int loadFrame = 0;
+    bool syncLoad = false;
+    VertexLayout floorLayout = VERTEX_FULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--load-frame") == 0 && i + 1 < argc)
+            loadFrame = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--sync-load") == 0)
+            syncLoad = true;
+        else if (std::strcmp(argv[i], "--compact-vertices") == 0)
+            floorLayout = VERTEX_COMPACT;
+        else if (std::strcmp(argv[i], "--no-program-cache") == 0)
+            ProgramCache::shared().enabled = false;
+        else if (std::strcmp(argv[i], "--no-render-queue") == 0)
+            useRenderQueue = false;
+        else if (std::strcmp(argv[i], "--merge-geometry") == 0)
+            mergeGeometry = true;
+        else if (std::strcmp(argv[i], "--no-culling") == 0)
+            useCulling = false;
+    }
+    PROFILE_THREAD_NAME("main");
 
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Exercise 5", NULL, NULL);
-    if (window == NULL)
+    GLFWwindow* window = NULL;
+    if (headless.enabled)
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+        if (!headless.init(SCR_WIDTH, SCR_HEIGHT, 4, 3))
+            return -1;
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, cursor_input_callback);
-    glfwSetKeyCallback(window, key_input_callback);
-    glfwSetScrollCallback(window, scroll_callback);
+    else
+    {
+        // glfw: initialize and configure
+        // ------------------------------
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // uncomment this statement to fix compilation on OS X
+#endif
 
-    // glad: load all OpenGL function pointers
-    // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+        // glfw window creation
+        // --------------------
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Exercise 5", NULL, NULL);
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetCursorPosCallback(window, cursor_input_callback);
+        glfwSetKeyCallback(window, key_input_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+        // glad: load all OpenGL function pointers
+        // ---------------------------------------
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
     }
 
     // load the shaders and the 3D models
     // ----------------------------------
-    floorModel = new Model("floor/floor.obj");
-    wave_shading = new Shader("shaders/wave.vert", "shaders/wave.frag");
+    wave_shading = loadShaderAsset("shaders/wave.vert", "shaders/wave.frag");
     shader = wave_shading;
+    frameUniforms.Time = shader->uniform("Time");
+    frameUniforms.ModelViewMatrix = shader->uniform("ModelViewMatrix");
+    frameUniforms.NormalMatrix = shader->uniform("NormalMatrix");
+    frameUniforms.MVP = shader->uniform("MVP");
+    // the wave sets y to A * sin(...), the floor lies at y = 0
+    float amplitude = 0.0f;
+    glGetUniformfv(shader->ID, shader->uniform("A"), &amplitude);
+    waveDisplacement = glm::vec3(0.0f, glm::abs(amplitude), 0.0f);
+    renderQueue.init(headless.enabled ? headless.procAddress() : (GLADloadproc)glfwGetProcAddress);
 
     // set up the z-buffer
     // -------------------
@@ -110,28 +200,77 @@ int main()
 
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window))
+    int frame = 0;
+    while (headless.enabled ? headless.nextFrame() : !glfwWindowShouldClose(window))
     {
+        PROFILE_ZONE("frame");
+        if (frame++ == loadFrame)
+        {
+            if (syncLoad)
+                floorModel = loadModelAsset("floor/floor.obj", false, floorLayout);
+            else
+                floorStream = new ModelStream("floor/floor.obj", false, floorLayout);
+        }
+        if (floorStream && !floorModel)
+        {
+            floorStream->update();
+            floorModel = floorStream->get();
+        }
+        static bool floorMerged = false;
+        if (floorModel && mergeGeometry && !floorMerged)
+        {
+            floorModel->mergeGeometry();
+            floorMerged = true;
+        }
+
         static float lastFrame = 0.0f;
-        float currentFrame = (float)glfwGetTime();
+        float currentFrame = headless.enabled ? headless.time() : (float)glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
-        shader->setFloat("Time", currentFrame);		
-		
-        processInput(window);
+        if (!headless.enabled)
+            processInput(window);
 
         glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         shader->use();
+        shader->setFloat(frameUniforms.Time, currentFrame);
 
         drawObjects();
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (!headless.enabled)
+        {
+            PROFILE_ZONE("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
     }
 
+    // release the assets while the context is still current, the last handle deletes the GL objects
+    // -----------------------------------------------------------------------------------------------
+    AssetManager::instance().printStats();
+    ProgramCache::shared().printStats();
+    if (useRenderQueue)
+        renderQueue.printStats();
+    if (useRenderQueue && useCulling)
+        cullingStats.print();
+    if (floorModel)
+        std::printf("Floor: %u meshes, %.1f KB of vertices and indices\n", (unsigned int)floorModel->meshes.size(),
+                    floorModel->bufferSize() / 1024.0);
+    printSharedArenaStats();
+    renderQueue.release();
+    shader.reset();
+    wave_shading.reset();
+    floorModel.reset();
+    delete floorStream;
+    releaseSharedArenas();
+
+    if (headless.enabled)
+        headless.finish();
+    if (!tracePath.empty())
+        profilerWriteChromeTrace(tracePath);
+
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
@@ -139,6 +278,7 @@ int main()
 }
 
 void drawObjects() {
+    PROFILE_FUNCTION();
 
     // camera parameters
     glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
@@ -148,15 +288,25 @@ void drawObjects() {
 	glm::mat4 mvp = projection * view * model;
 
 	// draw the floor
-	shader->setMat4("ModelViewMatrix", mv);
-	shader->setMat3("NormalMatrix", glm::mat3(glm::vec3(mv[0]), glm::vec3(mv[1]), glm::vec3(mv[2])));
-	shader->setMat4("MVP", mvp);
+	shader->setMat4(frameUniforms.ModelViewMatrix, mv);
+	shader->setMat3(frameUniforms.NormalMatrix, glm::mat3(glm::vec3(mv[0]), glm::vec3(mv[1]), glm::vec3(mv[2])));
+	shader->setMat4(frameUniforms.MVP, mvp);
 
-    floorModel->Draw(*shader);
+    if (floorModel && useRenderQueue)
+    {
+        floorModel->submit(renderQueue, *shader, mvp, useCulling, waveDisplacement);
+        cullingStats.add(floorModel->bvh);
+        renderQueue.flush();
+    }
+    else if (floorModel)
+        floorModel->Draw(*shader);
+    else if (floorStream)
+        floorStream->drawPlaceholder(mvp);
 }
 
 
 void processInput(GLFWwindow* window) {
+    PROFILE_FUNCTION();
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
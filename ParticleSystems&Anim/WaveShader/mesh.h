@@ -5,9 +5,14 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include <shader.h>
+#include <asset_manager.h>
+#include <geometry_arena.h>
+#include <render_queue.h>
 
+#include <cstdio>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -28,10 +33,190 @@ struct Vertex {
     glm::vec3 Bitangent;
 };
 
+// Compact layout, 20 bytes instead of 56. Positions are stored relative to the bounds of their mesh, Mesh::Draw()
+// sets the uniforms PositionOffset and PositionScale to decode them (0 and 1 for the full layout, so a shader can
+// always apply them). The normal and the tangent are octahedral encoded, the bitangent is rebuilt from them:
+//   vec3 octDecode(vec2 e) { vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+//                            if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * sign(n.xy); return normalize(n); }
+//   position = PositionOffset + VertexPosition * PositionScale;
+//   bitangent = cross(normal, tangent) * (BitangentSign * 2.0 - 1.0);
+// with the attributes at the same locations as Vertex: 0 position, 1 normal, 2 texCoords, 3 tangent and
+// 4 the bitangent sign (0 or 1).
+struct PackedVertex {
+    unsigned short Position[3]; // unorm within the mesh bounds
+    unsigned short BitangentSign; // 0 if the bitangent is -cross(normal, tangent), 65535 otherwise
+    short Normal[2]; // snorm, octahedral
+    unsigned short TexCoords[2]; // half float
+    short Tangent[2]; // snorm, octahedral
+};
+
+enum VertexLayout { VERTEX_FULL, VERTEX_COMPACT };
+
+// the attributes of a layout, the compact one at the locations of the full one
+inline vector<VertexAttribute> vertexAttributes(VertexLayout layout)
+{
+    if (layout == VERTEX_COMPACT)
+        return {
+            { 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedVertex, Position) },
+            { 1, 2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, Normal) },
+            { 2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, TexCoords) },
+            { 3, 2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, Tangent) },
+            { 4, 1, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedVertex, BitangentSign) },
+        };
+    return {
+        { 0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Position) }, // vertex Positions
+        { 1, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Normal) }, // vertex normals
+        { 2, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, TexCoords) }, // vertex texture coords
+        { 3, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Tangent) }, // vertex tangent
+        { 4, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Bitangent) }, // vertex bitangent
+    };
+}
+
+inline GLsizei vertexSize(VertexLayout layout)
+{
+    return layout == VERTEX_COMPACT ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+// the arena meshes of a layout and index type are merged into, see Mesh::moveToArena()
+inline GeometryArena& sharedArena(VertexLayout layout, GLenum indexType)
+{
+    static GeometryArena arenas[4] = {
+        { vertexAttributes(VERTEX_FULL), vertexSize(VERTEX_FULL), GL_UNSIGNED_SHORT },
+        { vertexAttributes(VERTEX_FULL), vertexSize(VERTEX_FULL), GL_UNSIGNED_INT },
+        { vertexAttributes(VERTEX_COMPACT), vertexSize(VERTEX_COMPACT), GL_UNSIGNED_SHORT },
+        { vertexAttributes(VERTEX_COMPACT), vertexSize(VERTEX_COMPACT), GL_UNSIGNED_INT },
+    };
+    return arenas[(layout == VERTEX_COMPACT ? 2 : 0) + (indexType == GL_UNSIGNED_INT ? 1 : 0)];
+}
+
+// what the arenas hold, the ones that were never used are left out
+inline void printSharedArenaStats()
+{
+    const char* names[4] = { "full/16", "full/32", "compact/16", "compact/32" };
+    for (int i = 0; i < 4; i++)
+    {
+        GeometryArena& arena = sharedArena(i >= 2 ? VERTEX_COMPACT : VERTEX_FULL, i % 2 ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT);
+        if (arena.vertexArray())
+            std::printf("Geometry arena %s: %zu vertices, %zu indices, %.1f KB of buffers\n", names[i], arena.vertexCount(),
+                        arena.indexCount(), arena.bufferSize() / 1024.0);
+    }
+}
+
+// deletes the buffers of the arenas while the context is still current, after the meshes in them
+inline void releaseSharedArenas()
+{
+    for (int i = 0; i < 4; i++)
+        sharedArena(i >= 2 ? VERTEX_COMPACT : VERTEX_FULL, i % 2 ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT).release();
+}
+
+// axis aligned box around the positions of a mesh in model space, and the sphere around its center that holds every
+// vertex (often tighter than the box's corners)
+struct MeshBounds {
+    glm::vec3 lower = glm::vec3(0.0f), upper = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    glm::vec3 center() const { return (lower + upper) * 0.5f; }
+};
+
+inline MeshBounds meshBounds(const Vertex* vertices, size_t vertexCount)
+{
+    MeshBounds bounds;
+    if (vertexCount)
+        bounds.lower = bounds.upper = vertices[0].Position;
+    for (size_t i = 1; i < vertexCount; i++)
+    {
+        bounds.lower = glm::min(bounds.lower, vertices[i].Position);
+        bounds.upper = glm::max(bounds.upper, vertices[i].Position);
+    }
+    glm::vec3 center = bounds.center();
+    float radius2 = 0.0f;
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        glm::vec3 d = vertices[i].Position - center;
+        radius2 = glm::max(radius2, glm::dot(d, d));
+    }
+    bounds.radius = glm::sqrt(radius2);
+    return bounds;
+}
+
+// a mesh in the compact layout, with 16 bit indices when it has at most 65536 vertices
+struct PackedMesh {
+    vector<PackedVertex> vertices;
+    vector<unsigned short> shortIndices;
+    vector<unsigned int> indices; // if shortIndices cannot hold them
+    glm::vec3 positionOffset, positionScale;
+
+    const void* indexData() const { return shortIndices.empty() ? (const void*)indices.data() : shortIndices.data(); }
+    size_t indexCount() const { return shortIndices.empty() ? indices.size() : shortIndices.size(); }
+    GLenum indexType() const { return shortIndices.empty() ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT; }
+};
+
+// unit vector to the octahedron, folded into [-1, 1]^2 and stored as two snorm shorts
+inline void packOctahedral(glm::vec3 v, short* out)
+{
+    float length = glm::abs(v.x) + glm::abs(v.y) + glm::abs(v.z);
+    glm::vec2 e = length > 0.0f ? glm::vec2(v.x, v.y) / length : glm::vec2(0.0f);
+    if (length > 0.0f && v.z < 0.0f)
+        e = (1.0f - glm::abs(glm::vec2(e.y, e.x))) * glm::vec2(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+    out[0] = (short)glm::round(glm::clamp(e.x, -1.0f, 1.0f) * 32767.0f);
+    out[1] = (short)glm::round(glm::clamp(e.y, -1.0f, 1.0f) * 32767.0f);
+}
+
+inline void packMesh(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount, PackedMesh& packed)
+{
+    PROFILE_FUNCTION();
+    MeshBounds bounds = meshBounds(vertices, vertexCount);
+    glm::vec3 lower = bounds.lower, upper = bounds.upper;
+    packed.positionOffset = lower;
+    packed.positionScale = upper - lower;
+    glm::vec3 inverseScale;
+    for (int c = 0; c < 3; c++)
+        inverseScale[c] = packed.positionScale[c] > 0.0f ? 1.0f / packed.positionScale[c] : 0.0f;
+
+    packed.vertices.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        const Vertex& vertex = vertices[i];
+        PackedVertex& out = packed.vertices[i];
+        glm::vec3 position = glm::clamp((vertex.Position - lower) * inverseScale, 0.0f, 1.0f);
+        for (int c = 0; c < 3; c++)
+            out.Position[c] = (unsigned short)glm::round(position[c] * 65535.0f);
+        bool rightHanded = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) >= 0.0f;
+        out.BitangentSign = rightHanded ? 65535 : 0;
+        packOctahedral(vertex.Normal, out.Normal);
+        packOctahedral(vertex.Tangent, out.Tangent);
+        out.TexCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+        out.TexCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+    }
+
+    packed.shortIndices.clear();
+    packed.indices.clear();
+    if (vertexCount <= 65536)
+        packed.shortIndices.assign(indices, indices + indexCount);
+    else
+        packed.indices.assign(indices, indices + indexCount);
+}
+
 struct Texture {
     unsigned int id;
     string type;
     string path;
+    TextureHandle object; // keeps the GL texture alive while a mesh uses it, see AssetManager
+};
+
+// a mesh before it is uploaded: the data an import produced, or pointers into a mapped mesh cache
+struct MeshData {
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    const Vertex* cachedVertices = nullptr; // used instead of the vectors when set
+    const unsigned int* cachedIndices = nullptr;
+    size_t cachedVertexCount = 0, cachedIndexCount = 0;
+    vector<Texture> textures; // type and path only, the GL textures are made with the mesh
+
+    const Vertex* vertexData() const { return cachedVertices ? cachedVertices : vertices.data(); }
+    size_t vertexCount() const { return cachedVertices ? cachedVertexCount : vertices.size(); }
+    const unsigned int* indexData() const { return cachedIndices ? cachedIndices : indices.data(); }
+    size_t indexCount() const { return cachedIndices ? cachedIndexCount : indices.size(); }
 };
 
 class Mesh {
@@ -41,6 +226,12 @@ public:
     vector<unsigned int> indices;
     vector<Texture> textures;
     unsigned int VAO;
+    unsigned int vertexCount;
+    unsigned int indexCount;
+    GLenum indexType; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    VertexLayout layout;
+    glm::vec3 positionOffset, positionScale; // decode the positions of the compact layout, see PackedVertex
+    MeshBounds bounds;
 
     /*  Functions  */
     // constructor
@@ -49,57 +240,195 @@ public:
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        bounds = meshBounds(this->vertices.data(), this->vertices.size());
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size(), GL_UNSIGNED_INT, VERTEX_FULL);
+    }
+
+    // constructor for data the mesh does not keep, e.g. a mapped mesh cache. vertices and indices stay empty.
+    // The compact layout is packed here, see PackedVertex.
+    Mesh(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount, vector<Texture> textures,
+         VertexLayout layout = VERTEX_FULL)
+    {
+        this->textures = textures;
+        bounds = meshBounds(vertices, vertexCount);
+        if (layout == VERTEX_COMPACT)
+        {
+            PackedMesh packed;
+            packMesh(vertices, vertexCount, indices, indexCount, packed);
+            positionOffset = packed.positionOffset;
+            positionScale = packed.positionScale;
+            setupMesh(packed.vertices.data(), vertexCount, packed.indexData(), indexCount, packed.indexType(), layout);
+        }
+        else
+            setupMesh(vertices, vertexCount, indices, indexCount, GL_UNSIGNED_INT, layout);
+    }
+
+    // constructor for streaming: the buffers are only allocated, their contents are copied in later (see ModelStream).
+    // A compact mesh takes the decode values of its PackedMesh.
+    Mesh(size_t vertexCount, size_t indexCount, vector<Texture> textures, const MeshBounds& bounds, VertexLayout layout = VERTEX_FULL,
+         GLenum indexType = GL_UNSIGNED_INT, glm::vec3 positionOffset = glm::vec3(0.0f), glm::vec3 positionScale = glm::vec3(1.0f))
+    {
+        this->textures = textures;
+        this->bounds = bounds;
+        this->positionOffset = positionOffset;
+        this->positionScale = positionScale;
+        setupMesh(nullptr, vertexCount, nullptr, indexCount, indexType, layout);
+    }
+
+    unsigned int vertexBuffer() const { return arena ? arena->vertexBuffer() : VBO; }
+    unsigned int indexBuffer() const { return arena ? arena->indexBuffer() : EBO; }
+    // bytes of vertex and index data the mesh keeps on the GPU
+    size_t bufferSize() const { return bufferBytes; }
+    bool merged() const { return arena != nullptr; }
+
+    // deletes the buffers or gives the ranges back to the arena, the textures are released with the last handle to them
+    void release()
+    {
+        if (arena)
+            arena->free(vertexCount, indexCount, baseVertex, firstIndex);
+        else
+        {
+            glDeleteVertexArrays(1, &VAO);
+            glDeleteBuffers(1, &VBO);
+            glDeleteBuffers(1, &EBO);
+        }
+        arena = nullptr;
+        textures.clear();
+    }
+
+    // copies the vertices and indices into ranges of the shared arena of the layout and index type and deletes the
+    // buffers of the mesh, it draws from the vertex array of the arena afterwards. The copy stays on the GPU, so the
+    // buffers have to be filled (a streamed mesh once its model is ready).
+    void moveToArena()
+    {
+        if (arena)
+            return;
+        GeometryArena& target = sharedArena(layout, indexType);
+        target.allocate(vertexCount, indexCount, baseVertex, firstIndex);
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+        glBindBuffer(GL_COPY_READ_BUFFER, VBO);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, target.vertexBuffer());
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, (GLintptr)baseVertex * vertexSize(layout),
+                            (GLsizeiptr)vertexCount * vertexSize(layout));
+        glBindBuffer(GL_COPY_READ_BUFFER, EBO);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, target.indexBuffer());
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, (GLintptr)firstIndex * indexSize,
+                            (GLsizeiptr)indexCount * indexSize);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        VBO = EBO = 0;
+        VAO = target.vertexArray();
+        arena = &target;
     }
 
     // render the mesh
-    void Draw(Shader shader)
+    void Draw(const Shader& shader)
     {
-        // bind appropriate textures
-        unsigned int diffuseNr = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr = 1;
-        unsigned int ambientNr = 1;
+        PROFILE_FUNCTION();
+        if (locationsProgram != shader.ID)
+            findLocations(shader);
         for (unsigned int i = 0; i < textures.size(); i++)
         {
             glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if (name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if (name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if (name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if (name == "texture_ambient")
-                number = std::to_string(ambientNr++); // transfer unsigned int to stream
-
             // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+            glUniform1i(samplerLocations[i], i);
             // and finally bind the texture
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
 
+        glUniform3fv(positionOffsetLocation, 1, &positionOffset[0]);
+        glUniform3fv(positionScaleLocation, 1, &positionScale[0]);
+
         // draw mesh
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, (int)indices.size(), GL_UNSIGNED_INT, 0);
+        glDrawElementsBaseVertex(GL_TRIANGLES, (int)indexCount, indexType, indexOffset(), baseVertex);
         glBindVertexArray(0);
 
         // always good practice to set everything back to defaults once configured.
         glActiveTexture(GL_TEXTURE0);
     }
 
+    // queues the mesh for RenderQueue::flush(), mvp places its bounds for the depth part of the sort key
+    void submit(RenderQueue& queue, const Shader& shader, const glm::mat4& mvp)
+    {
+        if (materialQueue != &queue)
+        {
+            vector<string> samplers = samplerNames();
+            vector<RenderQueue::MaterialSlot> slots;
+            for (unsigned int i = 0; i < textures.size(); i++)
+                slots.push_back({ samplers[i], textures[i].id });
+            material = queue.material(slots);
+            materialQueue = &queue;
+        }
+        glm::vec4 center = mvp * glm::vec4(bounds.center(), 1.0f);
+        float depth = center.w > 0.0f ? center.z / center.w * 0.5f + 0.5f : 0.0f;
+        RenderQueue::Packet packet = { &shader, material, VAO, (GLsizei)indexCount, indexType, firstIndex, baseVertex,
+                                       positionOffset, positionScale };
+        queue.submit(packet, depth);
+    }
+
 private:
     /*  Render data  */
     unsigned int VBO, EBO;
+    size_t bufferBytes;
+    // where the mesh lives in its arena once it was moved there
+    GeometryArena* arena = nullptr;
+    GLint baseVertex = 0;
+    GLuint firstIndex = 0;
+    // uniform locations in the program they were found for, so drawing does not look them up again
+    unsigned int locationsProgram = 0;
+    vector<GLint> samplerLocations; // of every texture
+    GLint positionOffsetLocation = -1, positionScaleLocation = -1;
+    // the textures as a material of the queue they were last submitted to
+    const RenderQueue* materialQueue = nullptr;
+    unsigned int material = 0;
 
     /*  Functions    */
+    // the sampler of every texture, the N-th texture of a type is sampled by typeN (e.g. texture_diffuse1)
+    vector<string> samplerNames() const
+    {
+        unsigned int diffuseNr = 1;
+        unsigned int specularNr = 1;
+        unsigned int normalNr = 1;
+        unsigned int ambientNr = 1;
+        vector<string> names;
+        for (unsigned int i = 0; i < textures.size(); i++)
+        {
+            // retrieve texture number (the N in diffuse_textureN)
+            string number;
+            string name = textures[i].type;
+            if (name == "texture_diffuse")
+                number = std::to_string(diffuseNr++);
+            else if (name == "texture_specular")
+                number = std::to_string(specularNr++); // transfer unsigned int to stream
+            else if (name == "texture_normal")
+                number = std::to_string(normalNr++); // transfer unsigned int to stream
+            else if (name == "texture_ambient")
+                number = std::to_string(ambientNr++); // transfer unsigned int to stream
+            names.push_back(name + number);
+        }
+        return names;
+    }
+
+    void findLocations(const Shader& shader)
+    {
+        vector<string> samplers = samplerNames();
+        samplerLocations.resize(textures.size());
+        for (unsigned int i = 0; i < textures.size(); i++)
+            samplerLocations[i] = shader.uniform(samplers[i].c_str());
+        positionOffsetLocation = shader.uniform("PositionOffset");
+        positionScaleLocation = shader.uniform("PositionScale");
+        locationsProgram = shader.ID;
+    }
+
     // initializes all the buffer objects/arrays
-    void setupMesh()
+    void setupMesh(const void* vertices, size_t vertexCount, const void* indices, size_t indexCount, GLenum indexType,
+                   VertexLayout layout)
     {
+        PROFILE_FUNCTION();
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
@@ -111,29 +440,38 @@ private:
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        size_t vertexSize = ::vertexSize(layout);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * vertexSize, vertices, GL_STATIC_DRAW);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, indices, GL_STATIC_DRAW);
+        this->vertexCount = (unsigned int)vertexCount;
+        this->indexCount = (unsigned int)indexCount;
+        this->indexType = indexType;
+        this->layout = layout;
+        bufferBytes = vertexCount * vertexSize + indexCount * indexSize;
+        if (layout != VERTEX_COMPACT)
+        {
+            positionOffset = glm::vec3(0.0f);
+            positionScale = glm::vec3(1.0f);
+        }
 
         // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        for (const VertexAttribute& attribute : vertexAttributes(layout))
+        {
+            glEnableVertexAttribArray(attribute.location);
+            glVertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized, (GLsizei)vertexSize,
+                                  (void*)(size_t)attribute.offset);
+        }
 
         glBindVertexArray(0);
     }
+
+    // byte offset of the first index in the index buffer
+    const void* indexOffset() const
+    {
+        return (const void*)((size_t)firstIndex * (indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int)));
+    }
 };
 #endif
\ No newline at end of file
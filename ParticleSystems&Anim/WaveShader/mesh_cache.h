@@ -0,0 +1,204 @@
+// Versioned binary cache of imported models, written next to the source asset
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <mesh.h>
+#include <mapped_file.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// The cache of "model.obj" is "model.obj.meshcache", laid out as
+//   MeshCacheHeader | MeshCacheRange[meshCount] | MeshCacheTexture[textureCount] | Vertex[vertexCount] |
+//   unsigned int[indexCount] | zero terminated strings
+// The vertices and indices are the final blobs Mesh uploads, a mesh range selects the part of them that belongs
+// to one Mesh. A cache is used only if version, vertex layout and import flags match this build and the size and
+// modification time of the source asset did not change since it was written; otherwise the model is imported again
+// and the cache rewritten. Bump MESH_CACHE_VERSION whenever the layout or the meaning of the data changes.
+const uint32_t MESH_CACHE_MAGIC = 0x4843534d; // "MSCH"
+const uint32_t MESH_CACHE_VERSION = 1;
+
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexSize; // sizeof(Vertex) of the build that wrote the cache
+    uint32_t importFlags; // assimp post processing the data went through
+    uint64_t sourceSize; // of the source asset when the cache was written
+    int64_t sourceTime; // modification time of the source asset
+    uint32_t meshCount;
+    uint32_t textureCount;
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint64_t stringsSize;
+};
+
+struct MeshCacheRange {
+    uint32_t firstVertex, vertexCount;
+    uint32_t firstIndex, indexCount; // indices are relative to the first vertex of the range
+    uint32_t firstTexture, textureCount;
+};
+
+struct MeshCacheTexture {
+    uint32_t type; // offset of the sampler prefix in the strings, e.g. "texture_diffuse"
+    uint32_t path; // offset of the path, relative to the directory of the model
+};
+
+class MeshCache
+{
+public:
+    static std::string cachePath(const std::string& sourcePath) { return sourcePath + ".meshcache"; }
+
+    // maps the cache of sourcePath, false if there is none or it does not match the source or this build
+    // ------------------------------------------------------------------------
+    bool open(const std::string& sourcePath, uint32_t importFlags)
+    {
+        header = NULL;
+        if (!file.open(cachePath(sourcePath)))
+            return false;
+        if (file.size() < sizeof(MeshCacheHeader))
+            return reject();
+        header = (const MeshCacheHeader*)file.data();
+        if (header->magic != MESH_CACHE_MAGIC || header->version != MESH_CACHE_VERSION ||
+            header->vertexSize != sizeof(Vertex) || header->importFlags != importFlags)
+            return reject();
+
+        // a missing source is fine, the cache can be shipped on its own
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        if (sourceStat(sourcePath, sourceSize, sourceTime) &&
+            (header->sourceSize != sourceSize || header->sourceTime != sourceTime))
+            return reject();
+
+        // every section has to lie within the file, a truncated cache is imported again
+        uint64_t size = sizeof(MeshCacheHeader);
+        size += (uint64_t)header->meshCount * sizeof(MeshCacheRange);
+        size += (uint64_t)header->textureCount * sizeof(MeshCacheTexture);
+        size += header->vertexCount * sizeof(Vertex);
+        size += header->indexCount * sizeof(unsigned int);
+        size += header->stringsSize;
+        if (size != file.size() || (header->stringsSize > 0 && strings()[header->stringsSize - 1] != '\0'))
+            return reject();
+        for (uint32_t i = 0; i < header->meshCount; i++)
+        {
+            const MeshCacheRange& r = ranges()[i];
+            if ((uint64_t)r.firstVertex + r.vertexCount > header->vertexCount ||
+                (uint64_t)r.firstIndex + r.indexCount > header->indexCount ||
+                (uint64_t)r.firstTexture + r.textureCount > header->textureCount)
+                return reject();
+        }
+        for (uint32_t i = 0; i < header->textureCount; i++)
+            if (textures()[i].type >= header->stringsSize || textures()[i].path >= header->stringsSize)
+                return reject();
+        return true;
+    }
+
+    unsigned int meshCount() const { return header->meshCount; }
+    const MeshCacheRange* ranges() const { return (const MeshCacheRange*)(file.data() + sizeof(MeshCacheHeader)); }
+    const MeshCacheTexture* textures() const { return (const MeshCacheTexture*)(ranges() + header->meshCount); }
+    const Vertex* vertices() const { return (const Vertex*)(textures() + header->textureCount); }
+    const unsigned int* indices() const { return (const unsigned int*)(vertices() + header->vertexCount); }
+    const char* string(uint32_t offset) const { return strings() + offset; }
+
+    // writes the cache of sourcePath from the meshes of an import
+    // ------------------------------------------------------------------------
+    static bool write(const std::string& sourcePath, uint32_t importFlags, const vector<MeshData>& meshes)
+    {
+        MeshCacheHeader header;
+        std::memset(&header, 0, sizeof(header));
+        header.magic = MESH_CACHE_MAGIC;
+        header.version = MESH_CACHE_VERSION;
+        header.vertexSize = sizeof(Vertex);
+        header.importFlags = importFlags;
+        if (!sourceStat(sourcePath, header.sourceSize, header.sourceTime))
+            return false;
+
+        vector<MeshCacheRange> ranges;
+        vector<MeshCacheTexture> textures;
+        std::string strings;
+        for (const MeshData& mesh : meshes)
+        {
+            MeshCacheRange range;
+            range.firstVertex = (uint32_t)header.vertexCount;
+            range.vertexCount = (uint32_t)mesh.vertexCount();
+            range.firstIndex = (uint32_t)header.indexCount;
+            range.indexCount = (uint32_t)mesh.indexCount();
+            range.firstTexture = (uint32_t)textures.size();
+            range.textureCount = (uint32_t)mesh.textures.size();
+            for (const Texture& texture : mesh.textures)
+            {
+                MeshCacheTexture entry;
+                entry.type = (uint32_t)strings.size();
+                strings.append(texture.type.c_str(), texture.type.size() + 1);
+                entry.path = (uint32_t)strings.size();
+                strings.append(texture.path.c_str(), texture.path.size() + 1);
+                textures.push_back(entry);
+            }
+            ranges.push_back(range);
+            header.vertexCount += range.vertexCount;
+            header.indexCount += range.indexCount;
+        }
+        header.meshCount = (uint32_t)ranges.size();
+        header.textureCount = (uint32_t)textures.size();
+        header.stringsSize = strings.size();
+
+        // written under a temporary name and renamed, a run that dies halfway leaves no truncated cache behind
+        std::string path = cachePath(sourcePath);
+        std::string temporary = path + ".tmp";
+        FILE* out = std::fopen(temporary.c_str(), "wb");
+        if (!out)
+            return false;
+        bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1;
+        ok = ok && (ranges.empty() || std::fwrite(ranges.data(), sizeof(MeshCacheRange), ranges.size(), out) == ranges.size());
+        ok = ok && (textures.empty() || std::fwrite(textures.data(), sizeof(MeshCacheTexture), textures.size(), out) == textures.size());
+        for (const MeshData& mesh : meshes)
+        {
+            ok = ok && (mesh.vertexCount() == 0 ||
+                        std::fwrite(mesh.vertexData(), sizeof(Vertex), mesh.vertexCount(), out) == mesh.vertexCount());
+        }
+        for (const MeshData& mesh : meshes)
+        {
+            ok = ok && (mesh.indexCount() == 0 ||
+                        std::fwrite(mesh.indexData(), sizeof(unsigned int), mesh.indexCount(), out) == mesh.indexCount());
+        }
+        ok = ok && (strings.empty() || std::fwrite(strings.data(), 1, strings.size(), out) == strings.size());
+        ok = std::fclose(out) == 0 && ok;
+        std::remove(path.c_str()); // rename does not replace an existing file on Windows
+        if (!ok || std::rename(temporary.c_str(), path.c_str()) != 0)
+        {
+            std::remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    MappedFile file;
+    const MeshCacheHeader* header;
+
+    const char* strings() const { return (const char*)(indices() + header->indexCount); }
+
+    bool reject()
+    {
+        file.close();
+        header = NULL;
+        return false;
+    }
+
+    static bool sourceStat(const std::string& sourcePath, uint64_t& size, int64_t& time)
+    {
+        struct stat info;
+        if (stat(sourcePath.c_str(), &info) != 0)
+            return false;
+        size = (uint64_t)info.st_size;
+        time = (int64_t)info.st_mtime;
+        return true;
+    }
+};
+#endif
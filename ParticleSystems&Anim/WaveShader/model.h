@@ -5,13 +5,17 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <texture_decoder.h> // includes the stb_image declarations, has to come before the implementation
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include <frustum_culling.h>
+#include <ktx_texture.h>
 #include <mesh.h>
+#include <mesh_cache.h>
 #include <shader.h>
 
 #include <string>
@@ -24,186 +28,351 @@ using namespace std;
 
 unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
 
+// post processing of every import, part of the mesh cache key
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+// everything an import produces before GL is involved, see importModel()
+struct ModelData {
+    string directory;
+    MeshCache cache; // the meshes of a cached model point into its mapping
+    vector<MeshData> meshes;
+};
+
+bool importModel(string const& path, ModelData& data);
+
 class Model
 {
 public:
     /*  Model Data */
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh> meshes;
     string directory;
     bool gammaCorrection;
+    VertexLayout layout;
+    MeshBVH bvh; // over the bounds of the meshes, culls them in submit()
 
     /*  Functions   */
     // constructor, expects a filepath to a 3D model.
-    Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const& path, bool gamma = false, VertexLayout layout = VERTEX_FULL) : gammaCorrection(gamma), layout(layout)
     {
+        PROFILE_FUNCTION();
         loadModel(path);
     }
 
+    // constructor for meshes that were built elsewhere, e.g. streamed in by ModelStream
+    Model(vector<Mesh>&& meshes, string const& directory, bool gamma, VertexLayout layout)
+        : meshes(std::move(meshes)), directory(directory), gammaCorrection(gamma), layout(layout)
+    {
+        bvh.build(this->meshes);
+    }
+
+    ~Model()
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].release();
+    }
+
+    // the meshes own their GL buffers, share a model through loadModelAsset() instead of copying it
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+
+    // bytes of vertex and index data of all meshes on the GPU
+    size_t bufferSize() const
+    {
+        size_t size = 0;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            size += meshes[i].bufferSize();
+        return size;
+    }
+
     // draws the model, and thus all its meshes
-    void Draw(Shader shader)
+    void Draw(const Shader& shader)
     {
+        PROFILE_FUNCTION();
         for (unsigned int i = 0; i < meshes.size(); i++)
             meshes[i].Draw(shader);
     }
 
+    // moves every mesh into the shared arena of its layout and index type, so a RenderQueue draws the model with one
+    // multi-draw. Meshes that were moved before stay where they are
+    void mergeGeometry()
+    {
+        PROFILE_FUNCTION();
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].moveToArena();
+    }
+
+    // queues the meshes for RenderQueue::flush() instead of drawing them in import order, only those in the view
+    // frustum of mvp unless cull is false. displacement bounds how far the vertex shader moves a vertex along each
+    // axis; bvh counts the meshes it culled
+    void submit(RenderQueue& queue, const Shader& shader, const glm::mat4& mvp, bool cull = true,
+                const glm::vec3& displacement = glm::vec3(0.0f))
+    {
+        PROFILE_FUNCTION();
+        if (!cull)
+        {
+            bvh.tested = bvh.culled = 0;
+            for (unsigned int i = 0; i < meshes.size(); i++)
+                meshes[i].submit(queue, shader, mvp);
+            return;
+        }
+        visible.clear();
+        bvh.cull(Frustum(mvp), visible, displacement);
+        for (unsigned int i : visible)
+            meshes[i].submit(queue, shader, mvp);
+    }
+
 private:
+    vector<unsigned int> visible; // of the last submit(), kept for its capacity
+
     /*  Functions   */
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const& path)
     {
-        // read file via ASSIMP
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-        // check for errors
-        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+        PROFILE_FUNCTION();
+        // the material textures are decoded on worker threads while the meshes upload, finish() uploads them at the end
+        ModelData data;
+        if (importModel(path, data))
         {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+            directory = data.directory;
+            for (const MeshData& mesh : data.meshes)
+            {
+                vector<Texture> textures;
+                for (const Texture& texture : mesh.textures)
+                    textures.push_back(loadTexture(texture.path.c_str(), texture.type, texture.type == "texture_diffuse"));
+                meshes.push_back(Mesh(mesh.vertexData(), mesh.vertexCount(), mesh.indexData(), mesh.indexCount(), textures, layout));
+            }
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
-
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        bvh.build(meshes);
+        TextureDecoder::shared().finish();
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode* node, const aiScene* scene)
+    // loads the texture at path relative to the model, unless any model loaded the same file or a copy of it before
+    Texture loadTexture(const char* path, const string& typeName, bool gamma)
     {
-        // process each mesh located at the current node
-        for (unsigned int i = 0; i < node->mNumMeshes; i++)
-        {
-            // the node object only contains indices to index the actual objects in the scene.
-            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
-        }
-        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
-        for (unsigned int i = 0; i < node->mNumChildren; i++)
-        {
-            processNode(node->mChildren[i], scene);
-        }
+        Texture texture;
+        texture.type = typeName;
+        texture.path = path;
+        texture.object = loadTextureAsset(this->directory + '/' + path, gamma);
+        texture.id = texture.object->id;
+        return texture;
+    }
 
+    // the texture object exists right away, its image is decoded by TextureDecoder and uploaded by finish(). A .ktx2
+    // file next to the image replaces it, its compressed levels are uploaded as they are
+    static TextureHandle loadTextureAsset(const string& filename, bool gamma)
+    {
+        string compressed = compressedTexturePath(filename);
+        if (!compressed.empty())
+            return AssetManager::instance().acquireFile<TextureObject>("texture2d:ktx2", compressed, [&](vector<unsigned char>& bytes) {
+                GLuint id;
+                glGenTextures(1, &id);
+                Ktx2Image image;
+                if (parseKtx2(bytes.data(), bytes.size(), image))
+                    uploadCompressedTexture2D(id, image);
+                else
+                    std::cout << "Texture failed to load at path: " << compressed << std::endl;
+                return std::make_shared<TextureObject>(id);
+            });
+        return AssetManager::instance().acquireFile<TextureObject>(gamma ? "texture2d:srgb" : "texture2d", filename,
+                                                                   [&](vector<unsigned char>& bytes) {
+            GLuint id;
+            glGenTextures(1, &id);
+            if (bytes.empty())
+                std::cout << "Texture failed to load at path: " << filename << std::endl; // empty texture, not cached
+            else
+                TextureDecoder::shared().request(filename, std::move(bytes), id, gamma);
+            return std::make_shared<TextureObject>(id);
+        });
     }
+};
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+// the import does not touch GL and can run on any thread
+// ------------------------------------------------------------------------
+// checks all material textures of a given type, only their type and path are recorded here.
+// the required info is returned as a Texture struct.
+inline vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+{
+    vector<Texture> textures;
+    for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
     {
-        // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        aiString str;
+        mat->GetTexture(type, i, &str);
+        Texture texture;
+        texture.id = 0;
+        texture.type = typeName;
+        texture.path = str.C_Str();
+        textures.push_back(texture);
+    }
+    return textures;
+}
 
-        // Walk through each of the mesh's vertices
-        for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-        {
-            Vertex vertex;
-            glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-            // positions
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
-            // normals
-            vector.x = mesh->mNormals[i].x;
-            vector.y = mesh->mNormals[i].y;
-            vector.z = mesh->mNormals[i].z;
-            vertex.Normal = vector;
-            // texture coordinates
-            if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
-            {
-                glm::vec2 vec;
-                // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't
-                // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-                vec.x = mesh->mTextureCoords[0][i].x;
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
-            }
-            else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-            // tangent
-            vector.x = mesh->mTangents[i].x;
-            vector.y = mesh->mTangents[i].y;
-            vector.z = mesh->mTangents[i].z;
-            vertex.Tangent = vector;
-            // bitangent
-            vector.x = mesh->mBitangents[i].x;
-            vector.y = mesh->mBitangents[i].y;
-            vector.z = mesh->mBitangents[i].z;
-            vertex.Bitangent = vector;
-            vertices.push_back(vertex);
-        }
-        // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
-        for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+inline MeshData processMesh(aiMesh* mesh, const aiScene* scene)
+{
+    PROFILE_FUNCTION();
+    // data to fill
+    MeshData data;
+    vector<Vertex>& vertices = data.vertices;
+    vector<unsigned int>& indices = data.indices;
+    vector<Texture>& textures = data.textures;
+
+    // Walk through each of the mesh's vertices
+    for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+    {
+        Vertex vertex;
+        glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
+        // positions
+        vector.x = mesh->mVertices[i].x;
+        vector.y = mesh->mVertices[i].y;
+        vector.z = mesh->mVertices[i].z;
+        vertex.Position = vector;
+        // normals
+        vector.x = mesh->mNormals[i].x;
+        vector.y = mesh->mNormals[i].y;
+        vector.z = mesh->mNormals[i].z;
+        vertex.Normal = vector;
+        // texture coordinates
+        if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
         {
-            aiFace face = mesh->mFaces[i];
-            // retrieve all indices of the face and store them in the indices vector
-            for (unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);
+            glm::vec2 vec;
+            // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't
+            // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
+            vec.x = mesh->mTextureCoords[0][i].x;
+            vec.y = mesh->mTextureCoords[0][i].y;
+            vertex.TexCoords = vec;
         }
-        // process materials
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-        // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
-        // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER.
-        // Same applies to other texture as the following list summarizes:
-        // diffuse: texture_diffuseN
-        // specular: texture_specularN
-        // normal: texture_normalN
-
-        // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-        // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-        // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-        // 4. ambient maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_ambient");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
-    }
-
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
-    {
-        vector<Texture> textures;
-        for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+        else
+            vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+        // tangent
+        vector.x = mesh->mTangents[i].x;
+        vector.y = mesh->mTangents[i].y;
+        vector.z = mesh->mTangents[i].z;
+        vertex.Tangent = vector;
+        // bitangent
+        vector.x = mesh->mBitangents[i].x;
+        vector.y = mesh->mBitangents[i].y;
+        vector.z = mesh->mBitangents[i].z;
+        vertex.Bitangent = vector;
+        vertices.push_back(vertex);
+    }
+    // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+    {
+        aiFace face = mesh->mFaces[i];
+        // retrieve all indices of the face and store them in the indices vector
+        for (unsigned int j = 0; j < face.mNumIndices; j++)
+            indices.push_back(face.mIndices[j]);
+    }
+    // process materials
+    aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+    // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
+    // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER.
+    // Same applies to other texture as the following list summarizes:
+    // diffuse: texture_diffuseN
+    // specular: texture_specularN
+    // normal: texture_normalN
+
+    // 1. diffuse maps
+    vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+    textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+    // 2. specular maps
+    vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+    textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+    // 3. normal maps
+    std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+    textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+    // 4. ambient maps
+    std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_ambient");
+    textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+
+    // return the extracted mesh data, the mesh object is created on the GL thread
+    return data;
+}
+
+
+// processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
+inline void processNode(aiNode* node, const aiScene* scene, vector<MeshData>& meshes)
+{
+    // process each mesh located at the current node
+    for (unsigned int i = 0; i < node->mNumMeshes; i++)
+    {
+        // the node object only contains indices to index the actual objects in the scene.
+        // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
+        aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+        meshes.push_back(processMesh(mesh, scene));
+    }
+    // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
+    for (unsigned int i = 0; i < node->mNumChildren; i++)
+    {
+        processNode(node->mChildren[i], scene, meshes);
+    }
+}
+
+// reads the meshes of the model at path from its mesh cache, or imports them with assimp and writes the cache
+inline bool importModel(string const& path, ModelData& data)
+{
+    PROFILE_FUNCTION();
+    // retrieve the directory path of the filepath
+    data.directory = path.substr(0, path.find_last_of('/'));
+
+    // a cache written by an earlier import skips assimp, see mesh_cache.h
+    if (data.cache.open(path, MODEL_IMPORT_FLAGS))
+    {
+        const MeshCache& cache = data.cache;
+        data.meshes.resize(cache.meshCount());
+        for (unsigned int i = 0; i < cache.meshCount(); i++)
         {
-            aiString str;
-            mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for (unsigned int j = 0; j < textures_loaded.size(); j++)
+            const MeshCacheRange& range = cache.ranges()[i];
+            MeshData& mesh = data.meshes[i];
+            mesh.cachedVertices = cache.vertices() + range.firstVertex;
+            mesh.cachedVertexCount = range.vertexCount;
+            mesh.cachedIndices = cache.indices() + range.firstIndex;
+            mesh.cachedIndexCount = range.indexCount;
+            for (unsigned int t = range.firstTexture; t < range.firstTexture + range.textureCount; t++)
             {
-                if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if (!skip)
-            {   // if texture hasn't been loaded already, load it
                 Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory, type == aiTextureType_DIFFUSE);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+                texture.id = 0;
+                texture.type = cache.string(cache.textures()[t].type);
+                texture.path = cache.string(cache.textures()[t].path);
+                mesh.textures.push_back(texture);
             }
         }
-        return textures;
+        return true;
     }
-};
 
+    // read file via ASSIMP
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
+    // check for errors
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+    {
+        cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+        return false;
+    }
+
+    // process ASSIMP's root node recursively
+    processNode(scene->mRootNode, scene, data.meshes);
+
+    if (!MeshCache::write(path, MODEL_IMPORT_FLAGS, data.meshes))
+        cout << "ERROR::MESH_CACHE::NOT_WRITTEN " << MeshCache::cachePath(path) << endl;
+    return true;
+}
+
+inline uint64_t modelAssetKey(string const& path, bool gamma, VertexLayout layout)
+{
+    string kind = gamma ? "model:gamma" : "model";
+    return assetPathKey(layout == VERTEX_COMPACT ? kind + ":compact" : kind, path);
+}
+
+// the model at path, shared with everybody who loaded it before and still holds it
+inline std::shared_ptr<Model> loadModelAsset(string const& path, bool gamma = false, VertexLayout layout = VERTEX_FULL)
+{
+    return AssetManager::instance().acquire<Model>(modelAssetKey(path, gamma, layout),
+                                                   [&]() { return std::make_shared<Model>(path, gamma, layout); });
+}
 
 unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)
 {
+    PROFILE_FUNCTION();
     string filename = string(path);
     filename = directory + '/' + filename;
 
@@ -214,29 +383,7 @@ unsigned int TextureFromFile(const char* path, const string& directory, bool gam
     unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
     if (data)
     {
-        GLenum format, internalFormat;
-        if (nrComponents == 1)
-            internalFormat = format = GL_RED;
-        else if (nrComponents == 3)
-        {
-            format = GL_RGB;
-            internalFormat = gamma ? GL_SRGB : format;
-        }
-        else if (nrComponents == 4)
-        {
-            format = GL_RGBA;
-            internalFormat = gamma ? GL_SRGB_ALPHA : format;
-        }
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
+        uploadTexture2D(textureID, data, width, height, nrComponents, gamma);
         stbi_image_free(data);
     }
     else
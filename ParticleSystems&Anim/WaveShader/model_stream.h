@@ -0,0 +1,478 @@
+// Loads a model in the background and uploads it over several frames while a bounding box stands in for it
+#ifndef MODEL_STREAM_H
+#define MODEL_STREAM_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <model.h>
+#include <staging_uploader.h>
+
+#include <atomic>
+#include <deque>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A loader thread imports the model (or maps its mesh cache), reads and decodes the material textures and builds their
+// mip chains (or reads the compressed .ktx2 files that replace them), nothing of which needs GL. update() runs once per
+// frame on the GL thread: once the loader is done it creates the buffers and immutable textures and then copies their
+// contents through a StagingUploader, at most bytesPerFrame a frame, so no single frame pays for the whole model. The
+// model is handed out by get() and stored in the AssetManager (like loadModelAsset() does) only after the GPU has
+// finished every copy; until then drawPlaceholder() outlines the bounding box as soon as the loader knows it.
+class ModelStream
+{
+public:
+    ModelStream(const string& path, bool gamma = false, VertexLayout layout = VERTEX_FULL, size_t bytesPerFrame = 4 << 20)
+        : path(path), gamma(gamma), layout(layout), budget(bytesPerFrame), stage(IMPORTING), boundsKnown(false), cancelled(false),
+          boundsMVP(-1), boundsColor(-1), placeholderVAO(0), placeholderVBO(0), placeholderEBO(0)
+    {
+        model = AssetManager::instance().find<Model>(modelKey());
+        if (model)
+        {
+            stage = READY;
+            return;
+        }
+        boundsShader = loadShaderAsset("shaders/bounds.vert", "shaders/bounds.frag");
+        boundsMVP = boundsShader->uniform("MVP");
+        boundsColor = boundsShader->uniform("Color");
+        loader = std::thread(&ModelStream::load, this);
+    }
+
+    ~ModelStream()
+    {
+        cancelled = true;
+        if (loader.joinable())
+            loader.join();
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].release();
+        releasePlaceholder();
+    }
+
+    ModelStream(const ModelStream&) = delete;
+    ModelStream& operator=(const ModelStream&) = delete;
+
+    bool ready() const { return stage == READY; }
+    bool failed() const { return stage == FAILED; }
+    // the model once it is ready, an empty handle before
+    std::shared_ptr<Model> get() const { return model; }
+
+    // advances the upload, call once per frame on the GL thread
+    // ------------------------------------------------------------------------
+    void update()
+    {
+        size_t spent = 0;
+        if (stage == LOADED)
+            createObjects(spent);
+        if (stage == UPLOADING)
+            upload(spent);
+        if (stage == FENCED && uploader->idle())
+            finish();
+    }
+
+    // outlines the bounding box of the model while it is loading, nothing before the loader knows it
+    // ------------------------------------------------------------------------
+    void drawPlaceholder(const glm::mat4& mvp)
+    {
+        if (stage == READY || stage == FAILED || !boundsKnown)
+            return;
+        if (!placeholderVAO)
+            createPlaceholder();
+        boundsShader->use();
+        boundsShader->setMat4(boundsMVP, mvp);
+        boundsShader->setVec3(boundsColor, 0.8f, 0.8f, 0.8f);
+        glBindVertexArray(placeholderVAO);
+        glDrawElements(GL_LINES, 24, GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+    }
+
+private:
+    enum Stage { IMPORTING, LOADED, UPLOADING, FENCED, READY, FAILED };
+
+    // a material texture, decoded by the loader unless the AssetManager already holds it
+    struct StreamedTexture {
+        string path; // relative to the model
+        bool gamma;
+        uint64_t pathKey, contentKey; // the keys acquireFile() would use, so synchronous loads share the texture
+        bool loaded = false;
+        int width = 0, height = 0, components = 0;
+        vector<vector<unsigned char>> levels; // mip chain, levels[0] is the image
+        bool compressed = false; // read from a .ktx2 file instead, its levels point into file
+        vector<unsigned char> file;
+        Ktx2Image image;
+    };
+
+    // one level of a texture or the vertices or indices of a mesh, copied in slot sized pieces
+    struct Copy {
+        enum Target { BUFFER, TEXTURE, COMPRESSED_TEXTURE };
+        GLuint object;
+        const unsigned char* data;
+        size_t size; // bytes of a buffer, rows of a texture level, block rows of a compressed one
+        size_t done;
+        Target target;
+        int level, width, height;
+        int components; // bytes per texel, per block of a compressed level
+        GLenum format; // pixel format, the internal format of a compressed level
+    };
+
+    string path;
+    bool gamma;
+    VertexLayout layout;
+    size_t budget;
+    std::atomic<int> stage;
+
+    // written by the loader before it publishes them through boundsKnown and stage
+    glm::vec3 boundsMin, boundsMax;
+    std::atomic<bool> boundsKnown, cancelled;
+    std::unique_ptr<ModelData> data;
+    vector<StreamedTexture> textures;
+    vector<vector<unsigned int>> meshTextures; // indices into textures for every mesh
+    vector<PackedMesh> packedMeshes; // the meshes in the compact layout, packed by the loader
+    vector<MeshBounds> meshBoxes; // of every mesh
+    vector<TextureHandle> handles; // of textures[0..size), created so far
+    std::thread loader;
+
+    // GL side, only touched by the GL thread
+    std::unique_ptr<StagingUploader> uploader;
+    std::deque<Copy> copies;
+    vector<Mesh> meshes;
+    std::shared_ptr<Model> model;
+    ShaderHandle boundsShader;
+    GLint boundsMVP, boundsColor;
+    GLuint placeholderVAO, placeholderVBO, placeholderEBO;
+
+    uint64_t modelKey() const { return modelAssetKey(path, gamma, layout); }
+
+    // runs on the loader thread
+    // ------------------------------------------------------------------------
+    void load()
+    {
+        PROFILE_THREAD_NAME("model loader");
+        PROFILE_FUNCTION();
+        data.reset(new ModelData());
+        if (!importModel(path, *data))
+        {
+            stage = FAILED;
+            return;
+        }
+
+        boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+        for (const MeshData& mesh : data->meshes)
+        {
+            meshBoxes.push_back(meshBounds(mesh.vertexData(), mesh.vertexCount()));
+            if (mesh.vertexCount() == 0)
+                continue;
+            boundsMin = glm::min(boundsMin, meshBoxes.back().lower);
+            boundsMax = glm::max(boundsMax, meshBoxes.back().upper);
+        }
+        boundsKnown = boundsMin.x <= boundsMax.x;
+
+        if (layout == VERTEX_COMPACT)
+        {
+            packedMeshes.resize(data->meshes.size());
+            for (unsigned int i = 0; i < data->meshes.size(); i++)
+            {
+                const MeshData& mesh = data->meshes[i];
+                packMesh(mesh.vertexData(), mesh.vertexCount(), mesh.indexData(), mesh.indexCount(), packedMeshes[i]);
+            }
+        }
+
+        // every file is decoded once, however many meshes use it; diffuse maps are gamma corrected like in Model
+        std::map<std::pair<string, bool>, unsigned int> unique;
+        for (const MeshData& mesh : data->meshes)
+        {
+            meshTextures.push_back(vector<unsigned int>());
+            for (const Texture& texture : mesh.textures)
+            {
+                bool srgb = texture.type == "texture_diffuse";
+                std::pair<string, bool> key(texture.path, srgb);
+                if (unique.find(key) == unique.end())
+                {
+                    unique[key] = (unsigned int)textures.size();
+                    textures.push_back(StreamedTexture());
+                    textures.back().path = texture.path;
+                    textures.back().gamma = srgb;
+                }
+                meshTextures.back().push_back(unique[key]);
+            }
+        }
+        for (StreamedTexture& texture : textures)
+        {
+            if (cancelled)
+                return;
+            decodeTexture(texture);
+        }
+        stage = LOADED;
+    }
+
+    void decodeTexture(StreamedTexture& texture)
+    {
+        PROFILE_FUNCTION();
+        string kind = texture.gamma ? "texture2d:srgb" : "texture2d";
+        string filename = data->directory + '/' + texture.path;
+        vector<vector<unsigned char>> files(1);
+        string compressed = compressedTexturePath(filename);
+        if (!compressed.empty())
+        {
+            // the same keys as Model::loadTextureAsset(), the file decides whether it is sRGB
+            texture.pathKey = assetFilesPathKey("texture2d:ktx2", vector<string>(1, compressed));
+            if (!readAssetFile(compressed, files[0]))
+                return;
+            texture.contentKey = assetFilesContentKey("texture2d:ktx2", files);
+            texture.file.swap(files[0]);
+            texture.compressed = parseKtx2(texture.file.data(), texture.file.size(), texture.image);
+            texture.loaded = texture.compressed;
+            texture.width = texture.image.width;
+            texture.height = texture.image.height;
+            return;
+        }
+        texture.pathKey = assetFilesPathKey(kind, vector<string>(1, filename));
+        if (!readAssetFile(filename, files[0]))
+            return;
+        texture.contentKey = assetFilesContentKey(kind, files);
+
+        unsigned char* pixels = stbi_load_from_memory(files[0].data(), (int)files[0].size(), &texture.width,
+                                                      &texture.height, &texture.components, 0);
+        if (!pixels)
+            return;
+        texture.levels = buildMipChain(pixels, texture.width, texture.height, texture.components, texture.gamma);
+        stbi_image_free(pixels);
+        texture.loaded = true;
+    }
+
+    // the textures and buffers of every mesh, their contents follow in upload(). Allocating the storage of a texture
+    // costs about as much as filling it, so the textures are created over several frames within the same budget.
+    // ------------------------------------------------------------------------
+    void createObjects(size_t& spent)
+    {
+        PROFILE_FUNCTION();
+        while (handles.size() < textures.size())
+        {
+            if (spent >= budget)
+                return;
+            StreamedTexture& texture = textures[handles.size()];
+            handles.push_back(createTexture(texture));
+            for (const vector<unsigned char>& level : texture.levels)
+                spent += level.size();
+            for (size_t size : texture.image.levelSizes)
+                spent += size;
+        }
+
+        for (unsigned int i = 0; i < data->meshes.size(); i++)
+        {
+            const MeshData& mesh = data->meshes[i];
+            vector<Texture> meshTextureList;
+            for (unsigned int t = 0; t < mesh.textures.size(); t++)
+            {
+                Texture texture = mesh.textures[t];
+                texture.object = handles[meshTextures[i][t]];
+                texture.id = texture.object->id;
+                meshTextureList.push_back(texture);
+            }
+            if (layout == VERTEX_COMPACT)
+            {
+                const PackedMesh& packed = packedMeshes[i];
+                size_t indexSize = packed.indexType() == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+                meshes.push_back(Mesh(mesh.vertexCount(), mesh.indexCount(), meshTextureList, meshBoxes[i], layout,
+                                      packed.indexType(), packed.positionOffset, packed.positionScale));
+                queueBuffer(meshes.back().vertexBuffer(), packed.vertices.data(), packed.vertices.size() * sizeof(PackedVertex));
+                queueBuffer(meshes.back().indexBuffer(), packed.indexData(), packed.indexCount() * indexSize);
+                continue;
+            }
+            meshes.push_back(Mesh(mesh.vertexCount(), mesh.indexCount(), meshTextureList, meshBoxes[i]));
+            queueBuffer(meshes.back().vertexBuffer(), mesh.vertexData(), mesh.vertexCount() * sizeof(Vertex));
+            queueBuffer(meshes.back().indexBuffer(), mesh.indexData(), mesh.indexCount() * sizeof(unsigned int));
+        }
+
+        uploader.reset(new StagingUploader());
+        stage = UPLOADING;
+    }
+
+    // the texture another model already loaded from the same file or a copy of it, or a new one with its levels queued
+    TextureHandle createTexture(StreamedTexture& texture)
+    {
+        AssetManager& assets = AssetManager::instance();
+        TextureHandle handle = assets.find<TextureObject>(texture.pathKey);
+        if (handle)
+            return handle;
+
+        if (texture.loaded)
+        {
+            handle = assets.find<TextureObject>(texture.contentKey, AssetManager::BY_CONTENT);
+            if (handle)
+            {
+                assets.alias(texture.pathKey, handle);
+                return handle;
+            }
+        }
+
+        GLuint id;
+        glGenTextures(1, &id);
+        handle = std::make_shared<TextureObject>(id);
+        if (!texture.loaded)
+        {
+            std::cout << "Texture failed to load at path: " << data->directory + '/' + texture.path << std::endl;
+            return handle; // empty texture, not cached
+        }
+        if (texture.compressed)
+        {
+            createCompressedTexture(id, texture.image);
+            assets.add(texture.pathKey, handle);
+            assets.alias(texture.contentKey, handle);
+            return handle;
+        }
+
+        // immutable storage for the whole chain, the same sampling as uploadTexture2D()
+        GLenum format = GL_RGBA, internalFormat = texture.gamma ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+        if (texture.components == 1)
+            format = GL_RED, internalFormat = GL_R8;
+        else if (texture.components == 2)
+            format = GL_RG, internalFormat = GL_RG8;
+        else if (texture.components == 3)
+            format = GL_RGB, internalFormat = texture.gamma ? GL_SRGB8 : GL_RGB8;
+        glBindTexture(GL_TEXTURE_2D, id);
+        glTexStorage2D(GL_TEXTURE_2D, (GLsizei)texture.levels.size(), internalFormat, texture.width, texture.height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        int width = texture.width, height = texture.height;
+        for (unsigned int level = 0; level < texture.levels.size(); level++)
+        {
+            Copy copy = { id, texture.levels[level].data(), (size_t)height, 0, Copy::TEXTURE, (int)level, width, height,
+                          texture.components, format };
+            copies.push_back(copy);
+            width = width > 1 ? width / 2 : 1;
+            height = height > 1 ? height / 2 : 1;
+        }
+        assets.add(texture.pathKey, handle);
+        assets.alias(texture.contentKey, handle);
+        return handle;
+    }
+
+    // immutable storage in the compressed format, its levels are copied in block rows
+    void createCompressedTexture(GLuint id, const Ktx2Image& image)
+    {
+        glBindTexture(GL_TEXTURE_2D, id);
+        glTexStorage2D(GL_TEXTURE_2D, (GLsizei)image.levels.size(), image.internalFormat, image.width, image.height);
+        setCompressedTextureParameters((unsigned int)image.levels.size());
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        int width = image.width, height = image.height;
+        for (unsigned int level = 0; level < image.levels.size(); level++)
+        {
+            Copy copy = { id, image.levels[level], (size_t)(height + 3) / 4, 0, Copy::COMPRESSED_TEXTURE, (int)level, width,
+                          height, (int)image.blockBytes, image.internalFormat };
+            copies.push_back(copy);
+            width = width > 1 ? width / 2 : 1;
+            height = height > 1 ? height / 2 : 1;
+        }
+    }
+
+    void queueBuffer(GLuint buffer, const void* source, size_t bytes)
+    {
+        if (bytes == 0)
+            return;
+        Copy copy = { buffer, (const unsigned char*)source, bytes, 0, Copy::BUFFER, 0, 0, 0, 0, GL_NONE };
+        copies.push_back(copy);
+    }
+
+    // stages copies until this frame's budget is spent or every staging buffer is still in flight
+    // ------------------------------------------------------------------------
+    void upload(size_t& spent)
+    {
+        PROFILE_FUNCTION();
+        while (!copies.empty() && spent < budget)
+        {
+            Copy& copy = copies.front();
+            size_t staged;
+            if (copy.target == Copy::COMPRESSED_TEXTURE)
+            {
+                size_t rowSize = (size_t)((copy.width + 3) / 4) * copy.components;
+                staged = (size_t)uploader->copyToCompressedTexture(copy.object, copy.level, copy.width, copy.height,
+                                                                   (int)copy.done, copy.format, copy.components, copy.data);
+                spent += staged * rowSize;
+            }
+            else if (copy.target == Copy::TEXTURE)
+            {
+                size_t rowSize = (size_t)copy.width * copy.components;
+                staged = copy.done < copy.size
+                    ? (size_t)uploader->copyToTexture(copy.object, copy.level, copy.width, (int)copy.size, (int)copy.done,
+                                                      copy.format, copy.components, copy.data)
+                    : 0;
+                spent += staged * rowSize;
+            }
+            else
+            {
+                staged = uploader->copyToBuffer(copy.object, copy.done, copy.data + copy.done, copy.size - copy.done);
+                spent += staged;
+            }
+            if (staged == 0)
+                break;
+            copy.done += staged;
+            if (copy.done == copy.size)
+                copies.pop_front();
+        }
+        if (copies.empty())
+            stage = FENCED;
+    }
+
+    // every copy has landed: the model goes live, the CPU copies and the placeholder are freed
+    // ------------------------------------------------------------------------
+    void finish()
+    {
+        PROFILE_FUNCTION();
+        model = std::make_shared<Model>(std::move(meshes), data->directory, gamma, layout);
+        meshes.clear();
+        AssetManager::instance().add(modelKey(), model);
+        uploader.reset();
+        data.reset();
+        packedMeshes.clear();
+        textures.clear();
+        handles.clear();
+        releasePlaceholder();
+        stage = READY;
+    }
+
+    void createPlaceholder()
+    {
+        glm::vec3 corners[8];
+        for (int i = 0; i < 8; i++)
+            corners[i] = glm::vec3(i & 1 ? boundsMax.x : boundsMin.x, i & 2 ? boundsMax.y : boundsMin.y,
+                                   i & 4 ? boundsMax.z : boundsMin.z);
+        // the twelve edges connect corners that differ in one bit
+        const unsigned int edges[24] = { 0, 1, 2, 3, 4, 5, 6, 7, 0, 2, 1, 3, 4, 6, 5, 7, 0, 4, 1, 5, 2, 6, 3, 7 };
+
+        glGenVertexArrays(1, &placeholderVAO);
+        glGenBuffers(1, &placeholderVBO);
+        glGenBuffers(1, &placeholderEBO);
+        glBindVertexArray(placeholderVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, placeholderVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, placeholderEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(edges), edges, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        glBindVertexArray(0);
+    }
+
+    void releasePlaceholder()
+    {
+        if (placeholderVAO)
+        {
+            glDeleteVertexArrays(1, &placeholderVAO);
+            glDeleteBuffers(1, &placeholderVBO);
+            glDeleteBuffers(1, &placeholderEBO);
+        }
+        placeholderVAO = placeholderVBO = placeholderEBO = 0;
+        boundsShader.reset();
+    }
+};
+#endif
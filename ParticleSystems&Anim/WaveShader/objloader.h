@@ -1,4 +1,6 @@
-// modified version of https://github.com/opengl-tutorials/ogl/blob/master/common/objloader.cpp
+// OBJ loader for large meshes: maps the file, parses it in parallel chunks and welds the corners into an indexed mesh.
+// loadOBJ() with separate output arrays keeps the interface of the version based on
+// https://github.com/opengl-tutorials/ogl/blob/master/common/objloader.cpp
 
 #ifndef GRAPHICSPROGRAMMINGEXERCISES_OBJLOADER_H
 #define GRAPHICSPROGRAMMINGEXERCISES_OBJLOADER_H
@@ -6,261 +8,513 @@
 
 #include <vector>
 #include <stdio.h>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
 #include <string>
 #include <cstring>
+#include <functional>
+#include <thread>
 
 #include <glm/glm.hpp>
 
-#include "objloader.h"
-
-// Very, VERY simple OBJ loader.
-// Here is a short list of features a real function would provide :
-// - Binary files. Reading a model should be just a few memcpy's away, not parsing a file at runtime. In short : OBJ is not very great.
-// - Animations & bones (includes bones weights)
-// - Multiple UVs
-// - All attributes should be optional, not "forced"
-// - More stable. Change a line in the OBJ file and it crashes.
-// - More secure. Change another line and you can inject code.
-// - Loading from memory, stream, etc
+#include "mapped_file.h"
+#include "profiler.h"
+
+// Only what the shaders here need is read: positions, the first set of texture coordinates and normals, and faces
+// with any number of corners (fanned into triangles). Groups, objects and materials are ignored, one OBJ is one mesh.
+// Corners that repeat the same v/vt/vn triplet share a vertex, so the result is indexed; a corner without a vt or
+// vn gets zero for it. Negative (relative) indices are supported. V is flipped like in the original loader.
+
+struct ObjMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> uvs; // as many as positions
+    std::vector<glm::vec3> normals; // as many as positions
+    std::vector<unsigned int> indices; // three per triangle
+};
+
+namespace objloader {
+
+const int NONE = INT_MIN; // attribute not given by a corner
+
+// one face corner; indices are zero based, or relative to the chunk's own attribute count if the relative bit is set
+struct Corner {
+    int v, t, n;
+    unsigned char relative; // bit 0: v, bit 1: t, bit 2: n
+};
+
+// what one thread parsed from its part of the file
+struct Chunk {
+    const char* begin;
+    const char* end;
+    std::vector<glm::vec3> positions, normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<Corner> corners; // three per triangle
+    bool ok = true;
+    size_t errorLine = 0; // offset of the first line that could not be read
+};
+
+inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+inline const char* skipBlanks(const char* p, const char* end)
+{
+    while (p < end && isBlank(*p))
+        p++;
+    return p;
+}
 
+inline const char* skipLine(const char* p, const char* end)
+{
+    const char* newline = (const char*)memchr(p, '\n', end - p);
+    return newline ? newline + 1 : end;
+}
 
+// decimal float without locale or strtod; false if there is no number at p
+inline bool parseFloat(const char*& p, const char* end, float& value)
+{
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14,
+                                     1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    p = skipBlanks(p, end);
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    // the usual short number is read in one pass; more than 18 digits would overflow the mantissa, those are read
+    // again keeping the first 19 significant digits and counting the rest into the exponent
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    const char* digits = p;
+    for (; p < end && (unsigned)(*p - '0') < 10; p++)
+        mantissa = mantissa * 10 + (*p - '0');
+    size_t count = p - digits;
+    if (p < end && *p == '.')
+    {
+        const char* fraction = ++p;
+        for (; p < end && (unsigned)(*p - '0') < 10; p++)
+            mantissa = mantissa * 10 + (*p - '0');
+        exponent = -(int)(p - fraction);
+        count += p - fraction;
+    }
+    if (count == 0)
+    {
+        p = start;
+        return false;
+    }
+    if (count > 18)
+    {
+        mantissa = 0;
+        exponent = 0;
+        int significant = 0;
+        bool fraction = false;
+        for (const char* c = digits; c < p; c++)
+        {
+            if (*c == '.')
+                fraction = true;
+            else if (significant < 19)
+            {
+                mantissa = mantissa * 10 + (*c - '0');
+                significant += mantissa > 0;
+                exponent -= fraction;
+            }
+            else
+                exponent += !fraction;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* e = p + 1;
+        bool negativeExponent = false;
+        if (e < end && (*e == '-' || *e == '+'))
+            negativeExponent = *e++ == '-';
+        if (e < end && (unsigned)(*e - '0') < 10)
+        {
+            int power = 0;
+            for (; e < end && (unsigned)(*e - '0') < 10; e++)
+                power = power < 10000 ? power * 10 + (*e - '0') : power;
+            exponent += negativeExponent ? -power : power;
+            p = e;
+        }
+    }
 
-bool loadOBJ(
-    const char* path,
-    std::vector<float>& out_vertices,
-    std::vector<float>& out_uvs,
-    std::vector<float>& out_normals
-) {
-    printf("Loading OBJ file %s...\n", path);
+    double result = (double)mantissa;
+    while (exponent > 22)
+        result *= 1e22, exponent -= 22;
+    while (exponent < -22)
+        result /= 1e22, exponent += 22;
+    result = exponent < 0 ? result / powers[-exponent] : result * powers[exponent];
+    value = (float)(negative ? -result : result);
+    return true;
+}
 
-    std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-    std::vector<float> temp_vertices;
-    std::vector<float> temp_uvs;
-    std::vector<float> temp_normals;
+inline bool parseInt(const char*& p, const char* end, int& value)
+{
+    bool negative = false;
+    if (p < end && *p == '-')
+        negative = true, p++;
+    if (p == end || (unsigned)(*p - '0') >= 10)
+        return false;
+    long long result = 0;
+    for (; p < end && (unsigned)(*p - '0') < 10; p++)
+        result = result < INT_MAX ? result * 10 + (*p - '0') : result;
+    if (result > INT_MAX)
+        return false;
+    value = (int)(negative ? -result : result);
+    return true;
+}
 
+// an OBJ index (1 based, or negative counting back from the last attribute read) as a zero based index
+inline bool resolveIndex(int index, size_t count, int& result, unsigned char& relative, unsigned char bit)
+{
+    if (index > 0)
+        result = index - 1;
+    else if (index < 0)
+    {
+        result = (int)count + index; // may be negative, it is completed with the counts of the earlier chunks
+        relative |= bit;
+    }
+    else
+        return false;
+    return true;
+}
 
-    FILE* file = fopen(path, "r");
-    if (file == NULL) {
-        printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
-        getchar();
+// v, v/vt, v//vn or v/vt/vn
+inline bool parseCorner(const char*& p, const char* end, Chunk& chunk, Corner& corner)
+{
+    int index;
+    corner.t = corner.n = NONE;
+    corner.relative = 0;
+    if (!parseInt(p, end, index) || !resolveIndex(index, chunk.positions.size(), corner.v, corner.relative, 1))
         return false;
+    if (p < end && *p == '/')
+    {
+        p++;
+        if (p < end && *p != '/')
+        {
+            if (!parseInt(p, end, index) || !resolveIndex(index, chunk.uvs.size(), corner.t, corner.relative, 2))
+                return false;
+        }
+        if (p < end && *p == '/')
+        {
+            p++;
+            if (!parseInt(p, end, index) || !resolveIndex(index, chunk.normals.size(), corner.n, corner.relative, 4))
+                return false;
+        }
     }
+    return p == end || isBlank(*p) || *p == '\n' || *p == '#';
+}
 
-    while (1) {
-
-        char lineHeader[128];
-        // read the first word of the line
-        int res = fscanf(file, "%s", lineHeader);
-        if (res == EOF)
-            break; // EOF = End Of File. Quit the loop.
-
-        // else : parse lineHeader
-
-        if (strcmp(lineHeader, "v") == 0) {
-            float x, y, z;
-            fscanf(file, "%f %f %f\n", &x, &y, &z);
-            temp_vertices.push_back(x);
-            temp_vertices.push_back(y);
-            temp_vertices.push_back(z);
+inline void parseChunk(Chunk& chunk)
+{
+    PROFILE_FUNCTION();
+    const char* p = chunk.begin;
+    const char* end = chunk.end;
+    // a line is rarely shorter than 24 bytes, this spares most of the reallocations of the arrays
+    size_t lines = (end - p) / 24;
+    chunk.positions.reserve(lines / 4);
+    chunk.corners.reserve(lines);
+    while (p < end)
+    {
+        const char* line = p;
+        p = skipBlanks(p, end);
+        if (p + 1 < end && p[0] == 'v' && isBlank(p[1]))
+        {
+            glm::vec3 position;
+            p += 2;
+            if (!parseFloat(p, end, position.x) || !parseFloat(p, end, position.y) || !parseFloat(p, end, position.z))
+                break;
+            chunk.positions.push_back(position);
         }
-        else if (strcmp(lineHeader, "vt") == 0) {
-            float u, v;
-            fscanf(file, "%f %f\n", &u, &v);
-            v = -v; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
-            temp_uvs.push_back(u);
-            temp_uvs.push_back(v);
+        else if (p + 2 < end && p[0] == 'v' && p[1] == 't' && isBlank(p[2]))
+        {
+            glm::vec2 uv(0.0f);
+            p += 3;
+            if (!parseFloat(p, end, uv.x))
+                break;
+            parseFloat(p, end, uv.y); // a 1D coordinate leaves v at 0
+            uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
+            chunk.uvs.push_back(uv);
         }
-        else if (strcmp(lineHeader, "vn") == 0) {
-            float nx, ny, nz;
-            fscanf(file, "%f %f %f\n", &nx, &ny, &nz);
-            temp_normals.push_back(nx);
-            temp_normals.push_back(ny);
-            temp_normals.push_back(nz);
+        else if (p + 2 < end && p[0] == 'v' && p[1] == 'n' && isBlank(p[2]))
+        {
+            glm::vec3 normal;
+            p += 3;
+            if (!parseFloat(p, end, normal.x) || !parseFloat(p, end, normal.y) || !parseFloat(p, end, normal.z))
+                break;
+            chunk.normals.push_back(normal);
         }
-        else if (strcmp(lineHeader, "f") == 0) {
-            std::string vertex1, vertex2, vertex3;
-            unsigned int vertexIndex[4], uvIndex[4], normalIndex[4];
-            int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n",
-                &vertexIndex[0], &uvIndex[0], &normalIndex[0],
-                &vertexIndex[1], &uvIndex[1], &normalIndex[1],
-                &vertexIndex[2], &uvIndex[2], &normalIndex[2],
-                &vertexIndex[3], &uvIndex[3], &normalIndex[3]);
-            if (matches != 9 && matches != 12) {
-                printf("File can't be read by our simple parser :-( Try exporting with other options\n");
-                fclose(file);
-                return false;
+        else if (p + 1 < end && p[0] == 'f' && isBlank(p[1]))
+        {
+            // fan triangulation: (0, 1, 2), (0, 2, 3), ...
+            Corner first, previous, corner;
+            int count = 0;
+            p++;
+            bool ok = true;
+            while (ok)
+            {
+                p = skipBlanks(p, end);
+                if (p == end || *p == '\n' || *p == '#')
+                    break;
+                ok = parseCorner(p, end, chunk, corner);
+                if (count >= 2)
+                {
+                    chunk.corners.push_back(first);
+                    chunk.corners.push_back(previous);
+                    chunk.corners.push_back(corner);
+                }
+                if (count == 0)
+                    first = corner;
+                previous = corner;
+                count++;
             }
-            // triangle info
-            vertexIndices.push_back(vertexIndex[0]);
-            vertexIndices.push_back(vertexIndex[1]);
-            vertexIndices.push_back(vertexIndex[2]);
-            uvIndices.push_back(uvIndex[0]);
-            uvIndices.push_back(uvIndex[1]);
-            uvIndices.push_back(uvIndex[2]);
-            normalIndices.push_back(normalIndex[0]);
-            normalIndices.push_back(normalIndex[1]);
-            normalIndices.push_back(normalIndex[2]);
-            if (matches == 12) {
-                // if a quad is defined, load as a second triangle
-                vertexIndices.push_back(vertexIndex[0]);
-                vertexIndices.push_back(vertexIndex[2]);
-                vertexIndices.push_back(vertexIndex[3]);
-                uvIndices.push_back(uvIndex[0]);
-                uvIndices.push_back(uvIndex[2]);
-                uvIndices.push_back(uvIndex[3]);
-                normalIndices.push_back(normalIndex[0]);
-                normalIndices.push_back(normalIndex[2]);
-                normalIndices.push_back(normalIndex[3]);
+            if (!ok || count < 3)
+            {
+                p = line;
+                break;
             }
         }
-        else {
-            // Probably a comment, eat up the rest of the line
-            char stupidBuffer[1000];
-            fgets(stupidBuffer, 1000, file);
-        }
-
+        p = skipLine(p, end);
     }
+    if (p < end)
+    {
+        chunk.ok = false;
+        chunk.errorLine = p - chunk.begin;
+    }
+}
 
-    // For each vertex of each triangle
-    for (unsigned int i = 0; i < vertexIndices.size(); i++) {
-
-        // Get the indices of its attributes
-        unsigned int vertexIndex = vertexIndices[i];
-        unsigned int uvIndex = uvIndices[i];
-        unsigned int normalIndex = normalIndices[i];
-
-        // Get the attributes thanks to the index
-        float x = temp_vertices[(vertexIndex - 1) * 3];
-        float y = temp_vertices[(vertexIndex - 1) * 3 + 1];
-        float z = temp_vertices[(vertexIndex - 1) * 3 + 2];
-        float u = temp_uvs[(uvIndex - 1) * 2];
-        float v = temp_uvs[(uvIndex - 1) * 2 + 1];
-        float nx = temp_normals[(normalIndex - 1) * 3];
-        float ny = temp_normals[(normalIndex - 1) * 3 + 1];
-        float nz = temp_normals[(normalIndex - 1) * 3 + 2];
+// open addressing table from v/vt/vn triplets to the vertex made for them, grows to stay at most half full
+class CornerWelder
+{
+public:
+    explicit CornerWelder(size_t expected) : used(0)
+    {
+        size_t size = 16;
+        while (size < expected * 2)
+            size *= 2;
+        slots.assign(size, Slot());
+    }
 
-        // Put the attributes in buffers
-        out_vertices.push_back(x); out_vertices.push_back(y); out_vertices.push_back(z);
-        out_uvs.push_back(u); out_uvs.push_back(v);
-        out_normals.push_back(nx); out_normals.push_back(ny); out_normals.push_back(nz);
+    // the vertex of the triplet, isNew tells whether it was just assigned the next free index
+    unsigned int find(int v, int t, int n, unsigned int next, bool& isNew)
+    {
+        Slot& slot = lookup(v, t, n);
+        isNew = slot.index == EMPTY;
+        if (isNew)
+        {
+            slot.v = v, slot.t = t, slot.n = n, slot.index = next;
+            if (++used * 2 > slots.size())
+                grow();
+            return next;
+        }
+        return slot.index;
+    }
 
+private:
+    static const unsigned int EMPTY = 0xffffffffu;
+    struct Slot {
+        int v = 0, t = 0, n = 0;
+        unsigned int index = EMPTY;
+    };
+    std::vector<Slot> slots;
+    size_t used;
+
+    // the slot holding the triplet, or the empty one it goes into
+    Slot& lookup(int v, int t, int n)
+    {
+        uint64_t hash = (uint32_t)v * 0x9e3779b97f4a7c15ull ^ (uint32_t)t * 0xc2b2ae3d27d4eb4full ^ (uint32_t)n * 0x165667b19e3779f9ull;
+        size_t mask = slots.size() - 1;
+        size_t i = (size_t)(hash ^ (hash >> 29)) & mask;
+        while (slots[i].index != EMPTY && (slots[i].v != v || slots[i].t != t || slots[i].n != n))
+            i = (i + 1) & mask;
+        return slots[i];
     }
-    fclose(file);
-    return true;
-}
 
+    void grow()
+    {
+        std::vector<Slot> old(slots.size() * 2);
+        old.swap(slots);
+        for (const Slot& slot : old)
+            if (slot.index != EMPTY)
+                lookup(slot.v, slot.t, slot.n) = slot;
+    }
+};
 
+} // namespace objloader
 
-bool loadOBJ(
-    const char* path,
-    std::vector<glm::vec3>& out_vertices,
-    std::vector<glm::vec2>& out_uvs,
-    std::vector<glm::vec3>& out_normals
-) {
+// loads the OBJ at path into an indexed mesh. threads = 0 uses one per hardware thread; files under a few MB are
+// parsed on the calling thread.
+// ------------------------------------------------------------------------
+inline bool loadOBJ(const char* path, ObjMesh& mesh, unsigned int threads = 0)
+{
+    using namespace objloader;
+    PROFILE_FUNCTION();
     printf("Loading OBJ file %s...\n", path);
 
-    std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-    std::vector<glm::vec3> temp_vertices;
-    std::vector<glm::vec2> temp_uvs;
-    std::vector<glm::vec3> temp_normals;
-
-
-    FILE* file = fopen(path, "r");
-    if (file == NULL) {
+    MappedFile file;
+    if (!file.open(path)) {
         printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
-        getchar();
         return false;
     }
+    const char* data = (const char*)file.data();
+    const char* end = data + file.size();
+
+    // split into line aligned chunks of at least 4 MB
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threads, file.size() / (4 << 20)));
+    std::vector<Chunk> chunks(chunkCount);
+    const char* begin = data;
+    for (size_t i = 0; i < chunkCount; i++)
+    {
+        const char* split = i + 1 == chunkCount ? end : data + file.size() / chunkCount * (i + 1);
+        if (split < begin)
+            split = begin;
+        if (split < end)
+            split = skipLine(split, end);
+        chunks[i].begin = begin;
+        chunks[i].end = split;
+        begin = split;
+    }
+    {
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < chunkCount; i++)
+            workers.emplace_back(parseChunk, std::ref(chunks[i]));
+        parseChunk(chunks[0]);
+        for (std::thread& worker : workers)
+            worker.join();
+    }
 
-    while (1) {
-
-        char lineHeader[128];
-        // read the first word of the line
-        int res = fscanf(file, "%s", lineHeader);
-        if (res == EOF)
-            break; // EOF = End Of File. Quit the loop.
-
-        // else : parse lineHeader
-
-        if (strcmp(lineHeader, "v") == 0) {
-            glm::vec3 vertex;
-            fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
-            temp_vertices.push_back(vertex);
-        }
-        else if (strcmp(lineHeader, "vt") == 0) {
-            glm::vec2 uv;
-            fscanf(file, "%f %f\n", &uv.x, &uv.y);
-            uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
-            temp_uvs.push_back(uv);
+    // relative indices become absolute with the attribute counts of the chunks before
+    size_t positionCount = 0, uvCount = 0, normalCount = 0, cornerCount = 0;
+    for (Chunk& chunk : chunks)
+    {
+        if (!chunk.ok)
+        {
+            size_t line = 1 + std::count(data, chunk.begin + chunk.errorLine, '\n');
+            printf("File can't be read by our simple parser :-( Line %zu is malformed\n", line);
+            return false;
         }
-        else if (strcmp(lineHeader, "vn") == 0) {
-            glm::vec3 normal;
-            fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
-            temp_normals.push_back(normal);
+        for (Corner& corner : chunk.corners)
+        {
+            if (corner.relative & 1)
+                corner.v += (int)positionCount;
+            if (corner.relative & 2)
+                corner.t += (int)uvCount;
+            if (corner.relative & 4)
+                corner.n += (int)normalCount;
         }
-        else if (strcmp(lineHeader, "f") == 0) {
-            unsigned int vertexIndex[4], uvIndex[4], normalIndex[4];
-            int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n",
-                &vertexIndex[0], &uvIndex[0], &normalIndex[0],
-                &vertexIndex[1], &uvIndex[1], &normalIndex[1],
-                &vertexIndex[2], &uvIndex[2], &normalIndex[2],
-                &vertexIndex[3], &uvIndex[3], &normalIndex[3]);
-            if (matches != 9 && matches != 12) {
-                printf("File can't be read by our simple parser :-( Try exporting with other options\n");
-                fclose(file);
+        positionCount += chunk.positions.size();
+        uvCount += chunk.uvs.size();
+        normalCount += chunk.normals.size();
+        cornerCount += chunk.corners.size();
+    }
+    // the arrays of the first chunk are taken over, the others appended
+    std::vector<glm::vec3> positions, normals;
+    std::vector<glm::vec2> uvs;
+    positions.swap(chunks[0].positions);
+    uvs.swap(chunks[0].uvs);
+    normals.swap(chunks[0].normals);
+    for (size_t i = 1; i < chunkCount; i++)
+    {
+        positions.insert(positions.end(), chunks[i].positions.begin(), chunks[i].positions.end());
+        uvs.insert(uvs.end(), chunks[i].uvs.begin(), chunks[i].uvs.end());
+        normals.insert(normals.end(), chunks[i].normals.begin(), chunks[i].normals.end());
+        std::vector<glm::vec3>().swap(chunks[i].positions);
+        std::vector<glm::vec2>().swap(chunks[i].uvs);
+        std::vector<glm::vec3>().swap(chunks[i].normals);
+    }
+
+    // weld corners with the same triplet into one vertex
+    PROFILE_ZONE("weld");
+    mesh = ObjMesh();
+    mesh.indices.reserve(cornerCount);
+    mesh.positions.reserve(positionCount);
+    mesh.uvs.reserve(positionCount);
+    mesh.normals.reserve(positionCount);
+    // most corners of a position repeat the triplet of its first corner, that one is found through the position
+    // itself and only the others go through the hash table
+    std::vector<unsigned int> firstVertex(positionCount, 0xffffffffu);
+    std::vector<int> firstT, firstN;
+    firstT.reserve(positionCount);
+    firstN.reserve(positionCount);
+    CornerWelder welder(positionCount / 8);
+    for (const Chunk& chunk : chunks)
+    {
+        for (const Corner& corner : chunk.corners)
+        {
+            if (corner.v < 0 || corner.v >= (int)positionCount || (corner.t != NONE && (corner.t < 0 || corner.t >= (int)uvCount)) ||
+                (corner.n != NONE && (corner.n < 0 || corner.n >= (int)normalCount)))
+            {
+                printf("File can't be read by our simple parser :-( A face uses an attribute that does not exist\n");
+                mesh = ObjMesh();
                 return false;
             }
-            vertexIndices.push_back(vertexIndex[0]);
-            vertexIndices.push_back(vertexIndex[1]);
-            vertexIndices.push_back(vertexIndex[2]);
-            uvIndices.push_back(uvIndex[0]);
-            uvIndices.push_back(uvIndex[1]);
-            uvIndices.push_back(uvIndex[2]);
-            normalIndices.push_back(normalIndex[0]);
-            normalIndices.push_back(normalIndex[1]);
-            normalIndices.push_back(normalIndex[2]);
-
-            if (matches == 12) {
-                // if a quad is defined, load as a second triangle
-                vertexIndices.push_back(vertexIndex[0]);
-                vertexIndices.push_back(vertexIndex[2]);
-                vertexIndices.push_back(vertexIndex[3]);
-                uvIndices.push_back(uvIndex[0]);
-                uvIndices.push_back(uvIndex[2]);
-                uvIndices.push_back(uvIndex[3]);
-                normalIndices.push_back(normalIndex[0]);
-                normalIndices.push_back(normalIndex[2]);
-                normalIndices.push_back(normalIndex[3]);
+            unsigned int index = firstVertex[corner.v];
+            bool isNew = index == 0xffffffffu;
+            if (isNew)
+                index = firstVertex[corner.v] = (unsigned int)mesh.positions.size();
+            else if (firstT[index] != corner.t || firstN[index] != corner.n)
+                index = welder.find(corner.v, corner.t, corner.n, (unsigned int)mesh.positions.size(), isNew);
+            if (isNew)
+            {
+                firstT.push_back(corner.t);
+                firstN.push_back(corner.n);
+                mesh.positions.push_back(positions[corner.v]);
+                mesh.uvs.push_back(corner.t != NONE ? uvs[corner.t] : glm::vec2(0.0f));
+                mesh.normals.push_back(corner.n != NONE ? normals[corner.n] : glm::vec3(0.0f));
             }
+            mesh.indices.push_back(index);
         }
-        else {
-            // Probably a comment, eat up the rest of the line
-            char stupidBuffer[1000];
-            fgets(stupidBuffer, 1000, file);
-        }
-
     }
+    return true;
+}
 
-    // For each vertex of each triangle
-    for (unsigned int i = 0; i < vertexIndices.size(); i++) {
 
-        // Get the indices of its attributes
-        unsigned int vertexIndex = vertexIndices[i];
-        unsigned int uvIndex = uvIndices[i];
-        unsigned int normalIndex = normalIndices[i];
 
-        // Get the attributes thanks to the index
-        glm::vec3 vertex = temp_vertices[vertexIndex - 1];
-        glm::vec2 uv = temp_uvs[uvIndex - 1];
-        glm::vec3 normal = temp_normals[normalIndex - 1];
+// unindexed variants: every corner of every triangle is written out as its own vertex
+bool loadOBJ(
+    const char* path,
+    std::vector<float>& out_vertices,
+    std::vector<float>& out_uvs,
+    std::vector<float>& out_normals
+) {
+    ObjMesh mesh;
+    if (!loadOBJ(path, mesh))
+        return false;
+
+    // For each vertex of each triangle
+    for (unsigned int i = 0; i < mesh.indices.size(); i++) {
+        unsigned int index = mesh.indices[i];
 
         // Put the attributes in buffers
-        out_vertices.push_back(vertex);
-        out_uvs.push_back(uv);
-        out_normals.push_back(normal);
+        out_vertices.push_back(mesh.positions[index].x); out_vertices.push_back(mesh.positions[index].y); out_vertices.push_back(mesh.positions[index].z);
+        out_uvs.push_back(mesh.uvs[index].x); out_uvs.push_back(mesh.uvs[index].y);
+        out_normals.push_back(mesh.normals[index].x); out_normals.push_back(mesh.normals[index].y); out_normals.push_back(mesh.normals[index].z);
+    }
+    return true;
+}
+
 
+
+bool loadOBJ(
+    const char* path,
+    std::vector<glm::vec3>& out_vertices,
+    std::vector<glm::vec2>& out_uvs,
+    std::vector<glm::vec3>& out_normals
+) {
+    ObjMesh mesh;
+    if (!loadOBJ(path, mesh))
+        return false;
+
+    // For each vertex of each triangle
+    for (unsigned int i = 0; i < mesh.indices.size(); i++) {
+        unsigned int index = mesh.indices[i];
+
+        // Put the attributes in buffers
+        out_vertices.push_back(mesh.positions[index]);
+        out_uvs.push_back(mesh.uvs[index]);
+        out_normals.push_back(mesh.normals[index]);
     }
-    fclose(file);
     return true;
 }
 
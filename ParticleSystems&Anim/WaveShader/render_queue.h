@@ -0,0 +1,620 @@
+// Draws collected over a frame, sorted by their state and issued with as few state changes as possible
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "geometry_arena.h"
+#include "profiler.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+// Model and Mesh submit() a packet per draw instead of drawing right away. flush() orders the packets by a 64 bit
+// key, from the most significant bits down
+//   10 bits program | 20 bits material | 18 bits vertex array | 16 bits depth
+// with a radix sort, then issues them and only changes the program, the textures, the vertex array and the position
+// decode uniforms where they differ from the draw before. The program and vertex array bits are their GL names, a
+// collision of two names only costs the grouping, never a wrong draw. Depth is in [0, 1], near first.
+//
+// Draws that follow each other with the same program and vertex array and materials that bind the same textures
+// become one glMultiDrawElementsIndirect, which is what meshes moved into a GeometryArena turn into: the whole arena
+// draws with one call however many meshes it holds. Each command gets the decode values of its mesh as a record of
+// the attributes DrawPositionOffset and DrawPositionScale (see geometry_arena.h), picked by its base instance, and
+// the bool uniform MergedDraw is set for the shader to read them instead of the uniforms:
+//   vec3 offset = MergedDraw ? DrawPositionOffset : PositionOffset;
+// A program without MergedDraw is drawn one mesh at a time.
+//
+// A material is the textures of a mesh with the sampler uniform each one is read through. How a texture reaches its
+// sampler depends on the type the program declares it with:
+//   sampler2DArray  the texture is copied into a 2D array texture of its format, size and level count the first time
+//                   a program samples it, the array is bound to the unit of the sampler and the float uniform
+//                   <sampler>Layer is set to its layer. Meshes whose textures share arrays draw without rebinding.
+//   sampler2D       with ARB_bindless_texture the resident handle of the texture is loaded into the uniform and no
+//                   unit is bound at all (the shader declares the sampler layout(bindless_sampler)), without it the
+//                   texture is bound to the unit of the sampler unless it is bound there already.
+// A shader that samples the diffuse map on any driver:
+//   uniform sampler2DArray texture_diffuse1;
+//   uniform float texture_diffuse1Layer;
+//   ... texture(texture_diffuse1, vec3(TexCoords, texture_diffuse1Layer)) ...
+class RenderQueue
+{
+public:
+    // a draw, everything the queue needs besides the textures of the material
+    struct Packet {
+        const Shader* shader;
+        unsigned int material; // from material()
+        GLuint vertexArray;
+        GLsizei indexCount;
+        GLenum indexType;
+        GLuint firstIndex;
+        GLint baseVertex;
+        glm::vec3 positionOffset, positionScale; // see PackedVertex in mesh.h
+    };
+
+    // a texture of a material and the sampler uniform it is read through
+    struct MaterialSlot {
+        std::string sampler;
+        GLuint texture;
+    };
+
+    // of the last flush()
+    unsigned int draws = 0, programChanges = 0, materialChanges = 0, vertexArrayChanges = 0, textureBinds = 0, multiDraws = 0;
+
+    // looks for ARB_bindless_texture, load resolves the GL entry points of the current context
+    // ------------------------------------------------------------------------
+    void init(GLADloadproc load)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        bool supported = false;
+        for (GLint i = 0; i < count && !supported; i++)
+            supported = std::strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_bindless_texture") == 0;
+        if (supported)
+        {
+            getTextureHandle = (PFN_glGetTextureHandleARB)load("glGetTextureHandleARB");
+            makeTextureHandleResident = (PFN_glMakeTextureHandleResidentARB)load("glMakeTextureHandleResidentARB");
+            makeTextureHandleNonResident = (PFN_glMakeTextureHandleNonResidentARB)load("glMakeTextureHandleNonResidentARB");
+            uniformHandle = (PFN_glUniformHandleui64ARB)load("glUniformHandleui64ARB");
+        }
+        useBindless = supported && getTextureHandle && makeTextureHandleResident && makeTextureHandleNonResident && uniformHandle;
+    }
+
+    bool bindless() const { return useBindless; }
+
+    // the id of the material made of slots, the same for the same textures and samplers
+    // ------------------------------------------------------------------------
+    unsigned int material(const std::vector<MaterialSlot>& slots)
+    {
+        std::string key;
+        for (const MaterialSlot& slot : slots)
+            key += slot.sampler + '=' + std::to_string(slot.texture) + ';';
+        std::map<std::string, unsigned int>::iterator found = materialIds.find(key);
+        if (found != materialIds.end())
+            return found->second;
+        unsigned int id = (unsigned int)materials.size();
+        materials.push_back(slots);
+        materialIds[key] = id;
+        return id;
+    }
+
+    // queues a draw until the next flush(), depth orders the draws that share all state
+    // ------------------------------------------------------------------------
+    void submit(const Packet& packet, float depth)
+    {
+        uint64_t program = packet.shader->ID & 0x3ff, material = packet.material & 0xfffff, vertexArray = packet.vertexArray & 0x3ffff;
+        uint64_t z = (uint64_t)(glm::clamp(depth, 0.0f, 1.0f) * 65535.0f);
+        Entry entry;
+        entry.key = program << 54 | material << 34 | vertexArray << 16 | z;
+        entry.packet = (uint32_t)packets.size();
+        entries.push_back(entry);
+        packets.push_back(packet);
+    }
+
+    // sorts and issues the queued draws, the queue is empty afterwards
+    // ------------------------------------------------------------------------
+    void flush()
+    {
+        PROFILE_FUNCTION();
+        draws = programChanges = materialChanges = vertexArrayChanges = textureBinds = multiDraws = 0;
+        sortEntries();
+        // whatever was bound before the flush is unknown, the first draw sets everything
+        boundUnits.assign(boundUnits.size(), BoundUnit());
+        activeUnit = -1;
+        buildBatches();
+
+        ProgramState* program = nullptr;
+        GLuint currentProgram = 0, currentVertexArray = 0;
+        unsigned int currentMaterial = ~0u;
+        glm::vec3 currentOffset(0.0f), currentScale(1.0f);
+        bool decodeSet = false;
+        for (const Batch& batch : batches)
+        {
+            const Packet& packet = packets[entries[batch.first].packet];
+            if (packet.shader->ID != currentProgram)
+            {
+                if (program)
+                    setMerged(*program, false);
+                currentProgram = packet.shader->ID;
+                glUseProgram(currentProgram);
+                program = &programState(*packet.shader);
+                currentMaterial = ~0u;
+                decodeSet = false;
+                programChanges++;
+            }
+            if (packet.material != currentMaterial)
+            {
+                currentMaterial = packet.material;
+                applyMaterial(*program, *packet.shader, packet.material);
+                materialChanges++;
+            }
+            if (packet.vertexArray != currentVertexArray)
+            {
+                currentVertexArray = packet.vertexArray;
+                glBindVertexArray(currentVertexArray);
+                vertexArrayChanges++;
+            }
+            if (batch.count > 1)
+            {
+                // the records are selected by the base instance of each command
+                setMerged(*program, true);
+                glBindVertexBuffer(1, recordBuffer, 0, sizeof(GeometryArena::DrawRecord));
+                glMultiDrawElementsIndirect(GL_TRIANGLES, packet.indexType, (const void*)(batch.command * sizeof(DrawCommand)),
+                                            (GLsizei)batch.count, 0);
+                draws += batch.count;
+                multiDraws++;
+                continue;
+            }
+            setMerged(*program, false);
+            if (!decodeSet || packet.positionOffset != currentOffset || packet.positionScale != currentScale)
+            {
+                decodeSet = true;
+                currentOffset = packet.positionOffset;
+                currentScale = packet.positionScale;
+                glUniform3fv(program->positionOffset, 1, &currentOffset[0]);
+                glUniform3fv(program->positionScale, 1, &currentScale[0]);
+            }
+            size_t indexSize = packet.indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+            glDrawElementsBaseVertex(GL_TRIANGLES, packet.indexCount, packet.indexType,
+                                     (const void*)(packet.firstIndex * indexSize), packet.baseVertex);
+            draws++;
+        }
+        if (program)
+            setMerged(*program, false);
+        packets.clear();
+        entries.clear();
+
+        // always good practice to set everything back to defaults once configured.
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+        flushes++;
+        totalStateChanges += programChanges + materialChanges + vertexArrayChanges + textureBinds;
+    }
+
+    // releases the handles and arrays while the context is current, before the textures are deleted
+    // ------------------------------------------------------------------------
+    void release()
+    {
+        for (std::map<GLuint, GLuint64>::iterator handle = handles.begin(); handle != handles.end(); ++handle)
+            makeTextureHandleNonResident(handle->second);
+        handles.clear();
+        for (TextureArray& array : arrays)
+            glDeleteTextures(1, &array.id);
+        arrays.clear();
+        arrayLayers.clear();
+        programs.clear();
+        if (commandBuffer)
+        {
+            glDeleteBuffers(1, &commandBuffer);
+            glDeleteBuffers(1, &recordBuffer);
+        }
+        commandBuffer = recordBuffer = 0;
+    }
+
+    void printStats() const
+    {
+        std::printf("Render queue: %s, %u materials, %u texture arrays, last frame %u draws in %u multi-draws and %u single "
+                    "ones with %u program, %u material, %u vertex array changes and %u texture binds, %.1f state changes per "
+                    "frame\n", useBindless ? "bindless" : "texture arrays", (unsigned int)materials.size(),
+                    (unsigned int)arrays.size(), draws, multiDraws, (unsigned int)batches.size() - multiDraws, programChanges,
+                    materialChanges, vertexArrayChanges, textureBinds, flushes ? (double)totalStateChanges / flushes : 0.0);
+    }
+
+private:
+    // ARB_bindless_texture, which the generated loader does not cover
+    typedef GLuint64 (APIENTRYP PFN_glGetTextureHandleARB)(GLuint texture);
+    typedef void (APIENTRYP PFN_glMakeTextureHandleResidentARB)(GLuint64 handle);
+    typedef void (APIENTRYP PFN_glMakeTextureHandleNonResidentARB)(GLuint64 handle);
+    typedef void (APIENTRYP PFN_glUniformHandleui64ARB)(GLint location, GLuint64 value);
+    PFN_glGetTextureHandleARB getTextureHandle = nullptr;
+    PFN_glMakeTextureHandleResidentARB makeTextureHandleResident = nullptr;
+    PFN_glMakeTextureHandleNonResidentARB makeTextureHandleNonResident = nullptr;
+    PFN_glUniformHandleui64ARB uniformHandle = nullptr;
+    bool useBindless = false;
+
+    struct Entry {
+        uint64_t key;
+        uint32_t packet;
+    };
+
+    // sorted draws issued together, by one multi-draw if there are several
+    struct Batch {
+        size_t first; // into entries
+        size_t count;
+        size_t command; // the first of the commands of a multi-draw
+    };
+
+    // the layout glMultiDrawElementsIndirect reads
+    struct DrawCommand {
+        GLuint count, instanceCount, firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // how a slot of a material reaches the sampler of one program
+    struct SlotBinding {
+        GLint location, layerLocation;
+        GLuint texture; // a 2D texture, unless array is set
+        GLuint64 handle; // bindless, instead of a unit
+        int array; // index into arrays, -1 if none
+        int layer;
+        int unit;
+    };
+
+    // the locations of a program, its materials resolved the first time they are drawn with it
+    struct ProgramState {
+        GLint positionOffset, positionScale, mergedDraw;
+        bool merged = false; // the value of MergedDraw
+        std::vector<std::vector<SlotBinding>> materials;
+        std::vector<bool> resolved;
+    };
+
+    // the 2D textures of one format, size and level count as layers, grown by doubling
+    struct TextureArray {
+        GLuint id;
+        GLenum internalFormat;
+        GLsizei width, height, levels, layers, capacity;
+    };
+
+    // what the flush bound to a unit, 0 if unknown
+    struct BoundUnit {
+        GLuint texture = 0, array = 0;
+    };
+
+    std::vector<Packet> packets;
+    std::vector<Entry> entries, scratch;
+    std::vector<Batch> batches;
+    std::vector<DrawCommand> commands;
+    std::vector<GeometryArena::DrawRecord> records;
+    GLuint commandBuffer = 0, recordBuffer = 0;
+    std::vector<std::vector<MaterialSlot>> materials;
+    std::map<std::string, unsigned int> materialIds;
+    std::map<GLuint, ProgramState> programs;
+    std::map<GLuint, GLuint64> handles; // resident, of every texture sampled bindless
+    std::vector<TextureArray> arrays;
+    std::map<GLuint, std::pair<int, int>> arrayLayers; // array and layer of every texture copied into one
+    std::vector<BoundUnit> boundUnits;
+    int activeUnit = -1;
+    unsigned int flushes = 0;
+    uint64_t totalStateChanges = 0;
+
+    // least significant byte first; every pass is stable, so the order of the lower bytes survives. The counts of
+    // all eight bytes come from one pass over the keys, bytes in which all keys agree are skipped
+    // ------------------------------------------------------------------------
+    void sortEntries()
+    {
+        PROFILE_FUNCTION();
+        if (entries.size() < 2)
+            return;
+        size_t counts[8][256];
+        std::memset(counts, 0, sizeof(counts));
+        for (const Entry& entry : entries)
+            for (int b = 0; b < 8; b++)
+                counts[b][(entry.key >> (8 * b)) & 0xff]++;
+        scratch.resize(entries.size());
+        for (int b = 0; b < 8; b++)
+        {
+            int shift = 8 * b;
+            if (counts[b][(entries[0].key >> shift) & 0xff] == entries.size())
+                continue;
+            size_t offset = 0;
+            for (int digit = 0; digit < 256; digit++)
+            {
+                size_t count = counts[b][digit];
+                counts[b][digit] = offset;
+                offset += count;
+            }
+            for (const Entry& entry : entries)
+                scratch[counts[b][(entry.key >> shift) & 0xff]++] = entry;
+            entries.swap(scratch);
+        }
+    }
+
+    ProgramState& programState(const Shader& shader)
+    {
+        std::map<GLuint, ProgramState>::iterator found = programs.find(shader.ID);
+        if (found != programs.end())
+            return found->second;
+        ProgramState& state = programs[shader.ID];
+        state.positionOffset = shader.uniform("PositionOffset");
+        state.positionScale = shader.uniform("PositionScale");
+        state.mergedDraw = shader.uniform("MergedDraw");
+        return state;
+    }
+
+    void setMerged(ProgramState& program, bool merged)
+    {
+        if (program.mergedDraw < 0 || program.merged == merged)
+            return;
+        glUniform1i(program.mergedDraw, merged);
+        program.merged = merged;
+    }
+
+    // groups the sorted draws into batches, a run that can be one multi-draw gets a command and a record per draw.
+    // Both are uploaded for the flush.
+    // ------------------------------------------------------------------------
+    void buildBatches()
+    {
+        PROFILE_FUNCTION();
+        batches.clear();
+        commands.clear();
+        records.clear();
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            if (!batches.empty() && mergeable(packets[entries[batches.back().first].packet], packets[entries[i].packet]))
+            {
+                batches.back().count++;
+                continue;
+            }
+            Batch batch = { i, 1, 0 };
+            batches.push_back(batch);
+        }
+        for (Batch& batch : batches)
+        {
+            if (batch.count < 2)
+                continue;
+            batch.command = commands.size();
+            for (size_t i = batch.first; i < batch.first + batch.count; i++)
+            {
+                const Packet& packet = packets[entries[i].packet];
+                DrawCommand command = { (GLuint)packet.indexCount, 1, packet.firstIndex, packet.baseVertex, (GLuint)records.size() };
+                commands.push_back(command);
+                GeometryArena::DrawRecord record;
+                std::memcpy(record.positionOffset, &packet.positionOffset[0], sizeof(record.positionOffset));
+                std::memcpy(record.positionScale, &packet.positionScale[0], sizeof(record.positionScale));
+                records.push_back(record);
+            }
+        }
+        if (commands.empty())
+            return;
+        if (!commandBuffer)
+        {
+            glGenBuffers(1, &commandBuffer);
+            glGenBuffers(1, &recordBuffer);
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawCommand), commands.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, recordBuffer);
+        glBufferData(GL_ARRAY_BUFFER, records.size() * sizeof(GeometryArena::DrawRecord), records.data(), GL_STREAM_DRAW);
+    }
+
+    // whether packet can join the multi-draw that first starts
+    bool mergeable(const Packet& first, const Packet& packet)
+    {
+        if (packet.shader->ID != first.shader->ID || packet.vertexArray != first.vertexArray || packet.indexType != first.indexType)
+            return false;
+        ProgramState& program = programState(*packet.shader);
+        if (program.mergedDraw < 0)
+            return false;
+        if (packet.material == first.material)
+            return true;
+        const std::vector<SlotBinding>& a = bindings(program, *packet.shader, first.material);
+        const std::vector<SlotBinding>& b = bindings(program, *packet.shader, packet.material);
+        if (a.size() != b.size())
+            return false;
+        for (size_t i = 0; i < a.size(); i++)
+            if (a[i].location != b[i].location || a[i].texture != b[i].texture || a[i].handle != b[i].handle ||
+                a[i].array != b[i].array || a[i].layer != b[i].layer || a[i].unit != b[i].unit)
+                return false;
+        return true;
+    }
+
+    // the slots of a material for a program, resolved on first use. The table holds every material, so a second
+    // call does not move what the first one returned
+    const std::vector<SlotBinding>& bindings(ProgramState& program, const Shader& shader, unsigned int material)
+    {
+        if (program.resolved.size() < materials.size())
+        {
+            program.materials.resize(materials.size());
+            program.resolved.resize(materials.size(), false);
+        }
+        if (!program.resolved[material])
+        {
+            program.materials[material] = resolve(shader, materials[material]);
+            program.resolved[material] = true;
+        }
+        return program.materials[material];
+    }
+
+    // sets the samplers of a material, the program is in use
+    // ------------------------------------------------------------------------
+    void applyMaterial(ProgramState& program, const Shader& shader, unsigned int material)
+    {
+        for (const SlotBinding& slot : bindings(program, shader, material))
+        {
+            if (slot.handle)
+            {
+                uniformHandle(slot.location, slot.handle);
+                continue;
+            }
+            if (boundUnits.size() <= (size_t)slot.unit)
+                boundUnits.resize(slot.unit + 1);
+            BoundUnit& unit = boundUnits[slot.unit];
+            GLuint array = slot.array >= 0 ? arrays[slot.array].id : 0;
+            if (array ? unit.array != array : unit.texture != slot.texture)
+            {
+                selectUnit(slot.unit);
+                if (array)
+                    glBindTexture(GL_TEXTURE_2D_ARRAY, unit.array = array);
+                else
+                    glBindTexture(GL_TEXTURE_2D, unit.texture = slot.texture);
+                textureBinds++;
+            }
+            glUniform1i(slot.location, slot.unit);
+            if (slot.layerLocation >= 0)
+                glUniform1f(slot.layerLocation, (float)slot.layer);
+        }
+    }
+
+    // the slots the program samples, the N-th slot on unit N
+    std::vector<SlotBinding> resolve(const Shader& shader, const std::vector<MaterialSlot>& slots)
+    {
+        std::vector<SlotBinding> bindings;
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            SlotBinding binding;
+            binding.location = shader.uniform(slots[i].sampler.c_str());
+            if (binding.location < 0)
+                continue;
+            binding.layerLocation = -1;
+            binding.texture = slots[i].texture;
+            binding.handle = 0;
+            binding.array = -1;
+            binding.layer = 0;
+            binding.unit = (int)i;
+
+            GLenum type = GL_SAMPLER_2D;
+            GLuint index = glGetProgramResourceIndex(shader.ID, GL_UNIFORM, slots[i].sampler.c_str());
+            const GLenum property = GL_TYPE;
+            if (index != GL_INVALID_INDEX)
+                glGetProgramResourceiv(shader.ID, GL_UNIFORM, index, 1, &property, 1, NULL, (GLint*)&type);
+            if (type == GL_SAMPLER_2D_ARRAY)
+            {
+                std::pair<int, int> layer = arrayLayer(binding.texture);
+                if (layer.first < 0)
+                    continue;
+                binding.array = layer.first;
+                binding.layer = layer.second;
+                binding.layerLocation = shader.uniform((slots[i].sampler + "Layer").c_str());
+            }
+            else if (useBindless)
+                binding.handle = residentHandle(binding.texture);
+            bindings.push_back(binding);
+        }
+        return bindings;
+    }
+
+    void selectUnit(int unit)
+    {
+        if (unit == activeUnit)
+            return;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+    }
+
+    GLuint64 residentHandle(GLuint texture)
+    {
+        std::map<GLuint, GLuint64>::iterator found = handles.find(texture);
+        if (found != handles.end())
+            return found->second;
+        GLuint64 handle = getTextureHandle(texture);
+        makeTextureHandleResident(handle);
+        handles[texture] = handle;
+        return handle;
+    }
+
+    // the array and layer a 2D texture was copied to, copies it if it was not yet. -1 if it cannot be read
+    // ------------------------------------------------------------------------
+    std::pair<int, int> arrayLayer(GLuint texture)
+    {
+        std::map<GLuint, std::pair<int, int>>::iterator found = arrayLayers.find(texture);
+        if (found != arrayLayers.end())
+            return found->second;
+
+        // the texture is bound to the active unit for the queries, which the flush has to know
+        if (activeUnit < 0)
+            selectUnit(0);
+        if (boundUnits.size() <= (size_t)activeUnit)
+            boundUnits.resize(activeUnit + 1);
+        glBindTexture(GL_TEXTURE_2D, boundUnits[activeUnit].texture = texture);
+        GLint internalFormat = 0, width = 0, height = 0, levels = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+        for (GLint levelWidth = width; levels < 16 && levelWidth > 0; levels++)
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, levels + 1, GL_TEXTURE_WIDTH, &levelWidth);
+        internalFormat = sizedFormat(internalFormat);
+        if (width <= 0 || height <= 0)
+            return arrayLayers[texture] = std::make_pair(-1, 0);
+
+        int array = -1;
+        for (size_t i = 0; i < arrays.size() && array < 0; i++)
+            if (arrays[i].internalFormat == (GLenum)internalFormat && arrays[i].width == width && arrays[i].height == height &&
+                arrays[i].levels == levels)
+                array = (int)i;
+        if (array < 0)
+        {
+            TextureArray created = { 0, (GLenum)internalFormat, width, height, levels, 0, 0 };
+            arrays.push_back(created);
+            array = (int)arrays.size() - 1;
+        }
+        TextureArray& target = arrays[array];
+        if (target.layers == target.capacity)
+            grow(target);
+        int layer = target.layers++;
+        for (GLint level = 0; level < levels; level++)
+            glCopyImageSubData(texture, GL_TEXTURE_2D, level, 0, 0, 0, target.id, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+                               std::max(1, width >> level), std::max(1, height >> level), 1);
+        return arrayLayers[texture] = std::make_pair(array, layer);
+    }
+
+    // reallocates an array with twice the layers and moves the layers over, the bindings refer to it by index
+    void grow(TextureArray& array)
+    {
+        GLsizei capacity = array.capacity ? array.capacity * 2 : 1;
+        GLuint id;
+        glGenTextures(1, &id);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, array.levels, array.internalFormat, array.width, array.height, capacity);
+        // the same sampling as uploadTexture2D()
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, array.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        if (array.layers)
+        {
+            for (GLsizei level = 0; level < array.levels; level++)
+                glCopyImageSubData(array.id, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, id, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+                                   std::max(1, array.width >> level), std::max(1, array.height >> level), array.layers);
+            glDeleteTextures(1, &array.id);
+        }
+        array.id = id;
+        array.capacity = capacity;
+        // the new array is bound to the active unit now
+        if (activeUnit >= 0 && (size_t)activeUnit < boundUnits.size())
+            boundUnits[activeUnit].array = id;
+    }
+
+    // texture storage needs a sized format, uploadTexture2D() creates its textures with the base ones
+    static GLint sizedFormat(GLint format)
+    {
+        switch (format)
+        {
+        case GL_RED: return GL_R8;
+        case GL_RG: return GL_RG8;
+        case GL_RGB: return GL_RGB8;
+        case GL_RGBA: return GL_RGBA8;
+        case GL_SRGB: return GL_SRGB8;
+        case GL_SRGB_ALPHA: return GL_SRGB8_ALPHA8;
+        default: return format;
+        }
+    }
+};
+#endif
@@ -0,0 +1,10 @@
+#version 330 core
+
+uniform vec3 Color; //color of the box outline
+
+// output color of this fragment
+layout ( location = 0 ) out vec4 FragColor;
+
+void main(){
+	FragColor = vec4(Color, 1.0);
+}
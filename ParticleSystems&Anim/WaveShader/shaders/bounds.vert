@@ -0,0 +1,9 @@
+#version 330 core
+layout (location = 0) in vec3 VertexPosition;
+
+uniform mat4 MVP; //represents the model, view and projection matrices combined
+
+//Corners of the bounding box, drawn as lines while the model it stands for is still loading
+void main(){
+	gl_Position = MVP * vec4(VertexPosition, 1.0);
+}
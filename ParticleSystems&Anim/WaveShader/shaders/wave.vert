@@ -1,6 +1,9 @@
 #version 330 core
 layout (location = 0) in vec3 VertexPosition;
 layout (location = 1) in vec3 VertexNormal;
+//Decode values of the mesh when it is one of the draws of a multi-draw (see render_queue.h)
+layout (location = 5) in vec3 DrawPositionOffset;
+layout (location = 6) in vec3 DrawPositionScale;
 
 uniform float Time; //time of animation
 
@@ -13,12 +16,19 @@ uniform mat4 ModelViewMatrix; // represents model coordinates in the world coord
 uniform mat3 NormalMatrix;
 uniform mat4 MVP; //represents the view and projection matrices combined (*viewProjection*)
 
+//Decode the positions of meshes in the compact vertex layout, identity for the full layout (see mesh.h)
+uniform vec3 PositionOffset = vec3(0.0);
+uniform vec3 PositionScale = vec3(1.0);
+uniform bool MergedDraw = false;
+
 out vec4 Position;
 out vec3 Normal;
 
 void main(){
 
-	vec4 pos = vec4(VertexPosition, 1.0);
+	vec3 positionOffset = MergedDraw ? DrawPositionOffset : PositionOffset;
+	vec3 positionScale = MergedDraw ? DrawPositionScale : PositionScale;
+	vec4 pos = vec4(positionOffset + VertexPosition * positionScale, 1.0);
 
 	//Wave equation -> y-coordinate of the surface
 	pos.y = A * sin(K * (pos.x - V * Time));
@@ -0,0 +1,193 @@
+// Copies CPU data into buffers and textures through a ring of staging buffers guarded by fences
+#ifndef STAGING_UPLOADER_H
+#define STAGING_UPLOADER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "profiler.h"
+
+// Every copy fills one staging buffer (a PBO for textures) and is followed by a fence. A staging buffer is only written
+// again once the GPU has passed its fence, so the CPU never waits for the driver to finish a copy: when the next slot
+// of the ring is still in flight, the copy functions stage nothing and the caller retries next frame. Copies larger
+// than a slot are split by the caller, see ModelStream.
+class StagingUploader
+{
+public:
+    StagingUploader(size_t slotSize = 1 << 20, unsigned int slotCount = 8) : size(slotSize), next(0)
+    {
+        slots.resize(slotCount);
+        for (Slot& slot : slots)
+        {
+            glGenBuffers(1, &slot.buffer);
+            glBindBuffer(GL_COPY_READ_BUFFER, slot.buffer);
+            glBufferData(GL_COPY_READ_BUFFER, size, NULL, GL_STREAM_DRAW);
+            slot.fence = 0;
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+
+    ~StagingUploader()
+    {
+        for (Slot& slot : slots)
+        {
+            if (slot.fence)
+                glDeleteSync(slot.fence);
+            glDeleteBuffers(1, &slot.buffer);
+        }
+    }
+
+    StagingUploader(const StagingUploader&) = delete;
+    StagingUploader& operator=(const StagingUploader&) = delete;
+
+    size_t slotSize() const { return size; }
+
+    // stages up to slotSize() bytes of data for buffer at offset, returns how many, 0 while the ring is busy
+    // ------------------------------------------------------------------------
+    size_t copyToBuffer(GLuint buffer, size_t offset, const void* data, size_t bytes)
+    {
+        if (bytes > size)
+            bytes = size;
+        Slot* slot = fill(data, bytes);
+        if (!slot)
+            return 0;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offset, bytes);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        fence(*slot);
+        return bytes;
+    }
+
+    // stages as many rows of a tightly packed texture level as fit into a slot, starting at firstRow. rows points
+    // at the first row of the level. Returns the number of rows, 0 while the ring is busy
+    // ------------------------------------------------------------------------
+    int copyToTexture(GLuint texture, int level, int width, int height, int firstRow, GLenum format, int components,
+                      const unsigned char* rows)
+    {
+        size_t rowSize = (size_t)width * components;
+        int count = height - firstRow;
+        if ((size_t)count * rowSize > size)
+            count = (int)(size / rowSize);
+        if (count == 0)
+        {
+            // a row wider than a slot is copied from client memory
+            uploadRows(texture, level, width, firstRow, 1, format, rows + firstRow * rowSize);
+            return 1;
+        }
+        Slot* slot = fill(rows + firstRow * rowSize, count * rowSize);
+        if (!slot)
+            return 0;
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->buffer);
+        uploadRows(texture, level, width, firstRow, count, format, (const void*)0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        fence(*slot);
+        return count;
+    }
+
+    // the same for a block compressed level, in rows of 4x4 blocks: stages as many block rows as fit into a slot,
+    // starting at firstRow. blocks points at the first block row of the level
+    // ------------------------------------------------------------------------
+    int copyToCompressedTexture(GLuint texture, int level, int width, int height, int firstRow, GLenum internalFormat,
+                                unsigned int blockBytes, const unsigned char* blocks)
+    {
+        size_t rowSize = (size_t)((width + 3) / 4) * blockBytes;
+        int count = (height + 3) / 4 - firstRow;
+        if ((size_t)count * rowSize > size)
+            count = (int)(size / rowSize);
+        if (count == 0)
+        {
+            uploadBlockRows(texture, level, width, height, firstRow, 1, internalFormat, rowSize, blocks + firstRow * rowSize);
+            return 1;
+        }
+        Slot* slot = fill(blocks + firstRow * rowSize, count * rowSize);
+        if (!slot)
+            return 0;
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->buffer);
+        uploadBlockRows(texture, level, width, height, firstRow, count, internalFormat, rowSize, (const void*)0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        fence(*slot);
+        return count;
+    }
+
+    // true once the GPU has finished every copy staged so far
+    // ------------------------------------------------------------------------
+    bool idle()
+    {
+        for (Slot& slot : slots)
+            if (slot.fence && !signaled(slot))
+                return false;
+        return true;
+    }
+
+private:
+    struct Slot {
+        GLuint buffer;
+        GLsync fence; // set after the copy from the slot was issued
+    };
+
+    size_t size;
+    std::vector<Slot> slots;
+    unsigned int next; // slots are used in ring order, the oldest copy is the first to finish
+
+    bool signaled(Slot& slot)
+    {
+        GLenum state = glClientWaitSync(slot.fence, 0, 0);
+        if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+            return false;
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+        return true;
+    }
+
+    // copies data into the next slot if the GPU is done with it, the slot is left bound to GL_COPY_READ_BUFFER
+    Slot* fill(const void* data, size_t bytes)
+    {
+        Slot& slot = slots[next];
+        if (slot.fence && !signaled(slot))
+            return nullptr;
+        PROFILE_ZONE("StagingUploader::fill");
+        glBindBuffer(GL_COPY_READ_BUFFER, slot.buffer);
+        void* mapped = glMapBufferRange(GL_COPY_READ_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (!mapped)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            return nullptr;
+        }
+        std::memcpy(mapped, data, bytes);
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+        next = (next + 1) % slots.size();
+        return &slot;
+    }
+
+    void fence(Slot& slot)
+    {
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    static void uploadRows(GLuint texture, int level, int width, int firstRow, int count, GLenum format, const void* pixels)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, firstRow, width, count, format, GL_UNSIGNED_BYTE, pixels);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // the last block row may be cut off by the bottom of the level
+    static void uploadBlockRows(GLuint texture, int level, int width, int height, int firstRow, int count,
+                                GLenum internalFormat, size_t rowSize, const void* blocks)
+    {
+        int y = firstRow * 4;
+        int rows = std::min(count * 4, height - y);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, y, width, rows, internalFormat, (GLsizei)(count * rowSize), blocks);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+};
+#endif
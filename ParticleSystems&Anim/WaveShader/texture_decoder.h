@@ -0,0 +1,244 @@
+// Decodes image files on worker threads and hands them to the GL thread for upload
+#ifndef TEXTURE_DECODER_H
+#define TEXTURE_DECODER_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "profiler.h"
+
+// uploads a decoded image into textureID and builds its mipmaps, on the GL thread
+inline void uploadTexture2D(unsigned int textureID, const unsigned char* data, int width, int height, int nrComponents, bool gamma)
+{
+    PROFILE_FUNCTION();
+    GLenum format, internalFormat;
+    if (nrComponents == 1)
+        internalFormat = format = GL_RED;
+    else if (nrComponents == 3)
+    {
+        format = GL_RGB;
+        internalFormat = gamma ? GL_SRGB : format;
+    }
+    else if (nrComponents == 4)
+    {
+        format = GL_RGBA;
+        internalFormat = gamma ? GL_SRGB_ALPHA : format;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+// the linear value of every 8 bit sRGB value, built once on first use by whichever thread gets there first
+inline const float* srgbToLinearTable()
+{
+    struct Table
+    {
+        float values[256];
+        Table()
+        {
+            for (int i = 0; i < 256; i++)
+            {
+                float c = i / 255.0f;
+                values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+        }
+    };
+    static const Table table;
+    return table.values;
+}
+
+inline unsigned char linearToSrgb(float linear)
+{
+    float c = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+    return (unsigned char)std::min(std::max(c * 255.0f + 0.5f, 0.0f), 255.0f);
+}
+
+// box filtered mip chain of a tightly packed image with 8 bit channels, levels[0] is a copy of the image. srgb
+// averages the color channels in linear space like glGenerateMipmap does for sRGB textures, alpha stays linear.
+inline std::vector<std::vector<unsigned char>> buildMipChain(const unsigned char* data, int width, int height, int components,
+                                                             bool srgb = false)
+{
+    PROFILE_FUNCTION();
+    const float* toLinear = srgbToLinearTable();
+    std::vector<std::vector<unsigned char>> levels(1, std::vector<unsigned char>(data, data + (size_t)width * height * components));
+    while (width > 1 || height > 1)
+    {
+        const std::vector<unsigned char>& source = levels.back();
+        int w = width > 1 ? width / 2 : 1;
+        int h = height > 1 ? height / 2 : 1;
+        std::vector<unsigned char> level((size_t)w * h * components);
+        for (int y = 0; y < h; y++)
+        {
+            // odd sizes drop their last row and column, a side of 1 averages its single texel with itself
+            const unsigned char* row0 = &source[(size_t)std::min(2 * y, height - 1) * width * components];
+            const unsigned char* row1 = &source[(size_t)std::min(2 * y + 1, height - 1) * width * components];
+            for (int x = 0; x < w; x++)
+            {
+                int x0 = std::min(2 * x, width - 1) * components;
+                int x1 = std::min(2 * x + 1, width - 1) * components;
+                for (int c = 0; c < components; c++)
+                {
+                    unsigned char& texel = level[((size_t)y * w + x) * components + c];
+                    if (srgb && c < 3)
+                        texel = linearToSrgb((toLinear[row0[x0 + c]] + toLinear[row0[x1 + c]] + toLinear[row1[x0 + c]] +
+                                              toLinear[row1[x1 + c]]) * 0.25f);
+                    else
+                        texel = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+                }
+            }
+        }
+        levels.push_back(std::move(level));
+        width = w;
+        height = h;
+    }
+    return levels;
+}
+
+// request() queues a file for one of the workers and returns immediately, the texture object is created by the
+// caller so meshes can reference it right away. finish() runs on the GL thread: it uploads every image as soon as
+// a worker has decoded it, while the others are still decoding, and returns once all requests are uploaded.
+// The workers live as long as the process, shared() is used by every Model.
+class TextureDecoder
+{
+public:
+    // threads = 0 uses one worker per hardware thread besides the GL thread
+    explicit TextureDecoder(unsigned int threads = 0) : stop(false), outstanding(0)
+    {
+        if (threads == 0)
+        {
+            unsigned int cores = std::thread::hardware_concurrency();
+            threads = cores > 1 ? cores - 1 : 1;
+        }
+        for (unsigned int i = 0; i < threads; i++)
+            workers.emplace_back(&TextureDecoder::workerLoop, this);
+    }
+
+    ~TextureDecoder()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stop = true;
+        }
+        jobReady.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+        for (Image& image : decoded)
+            stbi_image_free(image.data);
+    }
+
+    TextureDecoder(const TextureDecoder&) = delete;
+    TextureDecoder& operator=(const TextureDecoder&) = delete;
+
+    static TextureDecoder& shared()
+    {
+        static TextureDecoder decoder;
+        return decoder;
+    }
+
+    // decodes the file bytes (or reads filename if they are empty) on a worker, finish() uploads the image into
+    // the existing texture object textureID
+    // ------------------------------------------------------------------------
+    void request(const std::string& filename, std::vector<unsigned char> bytes, unsigned int textureID, bool gamma)
+    {
+        Image image;
+        image.filename = filename;
+        image.bytes = std::move(bytes);
+        image.textureID = textureID;
+        image.gamma = gamma;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            jobs.push_back(std::move(image));
+            outstanding++;
+        }
+        jobReady.notify_one();
+    }
+
+    // uploads decoded images in the order they finish until every request so far is done, on the GL thread
+    // ------------------------------------------------------------------------
+    void finish()
+    {
+        PROFILE_FUNCTION();
+        std::unique_lock<std::mutex> guard(lock);
+        while (outstanding > 0)
+        {
+            imageReady.wait(guard, [this] { return !decoded.empty(); });
+            Image image = std::move(decoded.front());
+            decoded.pop_front();
+            guard.unlock();
+
+            if (image.data)
+                uploadTexture2D(image.textureID, image.data, image.width, image.height, image.nrComponents, image.gamma);
+            else
+                std::cout << "Texture failed to load at path: " << image.filename << std::endl;
+            stbi_image_free(image.data);
+
+            guard.lock();
+            outstanding--;
+        }
+    }
+
+private:
+    struct Image {
+        std::string filename;
+        std::vector<unsigned char> bytes; // encoded file, released once decoded
+        unsigned int textureID;
+        bool gamma;
+        unsigned char* data = NULL;
+        int width = 0, height = 0, nrComponents = 0;
+    };
+
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable jobReady, imageReady;
+    std::deque<Image> jobs; // requested, not decoded yet
+    std::deque<Image> decoded; // waiting for the GL thread
+    bool stop;
+    unsigned int outstanding; // requested, not uploaded yet
+
+    void workerLoop()
+    {
+        PROFILE_THREAD_NAME("texture decoder");
+        std::unique_lock<std::mutex> guard(lock);
+        while (true)
+        {
+            jobReady.wait(guard, [this] { return stop || !jobs.empty(); });
+            if (stop)
+                return;
+            Image image = std::move(jobs.front());
+            jobs.pop_front();
+            guard.unlock();
+
+            {
+                PROFILE_ZONE("stbi_load");
+                if (image.bytes.empty())
+                    image.data = stbi_load(image.filename.c_str(), &image.width, &image.height, &image.nrComponents, 0);
+                else
+                    image.data = stbi_load_from_memory(image.bytes.data(), (int)image.bytes.size(), &image.width,
+                                                       &image.height, &image.nrComponents, 0);
+                std::vector<unsigned char>().swap(image.bytes);
+            }
+
+            guard.lock();
+            decoded.push_back(std::move(image));
+            imageReady.notify_one();
+        }
+    }
+};
+#endif
@@ -0,0 +1,93 @@
+// Offline mesh optimizer: imports a model like the projects do, reorders every mesh for the post-transform vertex
+// cache, overdraw and vertex fetch, and writes the result as the mesh cache next to the model (see mesh_cache.h).
+// Model then loads the optimized meshes instead of importing the model, as long as the model file is unchanged.
+//
+//   MeshOptimizer path/to/model.obj [--cache-size 16] [--no-overdraw]
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "model.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "usage: MeshOptimizer model.obj [--cache-size N] [--no-overdraw]" << std::endl;
+        return 1;
+    }
+    std::string path = argv[1];
+    unsigned int cacheSize = 16;
+    bool overdraw = true;
+    for (int i = 2; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc)
+            cacheSize = (unsigned int)std::max(3, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--no-overdraw") == 0)
+            overdraw = false;
+    }
+
+    // the runtime import does not weld, every triangle would have its own vertices and no cache could help. Welding
+    // and reordering do not change what is drawn, so the cache is written with the runtime flags and Model accepts it.
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS | aiProcess_JoinIdenticalVertices);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+        return 1;
+    }
+    std::vector<MeshData> meshes;
+    processNode(scene->mRootNode, scene, meshes);
+
+    size_t totalTriangles = 0, totalVertices = 0;
+    double missesBefore = 0.0, missesAfter = 0.0;
+    std::printf("FIFO cache of %u vertices\n", cacheSize);
+    for (unsigned int m = 0; m < meshes.size(); m++)
+    {
+        MeshData& mesh = meshes[m];
+        std::vector<unsigned int>& indices = mesh.indices;
+        CacheStats before = measureCache(indices, mesh.vertices.size(), cacheSize);
+
+        std::vector<size_t> clusters;
+        optimizeVertexCache(indices, mesh.vertices.size(), cacheSize, clusters);
+        if (overdraw)
+        {
+            std::vector<glm::vec3> positions(mesh.vertices.size());
+            for (size_t v = 0; v < mesh.vertices.size(); v++)
+                positions[v] = mesh.vertices[v].Position;
+            optimizeOverdraw(indices, positions, clusters);
+        }
+        std::vector<unsigned int> remap;
+        optimizeVertexFetch(indices, mesh.vertices.size(), remap);
+        std::vector<Vertex> vertices(remap.size());
+        for (size_t v = 0; v < remap.size(); v++)
+            vertices[v] = mesh.vertices[remap[v]];
+        mesh.vertices.swap(vertices);
+
+        CacheStats after = measureCache(indices, mesh.vertices.size(), cacheSize);
+        size_t triangles = indices.size() / 3;
+        std::printf("mesh %u: %zu triangles, %zu vertices, %zu clusters, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", m,
+                    triangles, mesh.vertices.size(), clusters.size(), before.acmr, after.acmr, before.atvr, after.atvr);
+        totalTriangles += triangles;
+        totalVertices += mesh.vertices.size();
+        missesBefore += before.acmr * triangles;
+        missesAfter += after.acmr * triangles;
+    }
+    if (totalTriangles > 0)
+        std::printf("total: %zu triangles, %zu vertices, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", totalTriangles,
+                    totalVertices, missesBefore / totalTriangles, missesAfter / totalTriangles,
+                    missesBefore / totalVertices, missesAfter / totalVertices);
+
+    if (!MeshCache::write(path, MODEL_IMPORT_FLAGS, meshes))
+    {
+        std::cout << "ERROR::MESH_CACHE::NOT_WRITTEN " << MeshCache::cachePath(path) << std::endl;
+        return 1;
+    }
+    std::cout << "wrote " << MeshCache::cachePath(path) << std::endl;
+    return 0;
+}
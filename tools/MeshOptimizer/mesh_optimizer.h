@@ -0,0 +1,196 @@
+// Triangle and vertex reordering for the post-transform vertex cache, overdraw and vertex fetch
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <vector>
+
+// The triangle order follows Tipsify (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and
+// Reduced Overdraw", 2007): it fans around the vertex that is most likely still in a cache of cacheSize entries and
+// falls back to recently used vertices at dead ends. Where it has to jump, the cache is mostly cold anyway, so those
+// jumps split the mesh into clusters that can be drawn in any order. The clusters are sorted so the ones that face
+// away from the center of the mesh come first; drawn from outside in, more hidden fragments fail the depth test.
+// Finally the vertices are renumbered in the order the index buffer first uses them.
+
+struct CacheStats {
+    float acmr; // average cache miss ratio: vertices transformed per triangle, 0.5 is ideal for large meshes, 3 the worst
+    float atvr; // average transformed vertex ratio: vertices transformed per vertex, 1 is ideal
+};
+
+// transformed vertices of a FIFO post-transform cache with cacheSize entries
+inline CacheStats measureCache(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize)
+{
+    std::vector<unsigned int> stamp(vertexCount, 0); // time of the vertex' last miss
+    unsigned int time = cacheSize + 1, misses = 0;
+    for (unsigned int index : indices)
+    {
+        if (time - stamp[index] > cacheSize)
+        {
+            stamp[index] = time++;
+            misses++;
+        }
+    }
+    CacheStats stats;
+    stats.acmr = indices.empty() ? 0.0f : misses / (indices.size() / 3.0f);
+    stats.atvr = vertexCount == 0 ? 0.0f : (float)misses / vertexCount;
+    return stats;
+}
+
+// reorders the triangles for the vertex cache, clusterStarts receives the first triangle of every cluster
+inline void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize,
+                                std::vector<size_t>& clusterStarts)
+{
+    size_t triangleCount = indices.size() / 3;
+    clusterStarts.clear();
+    if (triangleCount == 0)
+        return;
+
+    // triangles around every vertex
+    std::vector<unsigned int> live(vertexCount, 0), firstAdjacent(vertexCount + 1, 0), adjacent(indices.size());
+    for (unsigned int index : indices)
+        live[index]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        firstAdjacent[v + 1] = firstAdjacent[v] + live[v];
+    std::vector<unsigned int> filled(firstAdjacent.begin(), firstAdjacent.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+        adjacent[filled[indices[i]]++] = (unsigned int)(i / 3);
+
+    std::vector<unsigned int> stamp(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> deadEnds, candidates, output;
+    output.reserve(indices.size());
+    unsigned int time = cacheSize + 1;
+    size_t cursor = 0; // next vertex to look at once the dead end stack is empty
+    long fanning = 0;
+    clusterStarts.push_back(0);
+    while (fanning >= 0)
+    {
+        // emit every triangle around the fanning vertex
+        candidates.clear();
+        for (unsigned int a = firstAdjacent[fanning]; a < firstAdjacent[fanning + 1]; a++)
+        {
+            unsigned int triangle = adjacent[a];
+            if (emitted[triangle])
+                continue;
+            for (int corner = 0; corner < 3; corner++)
+            {
+                unsigned int v = indices[triangle * 3 + corner];
+                output.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - stamp[v] > cacheSize)
+                    stamp[v] = time++;
+            }
+            emitted[triangle] = true;
+        }
+
+        // the candidate that stays in the cache longest while all its triangles are emitted
+        long next = -1;
+        int best = -1;
+        for (unsigned int v : candidates)
+        {
+            if (live[v] == 0)
+                continue;
+            int priority = 0;
+            if (time - stamp[v] + 2 * live[v] <= cacheSize)
+                priority = (int)(time - stamp[v]);
+            if (priority > best)
+                best = priority, next = v;
+        }
+        if (next < 0)
+        {
+            // dead end: the most recent vertex with triangles left, otherwise the next one in input order
+            while (!deadEnds.empty() && next < 0)
+            {
+                unsigned int v = deadEnds.back();
+                deadEnds.pop_back();
+                if (live[v] > 0)
+                    next = v;
+            }
+            while (next < 0 && cursor < vertexCount)
+            {
+                if (live[cursor] > 0)
+                    next = (long)cursor;
+                cursor++;
+            }
+            if (next >= 0 && output.size() / 3 != clusterStarts.back())
+                clusterStarts.push_back(output.size() / 3);
+        }
+        fanning = next;
+    }
+    indices.swap(output);
+}
+
+// sorts the clusters of optimizeVertexCache() so the outward facing ones are drawn first
+inline void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+                             const std::vector<size_t>& clusterStarts)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (clusterStarts.size() < 2)
+        return;
+
+    glm::vec3 meshCenter(0.0f);
+    for (const glm::vec3& position : positions)
+        meshCenter += position;
+    meshCenter /= (float)std::max<size_t>(positions.size(), 1);
+
+    struct Cluster {
+        size_t first, last;
+        float sort;
+    };
+    std::vector<Cluster> clusters;
+    for (size_t c = 0; c < clusterStarts.size(); c++)
+    {
+        Cluster cluster;
+        cluster.first = clusterStarts[c];
+        cluster.last = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+
+        // area weighted center and normal
+        glm::vec3 center(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = cluster.first; t < cluster.last; t++)
+        {
+            const glm::vec3& p0 = positions[indices[t * 3]];
+            const glm::vec3& p1 = positions[indices[t * 3 + 1]];
+            const glm::vec3& p2 = positions[indices[t * 3 + 2]];
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float triangleArea = glm::length(n);
+            center += (p0 + p1 + p2) * (triangleArea / 3.0f);
+            normal += n;
+            area += triangleArea;
+        }
+        center = area > 0.0f ? center / area : positions[indices[cluster.first * 3]];
+        float length = glm::length(normal);
+        cluster.sort = length > 0.0f ? glm::dot(center - meshCenter, normal / length) : 0.0f;
+        clusters.push_back(cluster);
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sort > b.sort; });
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    for (const Cluster& cluster : clusters)
+        output.insert(output.end(), indices.begin() + cluster.first * 3, indices.begin() + cluster.last * 3);
+    indices.swap(output);
+}
+
+// renumbers the vertices in the order of first use, unused vertices are dropped. remap receives the old index of
+// every new vertex
+inline void optimizeVertexFetch(std::vector<unsigned int>& indices, size_t vertexCount, std::vector<unsigned int>& remap)
+{
+    const unsigned int UNUSED = 0xffffffffu;
+    std::vector<unsigned int> newIndex(vertexCount, UNUSED);
+    remap.clear();
+    for (unsigned int& index : indices)
+    {
+        if (newIndex[index] == UNUSED)
+        {
+            newIndex[index] = (unsigned int)remap.size();
+            remap.push_back(index);
+        }
+        index = newIndex[index];
+    }
+}
+#endif
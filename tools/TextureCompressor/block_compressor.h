@@ -0,0 +1,380 @@
+// Encoders for the 4x4 block compressed formats BC1, BC3, BC4, BC5 and BC7
+#ifndef BLOCK_COMPRESSOR_H
+#define BLOCK_COMPRESSOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Every block stores two endpoint colors and an index per texel that picks a color on the line between them. The
+// line starts out as the principal axis of the block's colors, cut off at their extremes, and is then refitted twice
+// to the indices chosen for it by least squares; the quantized endpoints with the smallest error are kept. That is
+// well short of an exhaustive search, but close enough for textures that are seen through a mipmapped sampler.
+//
+//   BC1  8 bytes: RGB565 endpoints, 2 bit indices (4 colors)
+//   BC4  8 bytes: one channel, 8 bit endpoints, 3 bit indices (8 values)
+//   BC3 16 bytes: BC4 alpha followed by BC1 color
+//   BC5 16 bytes: BC4 red followed by BC4 green
+//   BC7 16 bytes: mode 6 only, RGBA7777 endpoints with a shared low bit each, 4 bit indices (16 colors)
+enum BlockFormat { BLOCK_BC1, BLOCK_BC3, BLOCK_BC4, BLOCK_BC5, BLOCK_BC7 };
+
+inline unsigned int blockBytes(BlockFormat format)
+{
+    return format == BLOCK_BC1 || format == BLOCK_BC4 ? 8 : 16;
+}
+
+namespace bc
+{
+    // the texels of a block as floats, only the first channels of each are used
+    struct Block {
+        float texels[16][4];
+    };
+
+    // copies the block at (bx, by) of an RGBA8 image, blocks over the edge repeat the last row and column
+    inline void fetchBlock(const unsigned char* image, int width, int height, int bx, int by, Block& block)
+    {
+        for (int y = 0; y < 4; y++)
+            for (int x = 0; x < 4; x++)
+            {
+                const unsigned char* texel =
+                    image + ((size_t)std::min(by * 4 + y, height - 1) * width + std::min(bx * 4 + x, width - 1)) * 4;
+                for (int c = 0; c < 4; c++)
+                    block.texels[y * 4 + x][c] = texel[c];
+            }
+    }
+
+    inline float distance2(const float* a, const float* b, int channels)
+    {
+        float sum = 0.0f;
+        for (int c = 0; c < channels; c++)
+            sum += (a[c] - b[c]) * (a[c] - b[c]);
+        return sum;
+    }
+
+    // the line through the texels: their mean and the ends of the principal axis of their covariance
+    inline void fitLine(const Block& block, int channels, float start[4], float end[4])
+    {
+        float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < channels; c++)
+                mean[c] += block.texels[i][c] / 16.0f;
+        float covariance[4][4] = {};
+        for (int i = 0; i < 16; i++)
+            for (int a = 0; a < channels; a++)
+                for (int b = 0; b < channels; b++)
+                    covariance[a][b] += (block.texels[i][a] - mean[a]) * (block.texels[i][b] - mean[b]);
+
+        // power iteration, starting from the diagonal so a single varying channel is found right away
+        float axis[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int c = 0; c < channels; c++)
+            axis[c] = covariance[c][c];
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f }, length = 0.0f;
+            for (int a = 0; a < channels; a++)
+            {
+                for (int b = 0; b < channels; b++)
+                    next[a] += covariance[a][b] * axis[b];
+                length = std::max(length, std::fabs(next[a]));
+            }
+            if (length == 0.0f)
+                break;
+            for (int c = 0; c < channels; c++)
+                axis[c] = next[c] / length;
+        }
+
+        float low = 0.0f, high = 0.0f;
+        for (int i = 0; i < 16; i++)
+        {
+            float t = 0.0f;
+            for (int c = 0; c < channels; c++)
+                t += (block.texels[i][c] - mean[c]) * axis[c];
+            low = std::min(low, t);
+            high = std::max(high, t);
+        }
+        for (int c = 0; c < channels; c++)
+        {
+            start[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * low));
+            end[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * high));
+        }
+    }
+
+    // least squares endpoints for texels that sit at weights (0 = start, 1 = end) on the line, false if they all
+    // share one weight
+    inline bool refitLine(const Block& block, int channels, const float weights[16], float start[4], float end[4])
+    {
+        float aa = 0.0f, bb = 0.0f, ab = 0.0f, ax[4] = {}, bx[4] = {};
+        for (int i = 0; i < 16; i++)
+        {
+            float b = weights[i], a = 1.0f - b;
+            aa += a * a;
+            bb += b * b;
+            ab += a * b;
+            for (int c = 0; c < channels; c++)
+            {
+                ax[c] += a * block.texels[i][c];
+                bx[c] += b * block.texels[i][c];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) < 1e-6f)
+            return false;
+        for (int c = 0; c < channels; c++)
+        {
+            start[c] = std::min(255.0f, std::max(0.0f, (ax[c] * bb - bx[c] * ab) / determinant));
+            end[c] = std::min(255.0f, std::max(0.0f, (bx[c] * aa - ax[c] * ab) / determinant));
+        }
+        return true;
+    }
+
+    // nearest palette entry for every texel, returns the squared error
+    inline float assignIndices(const Block& block, int channels, const float palette[][4], int paletteSize,
+                               unsigned char indices[16])
+    {
+        float error = 0.0f;
+        for (int i = 0; i < 16; i++)
+        {
+            float best = distance2(block.texels[i], palette[0], channels);
+            indices[i] = 0;
+            for (int p = 1; p < paletteSize; p++)
+            {
+                float d = distance2(block.texels[i], palette[p], channels);
+                if (d < best)
+                    best = d, indices[i] = (unsigned char)p;
+            }
+            error += best;
+        }
+        return error;
+    }
+
+    // little endian bit stream of one block
+    struct BitWriter {
+        unsigned char* out;
+        unsigned int position;
+
+        explicit BitWriter(unsigned char* out, unsigned int bytes) : out(out), position(0) { std::memset(out, 0, bytes); }
+
+        void write(unsigned int value, unsigned int bits)
+        {
+            for (unsigned int b = 0; b < bits; b++, position++)
+                out[position / 8] |= (unsigned char)(((value >> b) & 1) << (position % 8));
+        }
+    };
+
+    inline unsigned int quantize565(const float color[4])
+    {
+        unsigned int r = (unsigned int)std::lround(color[0] * 31.0f / 255.0f);
+        unsigned int g = (unsigned int)std::lround(color[1] * 63.0f / 255.0f);
+        unsigned int b = (unsigned int)std::lround(color[2] * 31.0f / 255.0f);
+        return (r << 11) | (g << 5) | b;
+    }
+
+    inline void expand565(unsigned int color, float out[4])
+    {
+        unsigned int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+        out[0] = (float)((r << 3) | (r >> 2));
+        out[1] = (float)((g << 2) | (g >> 4));
+        out[2] = (float)((b << 3) | (b >> 2));
+        out[3] = 255.0f;
+    }
+
+    // the color half of BC1 and BC3, always in the four color mode
+    inline void encodeColor(const Block& block, unsigned char out[8])
+    {
+        float start[4], end[4];
+        fitLine(block, 3, start, end);
+
+        unsigned int bestColor0 = 0, bestColor1 = 0;
+        unsigned char bestIndices[16] = {};
+        float bestError = -1.0f;
+        for (int attempt = 0; attempt < 3; attempt++)
+        {
+            // the four color mode needs color0 > color1, the end with more weight goes first
+            unsigned int color0 = quantize565(end), color1 = quantize565(start);
+            if (color0 < color1)
+                std::swap(color0, color1);
+            unsigned char indices[16] = {};
+            float palette[4][4];
+            expand565(color0, palette[0]);
+            expand565(color1, palette[1]);
+            for (int c = 0; c < 3; c++)
+            {
+                palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+                palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+            }
+            float error = color0 == color1 ? assignIndices(block, 3, palette, 1, indices)
+                                           : assignIndices(block, 3, palette, 4, indices);
+            if (bestError < 0.0f || error < bestError)
+            {
+                bestError = error;
+                bestColor0 = color0;
+                bestColor1 = color1;
+                std::memcpy(bestIndices, indices, sizeof(indices));
+            }
+            if (color0 == color1)
+                break;
+
+            // palette[0] is the start of the refitted line
+            const float weightOf[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+            float weights[16];
+            for (int i = 0; i < 16; i++)
+                weights[i] = weightOf[indices[i]];
+            if (!refitLine(block, 3, weights, end, start))
+                break;
+        }
+
+        BitWriter writer(out, 8);
+        writer.write(bestColor0, 16);
+        writer.write(bestColor1, 16);
+        for (int i = 0; i < 16; i++)
+            writer.write(bestIndices[i], 2);
+    }
+
+    // one channel of BC3, BC4 and BC5 in the eight value mode: the extremes are exact, six values in between
+    inline void encodeChannel(const Block& block, int channel, unsigned char out[8])
+    {
+        float low = 255.0f, high = 0.0f;
+        for (int i = 0; i < 16; i++)
+        {
+            low = std::min(low, block.texels[i][channel]);
+            high = std::max(high, block.texels[i][channel]);
+        }
+        unsigned int value0 = (unsigned int)high, value1 = (unsigned int)low;
+
+        unsigned char indices[16] = {};
+        if (value0 > value1)
+        {
+            float palette[8][4];
+            palette[0][0] = (float)value0;
+            palette[1][0] = (float)value1;
+            for (int p = 2; p < 8; p++)
+                palette[p][0] = (float)(((8 - p) * value0 + (p - 1) * value1) / 7);
+            Block single;
+            for (int i = 0; i < 16; i++)
+                single.texels[i][0] = block.texels[i][channel];
+            assignIndices(single, 1, palette, 8, indices);
+        }
+
+        BitWriter writer(out, 8);
+        writer.write(value0, 8);
+        writer.write(value1, 8);
+        for (int i = 0; i < 16; i++)
+            writer.write(indices[i], 3);
+    }
+
+    // an RGBA endpoint of BC7 mode 6 as 7 bit channels and the low bit they share
+    struct Endpoint {
+        unsigned int channels[4];
+        unsigned int pbit;
+
+        void expand(float out[4]) const
+        {
+            for (int c = 0; c < 4; c++)
+                out[c] = (float)((channels[c] << 1) | pbit);
+        }
+    };
+
+    inline Endpoint quantizeEndpoint(const float color[4])
+    {
+        Endpoint best = {};
+        float bestError = -1.0f;
+        for (unsigned int pbit = 0; pbit < 2; pbit++)
+        {
+            Endpoint endpoint;
+            endpoint.pbit = pbit;
+            float expanded[4];
+            for (int c = 0; c < 4; c++)
+                endpoint.channels[c] = (unsigned int)std::min(127L, std::max(0L, std::lround((color[c] - pbit) / 2.0f)));
+            endpoint.expand(expanded);
+            float error = distance2(color, expanded, 4);
+            if (bestError < 0.0f || error < bestError)
+                bestError = error, best = endpoint;
+        }
+        return best;
+    }
+
+    inline void encodeBC7(const Block& block, unsigned char out[16])
+    {
+        static const int WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+        float start[4], end[4];
+        fitLine(block, 4, start, end);
+
+        Endpoint best0 = {}, best1 = {};
+        unsigned char bestIndices[16] = {};
+        float bestError = -1.0f;
+        for (int attempt = 0; attempt < 3; attempt++)
+        {
+            Endpoint endpoint0 = quantizeEndpoint(start), endpoint1 = quantizeEndpoint(end);
+            float expanded0[4], expanded1[4], palette[16][4];
+            endpoint0.expand(expanded0);
+            endpoint1.expand(expanded1);
+            for (int p = 0; p < 16; p++)
+                for (int c = 0; c < 4; c++)
+                    palette[p][c] = (float)(((64 - WEIGHTS[p]) * (int)expanded0[c] + WEIGHTS[p] * (int)expanded1[c] + 32) >> 6);
+            unsigned char indices[16];
+            float error = assignIndices(block, 4, palette, 16, indices);
+            if (bestError < 0.0f || error < bestError)
+            {
+                bestError = error;
+                best0 = endpoint0;
+                best1 = endpoint1;
+                std::memcpy(bestIndices, indices, sizeof(indices));
+            }
+
+            float weights[16];
+            for (int i = 0; i < 16; i++)
+                weights[i] = WEIGHTS[indices[i]] / 64.0f;
+            if (!refitLine(block, 4, weights, start, end))
+                break;
+        }
+
+        // the first index is stored without its high bit, so it has to be below 8
+        if (bestIndices[0] >= 8)
+        {
+            std::swap(best0, best1);
+            for (int i = 0; i < 16; i++)
+                bestIndices[i] = (unsigned char)(15 - bestIndices[i]);
+        }
+
+        BitWriter writer(out, 16);
+        writer.write(1 << 6, 7); // mode 6
+        for (int c = 0; c < 4; c++)
+        {
+            writer.write(best0.channels[c], 7);
+            writer.write(best1.channels[c], 7);
+        }
+        writer.write(best0.pbit, 1);
+        writer.write(best1.pbit, 1);
+        writer.write(bestIndices[0], 3);
+        for (int i = 1; i < 16; i++)
+            writer.write(bestIndices[i], 4);
+    }
+}
+
+// compresses an RGBA8 image of any size, blocks are stored row by row
+// ------------------------------------------------------------------------
+inline std::vector<unsigned char> compressImage(const unsigned char* rgba, int width, int height, BlockFormat format)
+{
+    int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    unsigned int bytes = blockBytes(format);
+    std::vector<unsigned char> output((size_t)blocksX * blocksY * bytes);
+    bc::Block block;
+    for (int by = 0; by < blocksY; by++)
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            unsigned char* out = &output[((size_t)by * blocksX + bx) * bytes];
+            bc::fetchBlock(rgba, width, height, bx, by, block);
+            switch (format)
+            {
+            case BLOCK_BC1: bc::encodeColor(block, out); break;
+            case BLOCK_BC3: bc::encodeChannel(block, 3, out); bc::encodeColor(block, out + 8); break;
+            case BLOCK_BC4: bc::encodeChannel(block, 0, out); break;
+            case BLOCK_BC5: bc::encodeChannel(block, 0, out); bc::encodeChannel(block, 1, out + 8); break;
+            case BLOCK_BC7: bc::encodeBC7(block, out); break;
+            }
+        }
+    return output;
+}
+#endif
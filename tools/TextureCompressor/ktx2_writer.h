@@ -0,0 +1,129 @@
+// Writes block compressed mip chains as KTX2 files that ktx_texture.h reads back
+#ifndef KTX2_WRITER_H
+#define KTX2_WRITER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ktx_texture.h"
+
+// The file is the header, the level index, a basic data format descriptor and the levels, smallest first. The
+// descriptor repeats what the format already says (KTX2 requires it): the color model of the block format, BT.709
+// primaries, the sRGB or linear transfer function and one sample per channel of the block.
+namespace ktx2
+{
+    // khr_df_model_e and the channel ids of the block formats
+    enum { MODEL_BC1A = 128, MODEL_BC3 = 130, MODEL_BC4 = 131, MODEL_BC5 = 132, MODEL_BC7 = 134 };
+    enum { CHANNEL_COLOR = 0, CHANNEL_GREEN = 1, CHANNEL_ALPHA = 15 };
+    enum { SAMPLE_LINEAR = 0x10 }; // an alpha channel is never sRGB encoded
+
+    struct Sample {
+        unsigned int channel, bitOffset, bitLength;
+        bool linear;
+    };
+
+    inline void put(std::vector<unsigned char>& out, uint32_t value)
+    {
+        for (int b = 0; b < 4; b++)
+            out.push_back((unsigned char)(value >> (8 * b)));
+    }
+
+    inline std::vector<unsigned char> descriptor(uint32_t vkFormat, unsigned int blockBytes)
+    {
+        bool srgb = vkFormat == KTX2_BC1_RGB_SRGB || vkFormat == KTX2_BC3_SRGB || vkFormat == KTX2_BC7_SRGB;
+        unsigned int model = MODEL_BC7;
+        std::vector<Sample> samples;
+        switch (vkFormat)
+        {
+        case KTX2_BC1_RGB_UNORM:
+        case KTX2_BC1_RGB_SRGB:
+            model = MODEL_BC1A;
+            samples.push_back({ CHANNEL_COLOR, 0, 64, false });
+            break;
+        case KTX2_BC3_UNORM:
+        case KTX2_BC3_SRGB:
+            model = MODEL_BC3;
+            samples.push_back({ CHANNEL_ALPHA, 0, 64, true });
+            samples.push_back({ CHANNEL_COLOR, 64, 64, false });
+            break;
+        case KTX2_BC4_UNORM:
+            model = MODEL_BC4;
+            samples.push_back({ CHANNEL_COLOR, 0, 64, false });
+            break;
+        case KTX2_BC5_UNORM:
+            model = MODEL_BC5;
+            samples.push_back({ CHANNEL_COLOR, 0, 64, false });
+            samples.push_back({ CHANNEL_GREEN, 64, 64, false });
+            break;
+        default:
+            samples.push_back({ CHANNEL_COLOR, 0, 128, false });
+        }
+
+        std::vector<unsigned char> out;
+        uint32_t blockSize = 24 + 16 * (uint32_t)samples.size();
+        put(out, 4 + blockSize); // total size
+        put(out, 0); // Khronos vendor, basic descriptor type
+        put(out, 2 | (blockSize << 16)); // version 1.3
+        put(out, model | (1 << 8) | ((srgb ? 2u : 1u) << 16)); // BT.709 primaries, transfer function, straight alpha
+        put(out, 3 | (3 << 8)); // 4x4x1x1 texels per block, stored minus one
+        put(out, blockBytes); // bytes of plane 0
+        put(out, 0);
+        for (const Sample& sample : samples)
+        {
+            bool linear = srgb && sample.linear;
+            put(out, sample.bitOffset | ((sample.bitLength - 1) << 16) | ((sample.channel | (linear ? SAMPLE_LINEAR : 0)) << 24));
+            put(out, 0); // sample position
+            put(out, 0); // lower
+            put(out, 0xffffffffu); // upper
+        }
+        return out;
+    }
+}
+
+// writes levels (level 0 first) of a width x height texture in vkFormat, false if the file could not be written
+// ------------------------------------------------------------------------
+inline bool writeKtx2(const std::string& path, uint32_t vkFormat, unsigned int blockBytes, int width, int height,
+                      const std::vector<std::vector<unsigned char>>& levels)
+{
+    std::vector<unsigned char> dfd = ktx2::descriptor(vkFormat, blockBytes);
+
+    Ktx2Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+    header.vkFormat = vkFormat;
+    header.typeSize = 1;
+    header.pixelWidth = (uint32_t)width;
+    header.pixelHeight = (uint32_t)height;
+    header.faceCount = 1;
+    header.levelCount = (uint32_t)levels.size();
+    header.dfdByteOffset = (uint32_t)(sizeof(Ktx2Header) + levels.size() * sizeof(Ktx2Level));
+    header.dfdByteLength = (uint32_t)dfd.size();
+
+    // every level starts at a multiple of the block size
+    std::vector<Ktx2Level> index(levels.size());
+    uint64_t offset = header.dfdByteOffset + dfd.size();
+    for (size_t i = levels.size(); i-- > 0;)
+    {
+        offset = (offset + blockBytes - 1) / blockBytes * blockBytes;
+        index[i].byteOffset = offset;
+        index[i].byteLength = index[i].uncompressedByteLength = levels[i].size();
+        offset += levels[i].size();
+    }
+
+    std::vector<unsigned char> file(offset, 0);
+    std::memcpy(&file[0], &header, sizeof(header));
+    std::memcpy(&file[sizeof(header)], index.data(), index.size() * sizeof(Ktx2Level));
+    std::memcpy(&file[header.dfdByteOffset], dfd.data(), dfd.size());
+    for (size_t i = 0; i < levels.size(); i++)
+        std::memcpy(&file[index[i].byteOffset], levels[i].data(), levels[i].size());
+
+    FILE* out = std::fopen(path.c_str(), "wb");
+    if (!out)
+        return false;
+    bool written = std::fwrite(file.data(), 1, file.size(), out) == file.size();
+    return std::fclose(out) == 0 && written;
+}
+#endif
@@ -0,0 +1,123 @@
+// Offline texture compressor: builds the mip chain of every image and writes it block compressed as a .ktx2 file
+// next to the image. Model and ModelStream load that file instead of the image whenever it exists (see
+// ktx_texture.h), so the textures stay compressed on the GPU and nothing is decoded or filtered at load time.
+//
+//   TextureCompressor image.png... [--format auto|bc1|bc3|bc4|bc5|bc7] [--srgb]
+//
+// auto picks BC4 for one channel images, BC1 for opaque ones and BC3 for images with alpha. --srgb marks color
+// textures (the diffuse maps, which the projects load as sRGB) and has no effect on BC4 and BC5.
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "texture_decoder.h" // includes the stb_image declarations, has to come before the implementation
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "block_compressor.h"
+#include "ktx2_writer.h"
+
+// the Vulkan format a block format is stored as
+static uint32_t vkFormatOf(BlockFormat format, bool srgb)
+{
+    switch (format)
+    {
+    case BLOCK_BC1: return srgb ? KTX2_BC1_RGB_SRGB : KTX2_BC1_RGB_UNORM;
+    case BLOCK_BC3: return srgb ? KTX2_BC3_SRGB : KTX2_BC3_UNORM;
+    case BLOCK_BC4: return KTX2_BC4_UNORM;
+    case BLOCK_BC5: return KTX2_BC5_UNORM;
+    default: return srgb ? KTX2_BC7_SRGB : KTX2_BC7_UNORM;
+    }
+}
+
+static const char* formatName(BlockFormat format)
+{
+    const char* names[] = { "BC1", "BC3", "BC4", "BC5", "BC7" };
+    return names[format];
+}
+
+static BlockFormat chooseFormat(const unsigned char* rgba, int width, int height, int components)
+{
+    if (components == 1)
+        return BLOCK_BC4;
+    for (size_t i = 0; components != 3 && i < (size_t)width * height; i++)
+        if (rgba[i * 4 + 3] != 255)
+            return BLOCK_BC3;
+    return BLOCK_BC1;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> images;
+    const char* formatOption = "auto";
+    bool srgb = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+            formatOption = argv[++i];
+        else if (std::strcmp(argv[i], "--srgb") == 0)
+            srgb = true;
+        else
+            images.push_back(argv[i]);
+    }
+    const char* formats[] = { "bc1", "bc3", "bc4", "bc5", "bc7" };
+    int forced = -1;
+    for (int f = 0; f < 5; f++)
+        if (std::strcmp(formatOption, formats[f]) == 0)
+            forced = f;
+    if (images.empty() || (forced < 0 && std::strcmp(formatOption, "auto") != 0))
+    {
+        std::cout << "usage: TextureCompressor image.png... [--format auto|bc1|bc3|bc4|bc5|bc7] [--srgb]" << std::endl;
+        return 1;
+    }
+
+    int failures = 0;
+    size_t totalBefore = 0, totalAfter = 0;
+    for (const std::string& path : images)
+    {
+        int width, height, components;
+        unsigned char* rgba = stbi_load(path.c_str(), &width, &height, &components, 4);
+        if (!rgba)
+        {
+            std::cout << "ERROR::TEXTURE::NOT_LOADED " << path << std::endl;
+            failures++;
+            continue;
+        }
+        BlockFormat format = forced >= 0 ? (BlockFormat)forced : chooseFormat(rgba, width, height, components);
+        bool useSrgb = srgb && format != BLOCK_BC4 && format != BLOCK_BC5;
+        std::vector<std::vector<unsigned char>> mips = buildMipChain(rgba, width, height, 4, useSrgb);
+        stbi_image_free(rgba);
+
+        // what the image costs on the GPU uncompressed, in the RGBA8 or RGB8 it is uploaded as
+        size_t before = 0, after = 0;
+        std::vector<std::vector<unsigned char>> levels;
+        int w = width, h = height;
+        for (const std::vector<unsigned char>& mip : mips)
+        {
+            levels.push_back(compressImage(mip.data(), w, h, format));
+            before += (size_t)w * h * components;
+            after += levels.back().size();
+            w = w > 1 ? w / 2 : 1;
+            h = h > 1 ? h / 2 : 1;
+        }
+
+        size_t dot = path.find_last_of('.'), slash = path.find_last_of("/\\");
+        std::string output = (dot == std::string::npos || (slash != std::string::npos && dot < slash) ? path : path.substr(0, dot)) + ".ktx2";
+        if (!writeKtx2(output, vkFormatOf(format, useSrgb), blockBytes(format), width, height, levels))
+        {
+            std::cout << "ERROR::TEXTURE::NOT_WRITTEN " << output << std::endl;
+            failures++;
+            continue;
+        }
+        std::printf("%s: %dx%d, %s%s, %zu levels, %.1f KB -> %.1f KB\n", output.c_str(), width, height, formatName(format),
+                    useSrgb ? " sRGB" : "", levels.size(), before / 1024.0, after / 1024.0);
+        totalBefore += before;
+        totalAfter += after;
+    }
+    if (totalAfter > 0)
+        std::printf("total: %.1f KB -> %.1f KB (%.1fx smaller)\n", totalBefore / 1024.0, totalAfter / 1024.0,
+                    (double)totalBefore / totalAfter);
+    return failures == 0 ? 0 : 1;
+}